@@ -0,0 +1,524 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Windowed aggregation of the values a tracer would log one by one.
+ *
+ * Every source (and target, if the value relates two objects) gets an HDR
+ * style histogram: values below 256 are counted exactly and above that
+ * every power of two is split in 128 buckets, so percentiles are within
+ * 1% of the real value. Values are clamped to 2^48, over three days in
+ * nanoseconds.
+ *
+ * When a value arrives after the window of its histogram is over, the
+ * window is logged as a single aggregate event and the histogram starts
+ * over. A flush thread logs the windows of the sources that stopped
+ * getting values, and the pending windows are logged when the aggregate is
+ * freed. Sources without values log nothing.
+ */
+
+#include <string.h>
+
+#include "gstaggregate.h"
+#include "gstctf.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_shark_aggregate_debug);
+#define GST_CAT_DEFAULT gst_shark_aggregate_debug
+
+#define SUB_BITS (8)
+#define SUB_COUNT (1 << SUB_BITS)
+#define HALF_COUNT (SUB_COUNT / 2)
+#define MAX_BITS (48)
+#define MAX_VALUE ((G_GUINT64_CONSTANT (1) << MAX_BITS) - 1)
+#define BUCKETS (SUB_COUNT + (MAX_BITS - SUB_BITS) * HALF_COUNT)
+
+struct _GstSharkAggregate
+{
+  gchar *series;
+  guint32 series_id;
+  GstClockTime window;
+
+  GMutex mutex;
+  GHashTable *histograms;
+  /* Offset from the monotonic time to the timestamps of the values, so
+     the flush thread can tell which windows are over */
+  GstClockTimeDiff ts_offset;
+  gboolean has_ts_offset;
+
+  GThread *flush_thread;
+  GCond flush_cond;
+  gboolean flush_running;
+};
+
+typedef struct _GstSharkHistogram GstSharkHistogram;
+struct _GstSharkHistogram
+{
+  guint64 key;
+  guint32 source_id;
+  guint32 target_id;
+  gchar *source;
+  gchar *target;
+
+  GstClockTime start;
+  guint64 count;
+  guint64 sum;
+  guint64 min;
+  guint64 max;
+  guint32 buckets[BUCKETS];
+};
+
+static GstTracerRecord *tr_aggregate;
+
+static void
+gst_shark_aggregate_init_once (void)
+{
+  static gsize initialized = 0;
+
+  if (!g_once_init_enter (&initialized)) {
+    return;
+  }
+
+  GST_DEBUG_CATEGORY_INIT (gst_shark_aggregate_debug, "sharkaggregate", 0,
+      "windowed aggregation of the tracer values");
+
+  tr_aggregate = gst_tracer_record_new ("aggregate.class",
+      "series", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_PROCESS, NULL),
+      "source", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_PAD, NULL),
+      "target", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_PAD, NULL),
+      "count", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "Values in the window",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL),
+      "min", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "Minimum value",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL),
+      "max", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "Maximum value",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL),
+      "mean", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "Mean value",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL),
+      "p50", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "50th percentile",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL),
+      "p90", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "90th percentile",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL),
+      "p99", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "99th percentile",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL),
+      "p999", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "99.9th percentile",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL), NULL);
+
+  /* Shared by every tracer aggregating, declared once in the metadata */
+  gst_ctf_add_event_metadata (AGGREGATE_EVENT_ID);
+
+  g_once_init_leave (&initialized, 1);
+}
+
+static guint
+bit_storage (guint64 value)
+{
+#ifdef __GNUC__
+  return 64 - __builtin_clzll (value);
+#else
+  guint bits;
+
+  for (bits = 0; value; bits++) {
+    value >>= 1;
+  }
+
+  return bits;
+#endif
+}
+
+guint
+gst_shark_aggregate_value_to_bucket (guint64 value)
+{
+  guint shift;
+
+  if (value < SUB_COUNT) {
+    return value;
+  }
+
+  value = MIN (value, MAX_VALUE);
+  shift = bit_storage (value) - SUB_BITS;
+
+  return SUB_COUNT + (shift - 1) * HALF_COUNT + (value >> shift) - HALF_COUNT;
+}
+
+guint64
+gst_shark_aggregate_bucket_to_value (guint bucket)
+{
+  guint64 sub;
+  guint shift;
+
+  if (bucket < SUB_COUNT) {
+    return bucket;
+  }
+
+  shift = (bucket - SUB_COUNT) / HALF_COUNT + 1;
+  sub = (bucket - SUB_COUNT) % HALF_COUNT + HALF_COUNT;
+
+  return ((sub + 1) << shift) - 1;
+}
+
+static void
+histogram_reset (GstSharkHistogram * histogram)
+{
+  histogram->count = 0;
+  histogram->sum = 0;
+  histogram->min = G_MAXUINT64;
+  histogram->max = 0;
+  memset (histogram->buckets, 0, sizeof (histogram->buckets));
+}
+
+static void
+histogram_stats (GstSharkHistogram * histogram, GstSharkAggregateStats * stats)
+{
+  static const guint per_mille[] = { 500, 900, 990, 999 };
+  guint64 *percentiles[G_N_ELEMENTS (per_mille)];
+  guint64 rank;
+  guint64 seen;
+  guint bucket;
+  guint i;
+
+  percentiles[0] = &stats->p500;
+  percentiles[1] = &stats->p900;
+  percentiles[2] = &stats->p990;
+  percentiles[3] = &stats->p999;
+
+  stats->count = histogram->count;
+  stats->min = histogram->min;
+  stats->max = histogram->max;
+  stats->mean = histogram->sum / histogram->count;
+
+  seen = 0;
+  i = 0;
+  for (bucket = 0; bucket < BUCKETS && i < G_N_ELEMENTS (per_mille); bucket++) {
+    seen += histogram->buckets[bucket];
+    /* Rank of the percentile, rounded up */
+    rank = (histogram->count * per_mille[i] + 999) / 1000;
+    while (i < G_N_ELEMENTS (per_mille) && seen >= rank) {
+      *percentiles[i] =
+          CLAMP (gst_shark_aggregate_bucket_to_value (bucket), histogram->min,
+          histogram->max);
+      i++;
+      if (i < G_N_ELEMENTS (per_mille)) {
+        rank = (histogram->count * per_mille[i] + 999) / 1000;
+      }
+    }
+  }
+}
+
+static void
+log_stats (GstSharkAggregate * self, GstSharkHistogram * histogram,
+    GstSharkAggregateStats * stats)
+{
+  if (gst_shark_tracer_log_enabled ()) {
+    gst_tracer_record_log (tr_aggregate, self->series, histogram->source,
+        histogram->target, stats->count, stats->min, stats->max, stats->mean,
+        stats->p500, stats->p900, stats->p990, stats->p999);
+  }
+
+  do_print_aggregate_event (self->series_id, histogram->source_id,
+      histogram->target_id, stats->count, stats->min, stats->max, stats->mean,
+      stats->p500, stats->p900, stats->p990, stats->p999);
+}
+
+/* With the mutex held */
+static guint32
+get_series_id (GstSharkAggregate * self)
+{
+  if (G_UNLIKELY (0 == self->series_id)) {
+    self->series_id = gst_ctf_intern_string (self->series);
+  }
+
+  return self->series_id;
+}
+
+/* Log the windows over at ts, or all the pending ones if ts is none */
+static void
+flush_histograms (GstSharkAggregate * self, GstClockTime ts)
+{
+  GstSharkHistogram *histogram;
+  GstSharkAggregateStats stats;
+  GHashTableIter iter;
+  gpointer value;
+
+  g_mutex_lock (&self->mutex);
+
+  g_hash_table_iter_init (&iter, self->histograms);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    histogram = (GstSharkHistogram *) value;
+
+    if (0 == histogram->count) {
+      continue;
+    }
+
+    if (GST_CLOCK_TIME_IS_VALID (ts)) {
+      if (ts <= histogram->start || ts - histogram->start < self->window) {
+        continue;
+      }
+      histogram->start = ts - (ts - histogram->start) % self->window;
+    }
+
+    get_series_id (self);
+    histogram_stats (histogram, &stats);
+    histogram_reset (histogram);
+    log_stats (self, histogram, &stats);
+  }
+
+  g_mutex_unlock (&self->mutex);
+}
+
+static gpointer
+flush_thread_func (gpointer data)
+{
+  GstSharkAggregate *self;
+  GstClockTimeDiff ts_offset;
+  gboolean has_ts_offset;
+  gint64 end_time;
+
+  self = (GstSharkAggregate *) data;
+
+  g_mutex_lock (&self->mutex);
+  while (self->flush_running) {
+    end_time = g_get_monotonic_time () + self->window / GST_USECOND;
+    while (self->flush_running
+        && g_cond_wait_until (&self->flush_cond, &self->mutex, end_time));
+    if (!self->flush_running) {
+      break;
+    }
+
+    ts_offset = self->ts_offset;
+    has_ts_offset = self->has_ts_offset;
+    g_mutex_unlock (&self->mutex);
+
+    if (has_ts_offset) {
+      flush_histograms (self, g_get_monotonic_time () * GST_USECOND -
+          ts_offset);
+    }
+
+    g_mutex_lock (&self->mutex);
+  }
+  g_mutex_unlock (&self->mutex);
+
+  return NULL;
+}
+
+/* Window of the aggregate param, none if the values are not aggregated */
+GstClockTime
+gst_shark_aggregate_get_window (GstSharkTracer * tracer)
+{
+  GstClockTime window;
+  GList *param;
+
+  g_return_val_if_fail (tracer, GST_CLOCK_TIME_NONE);
+
+  param = gst_shark_tracer_get_param (tracer, "aggregate");
+  if (NULL == param) {
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  window = gst_shark_tracer_parse_time (param->data, GST_SECOND);
+  if (!GST_CLOCK_TIME_IS_VALID (window) || 0 == window) {
+    GST_ERROR_OBJECT (tracer, "Invalid aggregate window \"%s\"",
+        (gchar *) param->data);
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  return window;
+}
+
+GstSharkAggregate *
+gst_shark_aggregate_new (const gchar * series, GstClockTime window)
+{
+  GstSharkAggregate *self;
+
+  g_return_val_if_fail (series, NULL);
+  g_return_val_if_fail (GST_CLOCK_TIME_IS_VALID (window), NULL);
+
+  gst_shark_aggregate_init_once ();
+
+  self = g_new0 (GstSharkAggregate, 1);
+  self->series = g_strdup (series);
+  self->window = window;
+  g_mutex_init (&self->mutex);
+  self->histograms = g_hash_table_new_full (g_int64_hash, g_int64_equal,
+      NULL, NULL);
+
+  g_cond_init (&self->flush_cond);
+  self->flush_running = TRUE;
+  self->flush_thread = g_thread_new ("GstSharkAggregate", flush_thread_func,
+      self);
+
+  GST_INFO ("Aggregating %s every %" GST_TIME_FORMAT, series,
+      GST_TIME_ARGS (window));
+
+  return self;
+}
+
+/* The names are only copied the first time the source and target are seen,
+   target may be 0 and NULL if the value relates to a single object */
+void
+gst_shark_aggregate_add (GstSharkAggregate * self, GstClockTime ts,
+    guint32 source_id, const gchar * source, guint32 target_id,
+    const gchar * target, guint64 value)
+{
+  GstSharkHistogram *histogram;
+  GstSharkAggregateStats stats;
+  gboolean window_over;
+  guint64 key;
+
+  g_return_if_fail (self);
+
+  key = ((guint64) source_id << 32) | target_id;
+  window_over = FALSE;
+
+  g_mutex_lock (&self->mutex);
+
+  if (G_UNLIKELY (!self->has_ts_offset)) {
+    self->ts_offset = GST_CLOCK_DIFF (ts, g_get_monotonic_time () *
+        GST_USECOND);
+    self->has_ts_offset = TRUE;
+  }
+
+  histogram = g_hash_table_lookup (self->histograms, &key);
+  if (G_UNLIKELY (NULL == histogram)) {
+    histogram = g_new (GstSharkHistogram, 1);
+    histogram->key = key;
+    histogram->source_id = source_id;
+    histogram->target_id = target_id;
+    histogram->source = g_strdup (source);
+    histogram->target = g_strdup (target ? target : "");
+    histogram->start = ts;
+    histogram_reset (histogram);
+    g_hash_table_insert (self->histograms, &histogram->key, histogram);
+  }
+
+  if (ts > histogram->start && ts - histogram->start >= self->window) {
+    if (histogram->count > 0) {
+      histogram_stats (histogram, &stats);
+      window_over = TRUE;
+    }
+    get_series_id (self);
+    histogram_reset (histogram);
+    /* Keep the windows aligned to the first one */
+    histogram->start = ts - (ts - histogram->start) % self->window;
+  }
+
+  histogram->count++;
+  histogram->sum += value;
+  histogram->min = MIN (histogram->min, value);
+  histogram->max = MAX (histogram->max, value);
+  histogram->buckets[gst_shark_aggregate_value_to_bucket (value)]++;
+
+  g_mutex_unlock (&self->mutex);
+
+  /* Histograms live as long as the aggregate, their names can be used
+     unlocked */
+  if (window_over) {
+    log_stats (self, histogram, &stats);
+  }
+}
+
+void
+gst_shark_aggregate_free (GstSharkAggregate * self)
+{
+  GHashTableIter iter;
+  gpointer value;
+  GstSharkHistogram *histogram;
+
+  if (NULL == self) {
+    return;
+  }
+
+  g_mutex_lock (&self->mutex);
+  self->flush_running = FALSE;
+  g_cond_signal (&self->flush_cond);
+  g_mutex_unlock (&self->mutex);
+  g_thread_join (self->flush_thread);
+  g_cond_clear (&self->flush_cond);
+
+  /* The last window of every source is not over yet */
+  flush_histograms (self, GST_CLOCK_TIME_NONE);
+
+  g_hash_table_iter_init (&iter, self->histograms);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    histogram = (GstSharkHistogram *) value;
+    g_free (histogram->source);
+    g_free (histogram->target);
+    g_free (histogram);
+  }
+  g_hash_table_unref (self->histograms);
+
+  g_mutex_clear (&self->mutex);
+  g_free (self->series);
+  g_free (self);
+}
+
+gboolean
+gst_shark_aggregate_get_stats (GstSharkAggregate * self, guint32 source_id,
+    guint32 target_id, GstSharkAggregateStats * stats)
+{
+  GstSharkHistogram *histogram;
+  gboolean ret;
+  guint64 key;
+
+  g_return_val_if_fail (self, FALSE);
+  g_return_val_if_fail (stats, FALSE);
+
+  key = ((guint64) source_id << 32) | target_id;
+
+  g_mutex_lock (&self->mutex);
+  histogram = g_hash_table_lookup (self->histograms, &key);
+  ret = NULL != histogram && histogram->count > 0;
+  if (ret) {
+    histogram_stats (histogram, stats);
+  }
+  g_mutex_unlock (&self->mutex);
+
+  return ret;
+}
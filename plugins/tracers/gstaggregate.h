@@ -0,0 +1,69 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __GST_SHARK_AGGREGATE_H__
+#define __GST_SHARK_AGGREGATE_H__
+
+#include "gstsharktracer.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GstSharkAggregate GstSharkAggregate;
+
+/* Summary of a window, percentiles are in per mille */
+typedef struct _GstSharkAggregateStats GstSharkAggregateStats;
+struct _GstSharkAggregateStats
+{
+  guint64 count;
+  guint64 min;
+  guint64 max;
+  guint64 mean;
+  guint64 p500;
+  guint64 p900;
+  guint64 p990;
+  guint64 p999;
+};
+
+GstClockTime gst_shark_aggregate_get_window (GstSharkTracer * tracer);
+
+GstSharkAggregate *gst_shark_aggregate_new (const gchar * series,
+    GstClockTime window);
+
+void gst_shark_aggregate_add (GstSharkAggregate * aggregate, GstClockTime ts,
+    guint32 source_id, const gchar * source, guint32 target_id,
+    const gchar * target, guint64 value);
+
+/* Summary of the current window of the source and target, FALSE if it
+   has no values yet */
+gboolean gst_shark_aggregate_get_stats (GstSharkAggregate * aggregate,
+    guint32 source_id, guint32 target_id, GstSharkAggregateStats * stats);
+
+void gst_shark_aggregate_free (GstSharkAggregate * aggregate);
+
+/* Values are counted in log-linear buckets, exact below 256 and within
+   1/128 of the value above */
+guint gst_shark_aggregate_value_to_bucket (guint64 value);
+
+/* Highest value counted by a bucket */
+guint64 gst_shark_aggregate_bucket_to_value (guint bucket);
+
+G_END_DECLS
+
+#endif /* __GST_SHARK_AGGREGATE_H__ */
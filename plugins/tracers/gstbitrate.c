@@ -37,7 +37,9 @@ struct _GstBitrateTracer
 {
   GstPeriodicTracer parent;
 
-  GHashTable *bitrate_counters;
+  /* Counters of every pad seen, each pad also points to its own */
+  GPtrArray *bitrate_counters;
+  GQuark counter_quark;
 };
 
 #define _do_init \
@@ -56,111 +58,129 @@ static void add_bytes (GstBitrateTracer * self, GstClockTime ts, GstPad * pad,
 static gboolean do_print_bitrate (GstPeriodicTracer * tracer);
 static void reset_counters (GstPeriodicTracer * tracer);
 
-typedef struct _GstBitrateHash GstBitrateHash;
+typedef struct _GstBitrateCounter GstBitrateCounter;
 
-struct _GstBitrateHash
+struct _GstBitrateCounter
 {
   gchar *fullname;
+  guint32 name_id;
   guint64 bitrate;
 };
 
-static const gchar bitrate_metadata_event[] = "event {\n\
-    name = bitrate;\n\
-    id = %d;\n\
-    stream_id = %d;\n\
-    fields := struct {\n\
-        string pad;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _bps;\n\
-    };\n\
-};\n\
-\n";
+static volatile gint bitrate_instances = 0;
 
 static gboolean
 do_print_bitrate (GstPeriodicTracer * tracer)
 {
   GstBitrateTracer *self;
-  GHashTableIter iter;
-  gpointer key, value;
-  GstBitrateHash *pad_table;
+  GstBitrateCounter *pad_table;
+  GstClockTime period;
+  guint64 bitrate;
+  guint64 bps;
+  guint i;
 
   self = GST_BITRATE_TRACER (tracer);
+  period = gst_periodic_tracer_get_period (tracer);
+
+  /* Lock the tracer to make sure no new pad is added while we are logging */
+  GST_OBJECT_LOCK (self);
 
-  /* Using the iterator functions to go through the Hash table and print the bitrate
-     of every element stored */
-  g_hash_table_iter_init (&iter, self->bitrate_counters);
-  while (g_hash_table_iter_next (&iter, &key, &value)) {
-    pad_table = (GstBitrateHash *) value;
+  /* Go through the counters and print the bitrate of every pad seen */
+  for (i = 0; i < self->bitrate_counters->len; i++) {
+    pad_table = g_ptr_array_index (self->bitrate_counters, i);
 
-    gst_tracer_record_log (tr_bitrate, pad_table->fullname, pad_table->bitrate);
-    do_print_bitrate_event (BITRATE_EVENT_ID, pad_table->fullname,
-        pad_table->bitrate);
+    /* Bits counted during the period, reported per second */
+    bitrate = GST_PERIODIC_COUNTER_TAKE (pad_table->bitrate);
+    bps = gst_util_uint64_scale (bitrate, GST_SECOND, period);
 
-    pad_table->bitrate = 0;
+    if (gst_shark_tracer_log_enabled ()) {
+      gst_tracer_record_log (tr_bitrate, pad_table->fullname, bps);
+    }
+    if (G_UNLIKELY (0 == pad_table->name_id)) {
+      pad_table->name_id = gst_ctf_intern_string (pad_table->fullname);
+    }
+    do_print_bitrate_event (pad_table->name_id, bps);
   }
 
+  GST_OBJECT_UNLOCK (self);
+
   return TRUE;
 }
 
 static void
-do_destroy_hashtable_value (gpointer data)
+free_counter (gpointer data)
 {
-  GstBitrateHash *value;
+  GstBitrateCounter *value;
 
-  /* In order to properly free the memory of a element of the Hash table
-     it is needed to free the memory of the structure in every value */
-  value = (GstBitrateHash *) data;
+  value = (GstBitrateCounter *) data;
 
   g_free (value->fullname);
   g_free (value);
 }
 
-static void
-do_destroy_hashtable_key (gpointer data)
-{
-  gst_object_unref (data);
-}
-
-static void
-add_bytes (GstBitrateTracer * self, GstClockTime ts, GstPad * pad,
-    guint64 bytes)
+/* The counter of a pad is created the first time it is seen, the
+   tracer owns it and the pad keeps a pointer to it */
+static GstBitrateCounter *
+get_counter (GstBitrateTracer * self, GstPad * pad)
 {
+  GstBitrateCounter *pad_frames;
   gchar *fullname;
-  GstBitrateHash *pad_frames;
 
-  pad_frames = g_hash_table_lookup (self->bitrate_counters, pad);
+  pad_frames = g_object_get_qdata (G_OBJECT (pad), self->counter_quark);
+  if (G_LIKELY (NULL != pad_frames)) {
+    return pad_frames;
+  }
 
-  if (NULL == pad_frames) {
-    /* The full name of every pad has the format elementName.padName and it is going 
-       to be used for displaying the bitrate in a friendly user way */
-    fullname = g_strdup_printf ("%s_%s", GST_DEBUG_PAD_NAME (pad));
-    fullname = make_char_array_valid (fullname);
+  /* The full name of every pad has the format elementName.padName and it is going 
+     to be used for displaying the bitrate in a friendly user way */
+  fullname = g_strdup_printf ("%s_%s", GST_DEBUG_PAD_NAME (pad));
+  fullname = make_char_array_valid (fullname);
 
-    GST_INFO_OBJECT (self, "The %s key was added to the Hash Table", fullname);
+  pad_frames = g_malloc0 (sizeof (GstBitrateCounter));
+  pad_frames->fullname = fullname;
+  pad_frames->name_id = gst_ctf_intern_string (fullname);
 
-    pad_frames = g_malloc0 (sizeof (GstBitrateHash));
-    pad_frames->fullname = fullname;
-    g_hash_table_insert (self->bitrate_counters, gst_object_ref (pad),
-        (gpointer) pad_frames);
+  /* Another streaming thread may have seen the pad meanwhile */
+  if (!g_object_replace_qdata (G_OBJECT (pad), self->counter_quark, NULL,
+          pad_frames, NULL, NULL)) {
+    free_counter (pad_frames);
+    return g_object_get_qdata (G_OBJECT (pad), self->counter_quark);
   }
 
-  pad_frames->bitrate += bytes * 8;
+  GST_OBJECT_LOCK (self);
+  g_ptr_array_add (self->bitrate_counters, pad_frames);
+  GST_OBJECT_UNLOCK (self);
+
+  GST_INFO_OBJECT (self, "Counting the bitrate of %s", fullname);
+
+  return pad_frames;
+}
+
+static void
+add_bytes (GstBitrateTracer * self, GstClockTime ts, GstPad * pad,
+    guint64 bytes)
+{
+  GstBitrateCounter *pad_frames;
+
+  pad_frames = get_counter (self, pad);
+  GST_PERIODIC_COUNTER_ADD (pad_frames->bitrate, bytes * 8);
 }
 
 static void
 reset_counters (GstPeriodicTracer * tracer)
 {
   GstBitrateTracer *self;
-  GstBitrateHash *pad_table;
-  GHashTableIter iter;
-  gpointer key, value;
+  GstBitrateCounter *pad_table;
+  guint i;
 
   self = GST_BITRATE_TRACER (tracer);
 
-  g_hash_table_iter_init (&iter, self->bitrate_counters);
-  while (g_hash_table_iter_next (&iter, &key, &value)) {
-    pad_table = (GstBitrateHash *) value;
-    pad_table->bitrate = 0;
+  GST_OBJECT_LOCK (self);
+  for (i = 0; i < self->bitrate_counters->len; i++) {
+    pad_table = g_ptr_array_index (self->bitrate_counters, i);
+    GST_PERIODIC_COUNTER_TAKE (pad_table->bitrate);
   }
+  GST_OBJECT_UNLOCK (self);
 }
 
 static void
@@ -200,7 +220,7 @@ gst_bitrate_tracer_finalize (GObject * obj)
 {
   GstBitrateTracer *self = GST_BITRATE_TRACER (obj);
 
-  g_hash_table_destroy (self->bitrate_counters);
+  g_ptr_array_free (self->bitrate_counters, TRUE);
 
   G_OBJECT_CLASS (parent_class)->finalize (obj);
 }
@@ -235,10 +255,15 @@ static void
 gst_bitrate_tracer_init (GstBitrateTracer * self)
 {
   GstSharkTracer *tracer = GST_SHARK_TRACER (self);
+  gchar *quark_name;
+
+  self->bitrate_counters = g_ptr_array_new_with_free_func (free_counter);
 
-  self->bitrate_counters =
-      g_hash_table_new_full (g_direct_hash, g_direct_equal,
-      do_destroy_hashtable_key, do_destroy_hashtable_value);
+  /* Every instance keeps its own counter in the pads */
+  quark_name = g_strdup_printf ("GstSharkBitrate%d",
+      g_atomic_int_add (&bitrate_instances, 1));
+  self->counter_quark = g_quark_from_string (quark_name);
+  g_free (quark_name);
 
   gst_shark_tracer_register_hook (tracer, "pad-push-pre",
       G_CALLBACK (do_pad_push_buffer_pre));
@@ -251,13 +276,8 @@ gst_bitrate_tracer_init (GstBitrateTracer * self)
 static void
 create_metadata_event (GstPeriodicTracer * tracer)
 {
-  gchar *metadata_event;
-
   /* Add event in metadata file */
-  metadata_event =
-      g_strdup_printf (bitrate_metadata_event, BITRATE_EVENT_ID, 0);
-  add_metadata_event_struct (metadata_event);
-  g_free (metadata_event);
+  gst_ctf_add_event_metadata (BITRATE_EVENT_ID);
 }
 
 static gchar *
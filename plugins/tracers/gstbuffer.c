@@ -50,24 +50,6 @@ static void gst_buffer_range_post (GObject * self, GstClockTime ts,
 
 static GstTracerRecord *tr_buffer;
 
-static const gchar buffer_metadata_event[] = "event {\n\
-    name = buffer;\n\
-    id = %d;\n\
-    stream_id = %d;\n\
-    fields := struct {\n\
-        string pad;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } pts;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } dts;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } duration;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } offset;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } offset_end;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } size;\n\
-        integer { size = 32; align = 8; signed = 0; encoding = none; base = 10; } flags;\n\
-        integer { size = 32; align = 8; signed = 0; encoding = none; base = 10; } refcount;\n\
-    };\n\
-};\n\
-\n";
-
 static void
 gst_buffer_buffer_pre (GObject * self, GstClockTime ts, GstPad * pad,
     GstBuffer * buffer)
@@ -87,41 +69,39 @@ gst_buffer_buffer_pre (GObject * self, GstClockTime ts, GstPad * pad,
   gchar *sflags;
   guint refcount;
 
-  pad_name = g_strdup_printf ("%s:%s", GST_DEBUG_PAD_NAME (pad));
-
   pts = GST_BUFFER_PTS (buffer);
-  spts = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (pts));
-
   dts = GST_BUFFER_DTS (buffer);
-  sdts = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (dts));
-
   duration = GST_BUFFER_DURATION (buffer);
-  sduration = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (duration));
-
   offset = GST_BUFFER_OFFSET (buffer);
   offset_end = GST_BUFFER_OFFSET_END (buffer);
-
   size = gst_buffer_get_size (buffer);
-
   flags = GST_BUFFER_FLAGS (buffer);
-  g_value_init (&vflags, GST_TYPE_BUFFER_FLAGS);
-  g_value_set_flags (&vflags, flags);
-  sflags = gst_value_serialize (&vflags);
-
   refcount = GST_MINI_OBJECT_REFCOUNT_VALUE (buffer);
 
-  gst_tracer_record_log (tr_buffer, pad_name, spts, sdts, sduration, offset,
-      offset_end, size, sflags, refcount);
-
-  do_print_buffer_event (BUFFER_EVENT_ID, pad_name, pts, dts, duration,
-      offset, offset_end, size, flags, refcount);
+  if (gst_shark_tracer_log_enabled ()) {
+    pad_name = g_strdup_printf ("%s:%s", GST_DEBUG_PAD_NAME (pad));
+    spts = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (pts));
+    sdts = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (dts));
+    sduration =
+        g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (duration));
+
+    g_value_init (&vflags, GST_TYPE_BUFFER_FLAGS);
+    g_value_set_flags (&vflags, flags);
+    sflags = gst_value_serialize (&vflags);
+
+    gst_tracer_record_log (tr_buffer, pad_name, spts, sdts, sduration, offset,
+        offset_end, size, sflags, refcount);
+
+    g_value_unset (&vflags);
+    g_free (spts);
+    g_free (sdts);
+    g_free (sduration);
+    g_free (sflags);
+    g_free (pad_name);
+  }
 
-  g_value_unset (&vflags);
-  g_free (spts);
-  g_free (sdts);
-  g_free (sduration);
-  g_free (sflags);
-  g_free (pad_name);
+  do_print_buffer_event (gst_ctf_pad_name_id (pad), pts, dts, duration, offset,
+      offset_end, size, flags, refcount);
 }
 
 static void
@@ -182,7 +162,6 @@ static void
 gst_buffer_tracer_init (GstBufferTracer * self)
 {
   GstSharkTracer *tracer = GST_SHARK_TRACER (self);
-  gchar *metadata_event = NULL;
 
   gst_shark_tracer_register_hook (tracer, "pad-push-pre",
       G_CALLBACK (gst_buffer_buffer_pre));
@@ -193,7 +172,5 @@ gst_buffer_tracer_init (GstBufferTracer * self)
   gst_shark_tracer_register_hook (tracer, "pad-pull-range-post",
       G_CALLBACK (gst_buffer_range_post));
 
-  metadata_event = g_strdup_printf (buffer_metadata_event, BUFFER_EVENT_ID, 0);
-  add_metadata_event_struct (metadata_event);
-  g_free (metadata_event);
+  gst_ctf_add_event_metadata (BUFFER_EVENT_ID);
 }
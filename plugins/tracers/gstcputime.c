@@ -0,0 +1,261 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/**
+ * SECTION:gstcputime
+ * @short_description: log per element cpu time
+ *
+ * A tracing module that measures, at the same points proctime does, how
+ * much thread CPU time an element consumes next to the wall time it takes
+ * to process a buffer. An element that burns CPU reports both times close
+ * to each other, while one waiting on locks, I/O or the scheduler reports
+ * a wall time well above its CPU time.
+ *
+ * Time spent by downstream elements running in the same thread, within a
+ * push, is not charged to the pushing element.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <time.h>
+#include <sys/resource.h>
+
+#include "gstcputime.h"
+#include "gstctf.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_cpu_time_debug);
+#define GST_CAT_DEFAULT gst_cpu_time_debug
+
+/**
+ * GstCpuTimeTracer:
+ *
+ * Opaque #GstCpuTimeTracer data structure
+ */
+struct _GstCpuTimeTracer
+{
+  GstSharkTracer parent;
+};
+
+/* Values accounted in the frames of a thread */
+enum
+{
+  FRAME_WALL,
+  FRAME_CPU
+};
+
+#define _do_init \
+    GST_DEBUG_CATEGORY_INIT (gst_cpu_time_debug, "cputime", 0, "cputime tracer");
+
+G_DEFINE_TYPE_WITH_CODE (GstCpuTimeTracer, gst_cpu_time_tracer,
+    GST_SHARK_TYPE_TRACER, _do_init);
+
+static GstTracerRecord *tr_cpu_time;
+
+/* Pushes and pulls in progress in the current thread. The data of a frame
+ * is the element processing it until the call returns. */
+static GPrivate cputime_frames = G_PRIVATE_INIT ((GDestroyNotify)
+    g_array_unref);
+
+/* CPU time consumed by the current thread */
+static GstClockTime
+thread_cpu_time (void)
+{
+#if defined (CLOCK_THREAD_CPUTIME_ID)
+  struct timespec now;
+
+  if (0 == clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now)) {
+    return GST_TIMESPEC_TO_TIME (now);
+  }
+#elif defined (RUSAGE_THREAD)
+  struct rusage usage;
+
+  if (0 == getrusage (RUSAGE_THREAD, &usage)) {
+    return GST_TIMEVAL_TO_TIME (usage.ru_utime) +
+        GST_TIMEVAL_TO_TIME (usage.ru_stime);
+  }
+#endif
+
+  return GST_CLOCK_TIME_NONE;
+}
+
+/* Thread CPU time as a frame value, 0 if not available */
+static guint64
+frame_cpu_time (void)
+{
+  GstClockTime cpu;
+
+  cpu = thread_cpu_time ();
+
+  return GST_CLOCK_TIME_IS_VALID (cpu) ? cpu : 0;
+}
+
+static void
+push_frame (guint64 ts, GstPad * pad)
+{
+  guint64 start[GST_SHARK_FRAME_VALUES] = { 0 };
+  GstPad *peer;
+  GstElement *element;
+  GArray *frames;
+
+  peer = gst_pad_get_peer (pad);
+  if (NULL == peer) {
+    return;
+  }
+
+  element = gst_pad_get_parent_element (peer);
+  gst_object_unref (peer);
+  if (NULL == element) {
+    return;
+  }
+
+  frames = gst_shark_tracer_get_frames (&cputime_frames);
+  start[FRAME_WALL] = ts;
+  /* Sampled last so the bookkeeping above is not charged to the element */
+  start[FRAME_CPU] = frame_cpu_time ();
+
+  gst_shark_tracer_push_frame (frames, pad, element, start);
+}
+
+static void
+pop_frame (GstTracer * self, guint64 ts, GstPad * pad)
+{
+  guint64 end[GST_SHARK_FRAME_VALUES] = { 0 };
+  guint64 exclusive[GST_SHARK_FRAME_VALUES];
+  GstSharkFrame frame;
+  GstElement *element;
+  gchar time_string[GST_SHARK_TIME_STRING_SIZE];
+  gchar cpu_time_string[GST_SHARK_TIME_STRING_SIZE];
+
+  end[FRAME_CPU] = frame_cpu_time ();
+  end[FRAME_WALL] = ts;
+
+  /* The pre hook skips pads without a peer element */
+  if (!gst_shark_tracer_pop_frame (gst_shark_tracer_get_frames
+          (&cputime_frames), pad, end, &frame, exclusive)) {
+    return;
+  }
+
+  /* The whole call is processing time of the element pushing it, the
+     element called is only charged with the time outside nested calls */
+  element = frame.data;
+
+  if (gst_shark_tracer_object_is_filtered (GST_SHARK_TRACER (self),
+          GST_OBJECT (element))) {
+    if (gst_shark_tracer_log_enabled ()) {
+      g_snprintf (time_string, sizeof (time_string), "%" GST_TIME_FORMAT,
+          GST_TIME_ARGS (exclusive[FRAME_WALL]));
+      g_snprintf (cpu_time_string, sizeof (cpu_time_string),
+          "%" GST_TIME_FORMAT, GST_TIME_ARGS (exclusive[FRAME_CPU]));
+      gst_tracer_record_log (tr_cpu_time, GST_OBJECT_NAME (element),
+          time_string, cpu_time_string);
+    }
+
+    do_print_cputime_event (gst_ctf_element_name_id (element),
+        exclusive[FRAME_WALL], exclusive[FRAME_CPU]);
+  }
+
+  gst_object_unref (element);
+}
+
+static void
+do_push_buffer_pre (GstTracer * self, guint64 ts, GstPad * pad,
+    GstBuffer * buffer)
+{
+  push_frame (ts, pad);
+}
+
+static void
+do_push_list_pre (GstTracer * self, guint64 ts, GstPad * pad,
+    GstBufferList * list)
+{
+  push_frame (ts, pad);
+}
+
+static void
+do_pull_range_pre (GstTracer * self, guint64 ts, GstPad * pad,
+    guint64 offset, guint size)
+{
+  push_frame (ts, pad);
+}
+
+static void
+do_push_post (GstTracer * self, guint64 ts, GstPad * pad, GstFlowReturn res)
+{
+  pop_frame (self, ts, pad);
+}
+
+static void
+do_pull_range_post (GstTracer * self, guint64 ts, GstPad * pad,
+    GstBuffer * buffer, GstFlowReturn res)
+{
+  pop_frame (self, ts, pad);
+}
+
+/* tracer class */
+
+static void
+gst_cpu_time_tracer_class_init (GstCpuTimeTracerClass * klass)
+{
+  tr_cpu_time = gst_tracer_record_new ("cputime.class",
+      "element", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_ELEMENT, NULL),
+      "time", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_PROCESS, NULL),
+      "cpu_time", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_THREAD, NULL), NULL);
+}
+
+static void
+gst_cpu_time_tracer_init (GstCpuTimeTracer * self)
+{
+  GstTracer *tracer = GST_TRACER (self);
+
+  if (!GST_CLOCK_TIME_IS_VALID (thread_cpu_time ())) {
+    GST_WARNING_OBJECT (self, "Thread CPU clock not available, "
+        "CPU times will be reported as 0");
+  }
+
+  gst_tracing_register_hook (tracer, "pad-push-pre",
+      G_CALLBACK (do_push_buffer_pre));
+
+  gst_tracing_register_hook (tracer, "pad-push-post",
+      G_CALLBACK (do_push_post));
+
+  gst_tracing_register_hook (tracer, "pad-push-list-pre",
+      G_CALLBACK (do_push_list_pre));
+
+  gst_tracing_register_hook (tracer, "pad-push-list-post",
+      G_CALLBACK (do_push_post));
+
+  gst_tracing_register_hook (tracer, "pad-pull-range-pre",
+      G_CALLBACK (do_pull_range_pre));
+
+  gst_tracing_register_hook (tracer, "pad-pull-range-post",
+      G_CALLBACK (do_pull_range_post));
+
+  gst_ctf_add_event_metadata (CPUTIME_EVENT_ID);
+}
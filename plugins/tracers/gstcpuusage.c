@@ -22,11 +22,16 @@
  * @short_description: log cpu usage stats
  *
  * A tracing module that take cpuusage() snapshots and logs them.
+ *
+ * With mode=process the CPU time of this process and of each of its
+ * threads is logged instead of the load of every core. Streaming
+ * threads are named after the pad whose task they run.
  */
 
 #include <glib/gstdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/syscall.h>
 
 #include "gstcpuusage.h"
 #include "gstcpuusagecompute.h"
@@ -39,6 +44,9 @@ struct _GstCPUUsageTracer
 {
   GstPeriodicTracer parent;
   GstCPUUsage cpu_usage;
+
+  gboolean process;
+  GstProcessUsage process_usage;
 };
 
 #define _do_init \
@@ -48,6 +56,11 @@ G_DEFINE_TYPE_WITH_CODE (GstCPUUsageTracer, gst_cpu_usage_tracer,
     GST_TYPE_PERIODIC_TRACER, _do_init);
 
 static GstTracerRecord *tr_cpuusage;
+static GstTracerRecord *tr_process_cpuusage;
+static GstTracerRecord *tr_thread_cpuusage;
+
+/* The task pad last seen by each streaming thread */
+static GPrivate cpuusage_thread_pad;
 
 static const gchar cpuusage_metadata_event_header[] = "\
 event {\n\
@@ -69,6 +82,8 @@ static void cpuusage_dummy_bin_add_post (GObject * obj, GstClockTime ts,
 static gboolean cpu_usage_thread_func (GstPeriodicTracer * tracer);
 static void create_metadata_event (GstPeriodicTracer * tracer);
 static void reset_counters (GstPeriodicTracer * tracer);
+static void gst_cpu_usage_tracer_constructed (GObject * object);
+static void gst_cpu_usage_tracer_finalize (GObject * object);
 
 static void
 cpuusage_dummy_bin_add_post (GObject * obj, GstClockTime ts,
@@ -84,7 +99,68 @@ reset_counters (GstPeriodicTracer * tracer)
 
   self = GST_CPU_USAGE_TRACER (tracer);
 
-  gst_cpu_usage_init (&(self->cpu_usage));
+  if (self->process) {
+    gst_process_usage_reset (&self->process_usage);
+  } else {
+    gst_cpu_usage_reset (&self->cpu_usage);
+  }
+}
+
+/* A pad with a task is pushed, or pulled, from the thread of the task */
+static void
+do_pad_task_pre (GstCPUUsageTracer * self, GstClockTime ts, GstPad * pad)
+{
+  if (G_LIKELY (NULL == GST_PAD_TASK (pad)
+          || g_private_get (&cpuusage_thread_pad) == pad)) {
+    return;
+  }
+
+  g_private_set (&cpuusage_thread_pad, pad);
+  gst_process_usage_set_thread_name (&self->process_usage,
+      (gint) syscall (SYS_gettid), gst_shark_tracer_pad_name (pad));
+}
+
+static gboolean
+process_usage_thread_func (GstCPUUsageTracer * self)
+{
+  GstProcessUsage *process_usage;
+  GstThreadUsage *thread;
+  GHashTableIter iter;
+  gpointer value;
+  GstClockTime period;
+
+  process_usage = &self->process_usage;
+  period = gst_periodic_tracer_get_period (GST_PERIODIC_TRACER (self));
+
+  gst_process_usage_compute (process_usage);
+
+  if (gst_shark_tracer_log_enabled ()) {
+    gst_tracer_record_log (tr_process_cpuusage,
+        100.0 * process_usage->cpu_time / period);
+  }
+  do_print_process_cpuusage_event (process_usage->cpu_time, period);
+
+  g_mutex_lock (&process_usage->lock);
+  g_hash_table_iter_init (&iter, process_usage->threads);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    thread = (GstThreadUsage *) value;
+    if (NULL == thread->name) {
+      continue;
+    }
+
+    if (gst_shark_tracer_log_enabled ()) {
+      gst_tracer_record_log (tr_thread_cpuusage, thread->name, thread->tid,
+          100.0 * thread->cpu_time / period);
+    }
+    if (G_UNLIKELY (0 == thread->name_id)) {
+      thread->name_id = gst_ctf_intern_string (thread->name);
+    }
+    do_print_thread_cpuusage_event (thread->name_id, thread->tid,
+        thread->cpu_time, period);
+  }
+  g_mutex_unlock (&process_usage->lock);
+
+  return TRUE;
 }
 
 static gboolean
@@ -98,6 +174,10 @@ cpu_usage_thread_func (GstPeriodicTracer * tracer)
 
   self = GST_CPU_USAGE_TRACER (tracer);
 
+  if (self->process) {
+    return process_usage_thread_func (self);
+  }
+
   cpu_usage = &self->cpu_usage;
 
   cpu_load = CPU_USAGE_ARRAY (cpu_usage);
@@ -105,8 +185,10 @@ cpu_usage_thread_func (GstPeriodicTracer * tracer)
 
   gst_cpu_usage_compute (cpu_usage);
 
-  for (cpu_id = 0; cpu_id < cpu_load_len; ++cpu_id) {
-    gst_tracer_record_log (tr_cpuusage, cpu_id, cpu_load[cpu_id]);
+  if (gst_shark_tracer_log_enabled ()) {
+    for (cpu_id = 0; cpu_id < cpu_load_len; ++cpu_id) {
+      gst_tracer_record_log (tr_cpuusage, cpu_id, cpu_load[cpu_id]);
+    }
   }
   do_print_cpuusage_event (CPUUSAGE_EVENT_ID, cpu_load_len, cpu_load);
 
@@ -127,6 +209,13 @@ create_metadata_event (GstPeriodicTracer * tracer)
   gint number_of_bytes;
 
   self = GST_CPU_USAGE_TRACER (tracer);
+
+  if (self->process) {
+    gst_ctf_add_event_metadata (PROCESS_CPUUSAGE_EVENT_ID);
+    gst_ctf_add_event_metadata (THREAD_CPUUSAGE_EVENT_ID);
+    return;
+  }
+
   cpu_num = self->cpu_usage.cpu_num;
 
   event_header =
@@ -172,13 +261,66 @@ create_metadata_event (GstPeriodicTracer * tracer)
   g_free (event_header);
 }
 
+static void
+gst_cpu_usage_tracer_constructed (GObject * object)
+{
+  GstCPUUsageTracer *self;
+  GstTracer *tracer;
+  GList *mode;
+
+  /* Let the parent parse the params */
+  G_OBJECT_CLASS (gst_cpu_usage_tracer_parent_class)->constructed (object);
+
+  self = GST_CPU_USAGE_TRACER (object);
+  tracer = GST_TRACER (object);
+
+  mode = gst_shark_tracer_get_param (GST_SHARK_TRACER (self), "mode");
+  if (NULL == mode || 0 == g_strcmp0 (mode->data, "system")) {
+    return;
+  } else if (0 != g_strcmp0 (mode->data, "process")) {
+    GST_ERROR_OBJECT (self, "Unknown cpuusage mode \"%s\"",
+        (gchar *) mode->data);
+    return;
+  }
+
+  GST_INFO_OBJECT (self, "Measuring the CPU time of the process threads");
+  self->process = TRUE;
+  gst_process_usage_init (&self->process_usage);
+
+  /* Name the streaming threads after the pads whose task they run */
+  gst_tracing_register_hook (tracer, "pad-push-pre",
+      G_CALLBACK (do_pad_task_pre));
+  gst_tracing_register_hook (tracer, "pad-push-list-pre",
+      G_CALLBACK (do_pad_task_pre));
+  gst_tracing_register_hook (tracer, "pad-pull-range-pre",
+      G_CALLBACK (do_pad_task_pre));
+}
+
+static void
+gst_cpu_usage_tracer_finalize (GObject * object)
+{
+  GstCPUUsageTracer *self = GST_CPU_USAGE_TRACER (object);
+
+  gst_cpu_usage_clear (&self->cpu_usage);
+  if (self->process) {
+    gst_process_usage_clear (&self->process_usage);
+  }
+
+  G_OBJECT_CLASS (gst_cpu_usage_tracer_parent_class)->finalize (object);
+}
+
 static void
 gst_cpu_usage_tracer_class_init (GstCPUUsageTracerClass * klass)
 {
+  GObjectClass *gobject_class;
   GstPeriodicTracerClass *tracer_class;
 
+  gobject_class = G_OBJECT_CLASS (klass);
   tracer_class = GST_PERIODIC_TRACER_CLASS (klass);
 
+  gobject_class->constructed = gst_cpu_usage_tracer_constructed;
+  gobject_class->finalize = gst_cpu_usage_tracer_finalize;
+
   tracer_class->timer_callback = GST_DEBUG_FUNCPTR (cpu_usage_thread_func);
   tracer_class->reset = GST_DEBUG_FUNCPTR (reset_counters);
   tracer_class->write_header = GST_DEBUG_FUNCPTR (create_metadata_event);
@@ -194,6 +336,33 @@ gst_cpu_usage_tracer_class_init (GstCPUUsageTracerClass * klass)
           "description", G_TYPE_STRING, "Core load percentage [%]", "flags",
           GST_TYPE_TRACER_VALUE_FLAGS, GST_TRACER_VALUE_FLAGS_AGGREGATED, "min",
           G_TYPE_DOUBLE, 0.0f, "max", G_TYPE_DOUBLE, 100.0f, NULL), NULL);
+
+  tr_process_cpuusage = gst_tracer_record_new ("processcpuusage.class",
+      "load", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_DOUBLE,
+          "description", G_TYPE_STRING,
+          "Process load percentage of one core [%]",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, "min", G_TYPE_DOUBLE, 0.0,
+          "max", G_TYPE_DOUBLE, 100.0 * CPU_NUM_MAX, NULL), NULL);
+
+  tr_thread_cpuusage = gst_tracer_record_new ("threadcpuusage.class",
+      "thread", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_THREAD, NULL),
+      "tid", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_INT,
+          "description", G_TYPE_STRING, "Thread ID",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_NONE, NULL),
+      "load", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_DOUBLE,
+          "description", G_TYPE_STRING,
+          "Thread load percentage of one core [%]",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, "min", G_TYPE_DOUBLE, 0.0,
+          "max", G_TYPE_DOUBLE, 100.0, NULL), NULL);
 }
 
 static void
@@ -203,7 +372,7 @@ gst_cpu_usage_tracer_init (GstCPUUsageTracer * self)
 
   cpu_usage = &self->cpu_usage;
   gst_cpu_usage_init (cpu_usage);
-  cpu_usage->cpu_array_sel = FALSE;
+  self->process = FALSE;
 
   /* Register a dummy hook so that the tracer remains alive */
   gst_tracing_register_hook (GST_TRACER (self), "bin-add-post",
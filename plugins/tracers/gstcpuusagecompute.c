@@ -26,13 +26,79 @@
 #include <glib/gstdio.h>
 #include "gstcpuusage.h"
 #include "gstcpuusagecompute.h"
+#include "gstctf.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
 
-#define CPU_NAME_MAX_SIZE 8
-#define S(arg) XS(arg)
-#define XS(arg) #arg
+#define CPU_STAT_BUF_SIZE (4096)
+#define PROC_SELF_STAT "/proc/self/stat"
+#define PROC_SELF_TASK "/proc/self/task"
+
+/* Read a whole /proc file from the start, growing the buffer as needed.
+ * Returns the number of bytes read, or -1 on error */
+static gssize
+proc_pread_all (gint fd, gchar ** buf, gsize * size)
+{
+  gssize ret;
+
+  while (TRUE) {
+    ret = pread (fd, *buf, *size - 1, 0);
+    if (ret < 0 && EINTR == errno) {
+      continue;
+    }
+    if (ret < 0 || (gsize) ret < *size - 1) {
+      break;
+    }
+    /* The file may be larger than the buffer */
+    *size *= 2;
+    *buf = g_realloc (*buf, *size);
+  }
+
+  if (ret >= 0) {
+    (*buf)[ret] = '\0';
+  }
+
+  return ret;
+}
+
+/* Sum utime and stime, the 14th and 15th fields of a stat file. The
+ * command name may contain spaces, so fields are counted after its
+ * closing parenthesis. */
+gboolean
+gst_proc_stat_parse_ticks (const gchar * stat, guint64 * ticks)
+{
+  const gchar *field;
+  gchar *end;
+  guint64 utime, stime;
+  gint i;
+
+  field = strrchr (stat, ')');
+  if (NULL == field) {
+    return FALSE;
+  }
+
+  /* Skip the state and the 10 fields up to utime */
+  field++;
+  for (i = 0; i < 11; ++i) {
+    field = strchr (field + 1, ' ');
+    if (NULL == field) {
+      return FALSE;
+    }
+  }
+
+  utime = g_ascii_strtoull (field, &end, 10);
+  stime = g_ascii_strtoull (end, &end, 10);
+  if (end == field) {
+    return FALSE;
+  }
+
+  *ticks = utime + stime;
+
+  return TRUE;
+}
 
 void
 gst_cpu_usage_init (GstCPUUsage * cpu_usage)
@@ -42,117 +108,315 @@ gst_cpu_usage_init (GstCPUUsage * cpu_usage)
   g_return_if_fail (cpu_usage);
 
   memset (cpu_usage, 0, sizeof (GstCPUUsage));
-  cpu_usage->cpu_array_sel = FALSE;
 
   if ((cpu_num = sysconf (_SC_NPROCESSORS_CONF)) == -1) {
     GST_WARNING ("failed to get number of cpus");
     cpu_num = 1;
   }
 
-  cpu_usage->cpu_num = cpu_num;
+  cpu_usage->cpu_num = MIN (cpu_num, CPU_NUM_MAX);
+
+  cpu_usage->stat_fd = g_open ("/proc/stat", O_RDONLY, 0);
+  if (cpu_usage->stat_fd < 0) {
+    GST_WARNING ("failed to open /proc/stat: %s", g_strerror (errno));
+  }
+  cpu_usage->stat_buf_size = CPU_STAT_BUF_SIZE;
+  cpu_usage->stat_buf = g_malloc (cpu_usage->stat_buf_size);
+}
+
+void
+gst_cpu_usage_reset (GstCPUUsage * cpu_usage)
+{
+  g_return_if_fail (cpu_usage);
+
+  memset (cpu_usage->cpu_load, 0, sizeof (cpu_usage->cpu_load));
+  memset (cpu_usage->busy, 0, sizeof (cpu_usage->busy));
+  memset (cpu_usage->total, 0, sizeof (cpu_usage->total));
+}
+
+void
+gst_cpu_usage_clear (GstCPUUsage * cpu_usage)
+{
+  g_return_if_fail (cpu_usage);
+
+  if (cpu_usage->stat_fd >= 0) {
+    close (cpu_usage->stat_fd);
+    cpu_usage->stat_fd = -1;
+  }
+  g_free (cpu_usage->stat_buf);
+  cpu_usage->stat_buf = NULL;
 }
 
 void
 gst_cpu_usage_compute (GstCPUUsage * cpu_usage)
 {
-  gfloat *cpu_load;
-  gint cpu_num;
+  gchar *line;
+  gchar *end;
   gint cpu_id;
-  FILE *fd;
-
-  gint *user;
-  gint *user_aux;
-  gint *nice;
-  gint *nice_aux;
-  gint *system;
-  gint *system_aux;
-  gint *idle;
-  gint *idle_aux;
-
-  gchar cpu_name[CPU_NAME_MAX_SIZE];
-  gint iowait;                  /* Time waiting for I/O to complete */
-  gint irq;                     /* Time servicing interrupts        */
-  gint softirq;                 /* Time servicing softirqs          */
-  gint steal;                   /* Time spent in other OSes when in virtualized env */
-  gint quest;                   /* Time spent running a virtual CPU for guest OS    */
-  gint quest_nice;              /* Time spent running niced guest */
-  gfloat num_value;
-  gfloat den_value;
-  gboolean cpu_array_sel;
-  gint ret;
+  guint64 user;
+  guint64 nice;
+  guint64 system;
+  guint64 idle;
+  guint64 busy;
+  guint64 total;
 
   g_return_if_fail (cpu_usage);
 
-  user = cpu_usage->user;
-  user_aux = cpu_usage->user_aux;
-  nice = cpu_usage->nice;
-  nice_aux = cpu_usage->nice_aux;
-  system = cpu_usage->system;
-  system_aux = cpu_usage->system_aux;
-  idle = cpu_usage->idle;
-  idle_aux = cpu_usage->idle_aux;
-
-  cpu_array_sel = cpu_usage->cpu_array_sel;
-  cpu_load = cpu_usage->cpu_load;
-  cpu_num = cpu_usage->cpu_num;
-
-
-
-  /* Compute the load for each core */
-  fd = g_fopen ("/proc/stat", "r");
-  if (cpu_array_sel == 0) {
-    ret =
-        fscanf (fd, "%" S (CPU_NAME_MAX_SIZE) "s %d %d %d %d %d %d %d %d %d %d",
-        cpu_name, &user[0], &nice[0], &system[0], &idle[0], &iowait, &irq,
-        &softirq, &steal, &quest, &quest_nice);
-    for (cpu_id = 0; cpu_id < cpu_num; ++cpu_id) {
-      ret =
-          fscanf (fd,
-          "%" S (CPU_NAME_MAX_SIZE) "s %d %d %d %d %d %d %d %d %d %d", cpu_name,
-          &user[cpu_id], &nice[cpu_id], &system[cpu_id], &idle[cpu_id], &iowait,
-          &irq, &softirq, &steal, &quest, &quest_nice);
+  if (cpu_usage->stat_fd < 0 || proc_pread_all (cpu_usage->stat_fd,
+          &cpu_usage->stat_buf, &cpu_usage->stat_buf_size) < 0) {
+    return;
+  }
+
+  /* Compute the load for each core from its "cpuN user nice system idle"
+   * line, offline cores have no line */
+  for (line = cpu_usage->stat_buf; NULL != line; line = strchr (line, '\n')) {
+    if ('\n' == *line) {
+      line++;
     }
-    /* Compute the utilization for each core */
-    for (cpu_id = 0; cpu_id < cpu_num; ++cpu_id) {
-      num_value =
-          ((user[cpu_id] + nice[cpu_id] + system[cpu_id]) - (user_aux[cpu_id] +
-              nice_aux[cpu_id] + system_aux[cpu_id]));
-      den_value =
-          ((user[cpu_id] + nice[cpu_id] + system[cpu_id] + idle[cpu_id]) -
-          (user_aux[cpu_id] + nice_aux[cpu_id] + system_aux[cpu_id] +
-              idle_aux[cpu_id]));
-      cpu_load[cpu_id] = 100 * (num_value / den_value);
+    if (!g_str_has_prefix (line, "cpu") || !g_ascii_isdigit (line[3])) {
+      continue;
     }
-    cpu_array_sel = 1;
-  } else {
-    ret =
-        fscanf (fd, "%" S (CPU_NAME_MAX_SIZE) "s %d %d %d %d %d %d %d %d %d %d",
-        cpu_name, &user_aux[0], &nice_aux[0], &system_aux[0], &idle_aux[0],
-        &iowait, &irq, &softirq, &steal, &quest, &quest_nice);
-    for (cpu_id = 0; cpu_id < cpu_num; ++cpu_id) {
-      ret =
-          fscanf (fd,
-          "%" S (CPU_NAME_MAX_SIZE) "s %d %d %d %d %d %d %d %d %d %d", cpu_name,
-          &user_aux[cpu_id], &nice_aux[cpu_id], &system_aux[cpu_id],
-          &idle_aux[cpu_id], &iowait, &irq, &softirq, &steal, &quest,
-          &quest_nice);
+
+    cpu_id = g_ascii_strtoull (line + 3, &end, 10);
+    if (cpu_id >= cpu_usage->cpu_num) {
+      continue;
     }
-    /* Compute the utilization for each core */
-    for (cpu_id = 0; cpu_id < cpu_num; ++cpu_id) {
-      num_value =
-          ((user_aux[cpu_id] + nice_aux[cpu_id] + system_aux[cpu_id]) -
-          (user[cpu_id] + nice[cpu_id] + system[cpu_id]));
-      den_value =
-          ((user_aux[cpu_id] + nice_aux[cpu_id] + system_aux[cpu_id] +
-              idle_aux[cpu_id]) - (user[cpu_id] + nice[cpu_id] +
-              system[cpu_id] + idle[cpu_id]));
-      cpu_load[cpu_id] = 100 * (num_value / den_value);
+
+    user = g_ascii_strtoull (end, &end, 10);
+    nice = g_ascii_strtoull (end, &end, 10);
+    system = g_ascii_strtoull (end, &end, 10);
+    idle = g_ascii_strtoull (end, &end, 10);
+
+    busy = user + nice + system;
+    total = busy + idle;
+
+    if (total > cpu_usage->total[cpu_id]) {
+      cpu_usage->cpu_load[cpu_id] = 100.0f *
+          (gfloat) (busy - cpu_usage->busy[cpu_id]) /
+          (gfloat) (total - cpu_usage->total[cpu_id]);
+    }
+
+    cpu_usage->busy[cpu_id] = busy;
+    cpu_usage->total[cpu_id] = total;
+  }
+}
+
+static void
+thread_usage_free (GstThreadUsage * thread)
+{
+  if (thread->stat_fd >= 0) {
+    close (thread->stat_fd);
+  }
+  g_free (thread->name);
+  g_free (thread);
+}
+
+static gboolean
+thread_usage_read (GstThreadUsage * thread, gchar * buf, gsize size,
+    GstClockTime tick_time)
+{
+  gssize ret;
+  guint64 ticks;
+
+  do {
+    ret = pread (thread->stat_fd, buf, size - 1, 0);
+  } while (ret < 0 && EINTR == errno);
+
+  /* The thread is gone */
+  if (ret <= 0) {
+    return FALSE;
+  }
+  buf[ret] = '\0';
+
+  if (!gst_proc_stat_parse_ticks (buf, &ticks)) {
+    return FALSE;
+  }
+
+  /* Name the thread after its command name, unless a task claimed it */
+  if (NULL == thread->name) {
+    const gchar *start = strchr (buf, '(');
+    const gchar *end = strrchr (buf, ')');
+
+    if (NULL != start && NULL != end && end > start) {
+      gchar *comm = g_strndup (start + 1, end - start - 1);
+
+      thread->name = g_strdup_printf ("%s_%d", comm, thread->tid);
+      thread->name_id = gst_ctf_intern_string (thread->name);
+      g_free (comm);
     }
-    cpu_array_sel = 0;
   }
 
-  (void) ret;
+  thread->cpu_time = (ticks - MIN (ticks, thread->ticks)) * tick_time;
+  thread->ticks = ticks;
 
-  cpu_usage->cpu_array_sel = cpu_array_sel;
-  fclose (fd);
+  return TRUE;
+}
+
+static GstThreadUsage *
+thread_usage_get (GstProcessUsage * process_usage, gint tid)
+{
+  GstThreadUsage *thread;
+  gchar *path;
+
+  thread = g_hash_table_lookup (process_usage->threads,
+      GINT_TO_POINTER (tid));
+  if (NULL != thread) {
+    return thread;
+  }
+
+  thread = g_new0 (GstThreadUsage, 1);
+  thread->tid = tid;
+
+  path = g_strdup_printf (PROC_SELF_TASK "/%d/stat", tid);
+  thread->stat_fd = g_open (path, O_RDONLY, 0);
+  g_free (path);
+
+  g_hash_table_insert (process_usage->threads, GINT_TO_POINTER (tid), thread);
+
+  return thread;
+}
+
+void
+gst_process_usage_init (GstProcessUsage * process_usage)
+{
+  glong ticks_per_second;
+
+  g_return_if_fail (process_usage);
+
+  memset (process_usage, 0, sizeof (GstProcessUsage));
+
+  process_usage->stat_fd = g_open (PROC_SELF_STAT, O_RDONLY, 0);
+  if (process_usage->stat_fd < 0) {
+    GST_WARNING ("failed to open " PROC_SELF_STAT ": %s", g_strerror (errno));
+  }
+
+  ticks_per_second = sysconf (_SC_CLK_TCK);
+  if (ticks_per_second <= 0) {
+    ticks_per_second = 100;
+  }
+  process_usage->tick_time = GST_SECOND / ticks_per_second;
+
+  g_mutex_init (&process_usage->lock);
+  process_usage->threads = g_hash_table_new_full (g_direct_hash,
+      g_direct_equal, NULL, (GDestroyNotify) thread_usage_free);
+}
+
+void
+gst_process_usage_reset (GstProcessUsage * process_usage)
+{
+  GHashTableIter iter;
+  gpointer value;
+
+  g_return_if_fail (process_usage);
+
+  /* Only count from now on, forgetting the threads that are gone */
+  gst_process_usage_compute (process_usage);
+
+  process_usage->cpu_time = 0;
+  g_mutex_lock (&process_usage->lock);
+  g_hash_table_iter_init (&iter, process_usage->threads);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    ((GstThreadUsage *) value)->cpu_time = 0;
+  }
+  g_mutex_unlock (&process_usage->lock);
+}
+
+void
+gst_process_usage_clear (GstProcessUsage * process_usage)
+{
+  g_return_if_fail (process_usage);
+
+  if (process_usage->stat_fd >= 0) {
+    close (process_usage->stat_fd);
+    process_usage->stat_fd = -1;
+  }
+  if (process_usage->threads) {
+    g_hash_table_destroy (process_usage->threads);
+    process_usage->threads = NULL;
+    g_mutex_clear (&process_usage->lock);
+  }
+}
+
+void
+gst_process_usage_compute (GstProcessUsage * process_usage)
+{
+  GstThreadUsage *thread;
+  GHashTableIter iter;
+  gpointer value;
+  const gchar *entry;
+  GDir *dir;
+  guint64 ticks;
+  gssize ret;
+  gint tid;
+
+  g_return_if_fail (process_usage);
+
+  if (process_usage->stat_fd >= 0) {
+    do {
+      ret = pread (process_usage->stat_fd, process_usage->stat_buf,
+          sizeof (process_usage->stat_buf) - 1, 0);
+    } while (ret < 0 && EINTR == errno);
+
+    if (ret > 0) {
+      process_usage->stat_buf[ret] = '\0';
+      if (gst_proc_stat_parse_ticks (process_usage->stat_buf, &ticks)) {
+        process_usage->cpu_time = (ticks - MIN (ticks, process_usage->ticks)) *
+            process_usage->tick_time;
+        process_usage->ticks = ticks;
+      }
+    }
+  }
+
+  /* The threads are listed every period to find the new ones, the stat
+   * file of the known ones stays open */
+  dir = g_dir_open (PROC_SELF_TASK, 0, NULL);
+  if (NULL == dir) {
+    return;
+  }
+
+  g_mutex_lock (&process_usage->lock);
+  while (NULL != (entry = g_dir_read_name (dir))) {
+    tid = atoi (entry);
+    if (tid <= 0) {
+      continue;
+    }
+
+    thread = thread_usage_get (process_usage, tid);
+    thread->alive = thread->stat_fd >= 0 &&
+        thread_usage_read (thread, process_usage->stat_buf,
+        sizeof (process_usage->stat_buf), process_usage->tick_time);
+  }
+  g_dir_close (dir);
+
+  /* Forget the threads that finished */
+  g_hash_table_iter_init (&iter, process_usage->threads);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    thread = (GstThreadUsage *) value;
+    if (!thread->alive) {
+      g_hash_table_iter_remove (&iter);
+    } else {
+      thread->alive = FALSE;
+    }
+  }
+  g_mutex_unlock (&process_usage->lock);
+}
+
+void
+gst_process_usage_set_thread_name (GstProcessUsage * process_usage, gint tid,
+    const gchar * name)
+{
+  GstThreadUsage *thread;
+
+  g_return_if_fail (process_usage);
+  g_return_if_fail (name);
+
+  g_mutex_lock (&process_usage->lock);
+  thread = thread_usage_get (process_usage, tid);
+  if (!thread->owned || 0 != g_strcmp0 (thread->name, name)) {
+    g_free (thread->name);
+    thread->name = g_strdup (name);
+    thread->name_id = gst_ctf_intern_string (name);
+    thread->owned = TRUE;
+  }
+  g_mutex_unlock (&process_usage->lock);
 }
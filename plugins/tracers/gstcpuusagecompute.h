@@ -1,5 +1,5 @@
 /* GstShark - A Front End for GstTracer
- * Copyright (C) 2016 RidgeRun Engineering <michael.gruner@ridgerun.com>
+ * Copyright (C) 2016 RidgeRun Engineering <manuel.leiva@ridgerun.com>
  *
  * This file is part of GstShark.
  *
@@ -36,20 +36,63 @@ G_BEGIN_DECLS
   gint cpu_num;
   gfloat cpu_load[CPU_NUM_MAX];
 
-  gint user[CPU_NUM_MAX];       /* Time spent in user mode */
-  gint user_aux[CPU_NUM_MAX];   /* Time spent in user mode */
-  gint nice[CPU_NUM_MAX];       /* Time spent in user mode with low priority */
-  gint nice_aux[CPU_NUM_MAX];   /* Time spent in user mode with low priority */
-  gint system[CPU_NUM_MAX];     /* Time spent in user mode with low priority */
-  gint system_aux[CPU_NUM_MAX]; /* Time spent in user mode with low priority */
-  gint idle[CPU_NUM_MAX];       /* Time spent in system mode */
-  gint idle_aux[CPU_NUM_MAX];   /* Time spent in system mode */
-  gboolean cpu_array_sel;
+  /* /proc/stat, kept open and read from the start every period */
+  gint stat_fd;
+  gchar *stat_buf;
+  gsize stat_buf_size;
+
+  /* Clock ticks of every core at the last read */
+  guint64 busy[CPU_NUM_MAX];    /* Time spent in user, nice and system mode */
+  guint64 total[CPU_NUM_MAX];   /* Busy time plus idle time */
 } GstCPUUsage;
 
+/* CPU time of a thread of this process */
+typedef struct
+{
+  gint tid;
+  /* /proc/self/task/<tid>/stat */
+  gint stat_fd;
+  /* Thread name, or the pad whose task the thread runs */
+  gchar *name;
+  guint32 name_id;
+  gboolean owned;
+
+  guint64 ticks;                /* user and system clock ticks at the last read */
+  GstClockTime cpu_time;        /* CPU time during the last period */
+  gboolean alive;
+} GstThreadUsage;
+
+typedef struct
+{
+  /* /proc/self/stat */
+  gint stat_fd;
+  gchar stat_buf[1024];
+
+  guint64 ticks;                /* user and system clock ticks at the last read */
+  GstClockTime cpu_time;        /* CPU time during the last period */
+  GstClockTime tick_time;       /* Duration of a clock tick */
+
+  /* tid to GstThreadUsage, threads are named from the streaming threads */
+  GMutex lock;
+  GHashTable *threads;
+} GstProcessUsage;
+
 void gst_cpu_usage_init (GstCPUUsage * cpu_usage);
+void gst_cpu_usage_reset (GstCPUUsage * cpu_usage);
+void gst_cpu_usage_clear (GstCPUUsage * cpu_usage);
 
 void gst_cpu_usage_compute (GstCPUUsage * cpu_usage);
 
+void gst_process_usage_init (GstProcessUsage * process_usage);
+void gst_process_usage_reset (GstProcessUsage * process_usage);
+void gst_process_usage_clear (GstProcessUsage * process_usage);
+
+void gst_process_usage_compute (GstProcessUsage * process_usage);
+void gst_process_usage_set_thread_name (GstProcessUsage * process_usage,
+    gint tid, const gchar * name);
+
+/* Clock ticks in user and system mode listed in a /proc stat file */
+gboolean gst_proc_stat_parse_ticks (const gchar * stat, guint64 * ticks);
+
 G_END_DECLS
 #endif //__GST_CPU_USAGE_COMPUTE_H__
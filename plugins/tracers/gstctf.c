@@ -19,6 +19,10 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* fallocate */
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -30,6 +34,16 @@
 #include <gio/gio.h>
 #include <string.h>
 
+#ifdef G_OS_UNIX
+#include <signal.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "gstctf.h"
 #include "gstparser.h"
@@ -41,20 +55,52 @@
 #define SOCKET_PROTOCOL G_SOCKET_PROTOCOL_TCP
 #define CTF_MEM_SIZE      (1048576)     //1M = 1024*1024
 #define CTF_UUID_SIZE     (16)
+#define CTF_RING_SIZE     (262144)      //256K per streaming thread
+#define CTF_FLUSH_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+#define TCP_QUEUE_SIZE       (4194304)  //4M of pending packets
+#define TCP_CONNECT_TIMEOUT  (5)        //seconds
+#define TCP_RECONNECT_INTERVAL (G_TIME_SPAN_SECOND)
+#define TCP_REPORT_INTERVAL  (G_TIME_SPAN_SECOND)
+#define CTF_MMAP_CHUNK_SIZE  (4194304)  //4M preallocated per growth
+#define CTF_FLIGHT_MAX_SIZE  (16777216) //16M of packets kept in memory
+#define CTF_SNAPSHOT_INTERVAL (G_TIME_SPAN_SECOND)
 
 typedef guint8 tcp_header_id;
 typedef guint32 tcp_header_length;
 
 #define TCP_HEADER_SIZE (sizeof(tcp_header_id) + sizeof(tcp_header_length))
-#define CTF_HEADER_SIZE (sizeof(guint16) + sizeof(guint32))
+/* Compact event header: 16 bits ID and the lower 32 bits of the timestamp.
+   Extended event header: extended ID, 32 bits ID and 64 bits timestamp. */
+#define CTF_COMPACT_HEADER_SIZE (sizeof(guint16) + sizeof(guint32))
+#define CTF_EXTENDED_HEADER_SIZE \
+  (sizeof(guint16) + sizeof(guint32) + sizeof(guint64))
+#define CTF_EXTENDED_ID (65535)
 #define CTF_AVAILABLE_MEM_SIZE (CTF_MEM_SIZE - TCP_HEADER_SIZE)
-
-typedef guint16 ctf_header_id;
-typedef guint32 ctf_header_timestamp;
-
-/* TCP Section ID */
+/* Packet header (magic, uuid, stream_id) followed by the packet context
+   (timestamp_begin, timestamp_end, content_size, packet_size,
+   events_discarded, stream_instance_id) */
+#define CTF_PACKET_HEADER_SIZE (4 + CTF_UUID_SIZE + 4 + 8 + 8 + 8 + 8 + 4 + 4)
+#define CTF_PACKET_MAGIC       (0xC1FC1FC1)
+/* Stream instance of the name table written on its own by the snapshots */
+#define CTF_NAMES_STREAM_INSTANCE (G_MAXUINT32)
+#define CTF_PACKET_TIMESTAMP_BEGIN_OFFSET (4 + CTF_UUID_SIZE + 4)
+#define CTF_PACKET_TIMESTAMP_END_OFFSET (CTF_PACKET_TIMESTAMP_BEGIN_OFFSET + 8)
+
+/* Every event in a ring is preceded by its length. A length of
+   CTF_RECORD_WRAP tells the writer to continue at the start of the ring. */
+typedef guint32 ctf_record_length;
+
+#define CTF_RECORD_HEADER_SIZE (sizeof (ctf_record_length))
+#define CTF_RECORD_WRAP        (G_MAXUINT32)
+#define CTF_RECORD_SIZE(size)  GST_ROUND_UP_4 ((size) + CTF_RECORD_HEADER_SIZE)
+
+/* TCP Section ID. Datastream sections start with the 32 bits index of the
+   stream the packet belongs to, the collector writes the packets of every
+   stream to its own file. */
 #define TCP_METADATA_ID    (0x01)
-#define TCP_DATASTREAM_ID  (0x02)
+#define TCP_DATASTREAM_ID  (0x03)
+
+typedef guint32 tcp_stream_index;
 
 #define TCP_EVENT_HEADER_WRITE(id,size,mem) \
   G_STMT_START {                            \
@@ -85,6 +131,12 @@ typedef guint32 ctf_header_timestamp;
   } G_STMT_END
 #endif
 
+#ifdef WORDS_BIGENDIAN
+#  define CTF_EVENT_READ(w,mem) GST_READ_UINT ## w ## _BE (mem)
+#else
+#  define CTF_EVENT_READ(w,mem) GST_READ_UINT ## w ## _LE (mem)
+#endif
+
 #define CTF_EVENT_WRITE_INT16(int16,mem) \
   CTF_EVENT_WRITE(16,mem,int16)
 
@@ -100,24 +152,30 @@ typedef guint32 ctf_header_timestamp;
     mem += sizeof(gfloat);                   \
   } G_STMT_END
 
-/* *INDENT-OFF* */
-#define CTF_EVENT_WRITE_HEADER(id,mem) \
-  G_STMT_START {                       \
-    /* Write event ID */               \
-    CTF_EVENT_WRITE_INT16(id,mem);     \
-    /* Write timestamp */              \
-    CTF_EVENT_WRITE_INT32(             \
-      GST_CLOCK_DIFF (                 \
-          ctf_descriptor->start_time,  \
-          gst_util_get_timestamp ()    \
-      )/1000,                          \
-    mem);                              \
-  } G_STMT_END
-/* *INDENT-ON* */
+/* Timestamps are kept in nanoseconds since the trace start */
+#define CTF_TIMESTAMP() \
+  GST_CLOCK_DIFF (ctf_descriptor->start_time, gst_util_get_timestamp ())
 
 static void file_parser_handler (gchar * line);
 static void tcp_parser_handler (gchar * line);
+static void flight_parser_handler (gchar * line);
 static inline gboolean event_exceeds_mem_size (gsize size);
+static void ctf_ring_release (gpointer data);
+static void ctf_tcp_send_metadata (const gchar * metadata, gsize size);
+static void ctf_tcp_send_datastream (guint32 stream_idx, const guint8 * data,
+    gsize size, gboolean names);
+
+/* Packet queued for the TCP sender thread */
+typedef struct
+{
+  GBytes *bytes;
+  /* The packet defines names, losing it requires sending the name table
+     again */
+  gboolean names;
+} GstCtfTcpChunk;
+
+typedef void (*ctf_packet_write_func) (const guint8 * packet, gsize size,
+    gpointer user_data);
 
 typedef enum
 {
@@ -125,6 +183,67 @@ typedef enum
   BYTE_ORDER_LE,
 } byte_order;
 
+/* Datastream file written through a shared mapping. The file is
+   preallocated in chunks and only the chunk being written is mapped. The
+   file length only covers complete packets. */
+typedef struct _GstCtfMappedFile GstCtfMappedFile;
+struct _GstCtfMappedFile
+{
+  gint fd;
+  guint8 *data;
+  /* File offset and length of the mapped window */
+  gsize offset;
+  gsize mapped;
+  /* Bytes of complete packets */
+  gsize size;
+};
+
+/* Single producer, single consumer event ring. The streaming thread that
+   owns the ring encodes its events in place and only moves head, the
+   writer thread drains it and only moves tail. */
+typedef struct _GstCtfRing GstCtfRing;
+struct _GstCtfRing
+{
+  guint8 mem[CTF_RING_SIZE];
+  gint head;
+  gint tail;
+  /* Head to be published once the reserved event is complete */
+  gint next_head;
+  /* Timestamp of the last committed event and of the reserved one. Events
+     less than 2^32 ns apart use the compact header. */
+  guint64 timestamp;
+  guint64 next_timestamp;
+  /* Timestamp of the last event written by the writer thread */
+  guint64 flush_timestamp;
+  /* Events discarded because the ring was full */
+  gint dropped;
+  gint dropped_reported;
+  /* Every ring is written as its own CTF stream */
+  guint stream_idx;
+  FILE *datastream;
+  GstCtfMappedFile mapped;
+  /* Size capped files of the stream, oldest first */
+  GQueue files;
+  guint file_count;
+  gsize file_size;
+  /* The owner thread exited, free the ring once it is drained */
+  gint orphaned;
+  /* The descriptor was closed while the owner thread was alive */
+  gboolean detached;
+};
+
+static void ctf_ring_write_name_table (GstCtfRing * ring);
+static void ctf_write_name_table (guint64 timestamp,
+    guint32 stream_instance_id, guint32 events_discarded,
+    ctf_packet_write_func write_packet, gpointer user_data);
+
+/* Packet kept by the flight recorder */
+typedef struct _GstCtfFlightPacket GstCtfFlightPacket;
+struct _GstCtfFlightPacket
+{
+  guint stream_idx;
+  GBytes *packet;
+};
 
 struct _GstCtfDescriptor
 {
@@ -137,27 +256,86 @@ struct _GstCtfDescriptor
    */
   /* File variables */
   FILE *metadata;
-  FILE *datastream;
   gchar *dir_name;
   gchar *env_dir_name;
   gboolean file_output_disable;
   gsize file_buf_size;
   gboolean change_file_buf_size;
+  gboolean file_mmap;
+  gsize file_mmap_chunk;
+  /* Datastream rotation, no limit when 0 */
+  gsize max_file_size;
+  guint max_files;
 
   /* TCP connection variables */
   gchar *host_name;
   gint port_number;
   GSocketClient *socket_client;
-  GSocketConnection *socket_connection;
-  GOutputStream *output_stream;
   gboolean tcp_output_disable;
+
+  /* TCP sender thread variables. The connection is owned by the sender,
+     the rest is protected by sender_mutex. */
+  GThread *sender;
+  GMutex sender_mutex;
+  GCond sender_cond;
+  gboolean sender_running;
+  GQueue tcp_queue;
+  gsize tcp_queue_bytes;
+  gsize tcp_queue_size;
+  gboolean tcp_drop_oldest;
+  GString *tcp_metadata;
+  gsize tcp_metadata_sent;
+  guint64 tcp_dropped_packets;
+  guint64 tcp_dropped_bytes;
+  /* Names were lost with a dropped packet or a reconnection, the writer
+     thread sends the whole name table again in its own stream */
+  gboolean tcp_names_lost;
+  guint tcp_names_stream;
+
+  /* Interned element and pad names, protected by ctf_names_mutex */
+  GHashTable *names;
+  guint32 name_count;
+
+  /* Flight recorder, the last packets are kept in memory and only written
+     as snapshots. Packets are handled by the writer thread, the metadata
+     is protected by mutex. */
+  gboolean flight;
+  GQueue flight_packets;
+  gsize flight_bytes;
+  gsize flight_max_size;
+  GstClockTime flight_max_time;
+  GString *flight_metadata;
+  guint snapshot_count;
+  gint64 snapshot_time;
+  GstClockTime snapshot_proctime;
+  GstClockTime snapshot_interlatency;
+
+  /* Per streaming thread event rings, protected by ctf_rings_mutex */
+  GList *rings;
+  guint stream_count;
+
+  /* Writer thread variables */
+  GThread *writer;
+  GMutex writer_mutex;
+  GCond writer_cond;
+  gboolean writer_running;
 };
 
 static GstCtfDescriptor *ctf_descriptor = NULL;
 
+static GPrivate ctf_thread_ring = G_PRIVATE_INIT (ctf_ring_release);
+static GMutex ctf_rings_mutex;
+static GMutex ctf_names_mutex;
+static GQuark ctf_name_id_quark;
+static gint ctf_snapshot_requested;
+#ifdef G_OS_UNIX
+static struct sigaction ctf_old_sigusr1;
+#endif
+
 static const parser_handler_desc parser_handler_desc_list[] = {
   {"file://", file_parser_handler},
   {"tcp://", tcp_parser_handler},
+  {"flight://", flight_parser_handler},
 };
 
 /* Metadata format string */
@@ -184,7 +362,7 @@ clock { \n\
     name = monotonic; \n\
     uuid = \"84db105b-b3f4-4821-b662-efc51455106a\"; \n\
     description = \"Monotonic Clock\"; \n\
-    freq = 1000000; /* Frequency, in Hz */ \n\
+    freq = 1000000000; /* Frequency, in Hz */ \n\
     /* clock value offset from Epoch is: offset * (1/freq) */ \n\
     offset_s = 21600; \n\
 };\n\
@@ -202,17 +380,21 @@ typealias integer {\n\
 struct packet_context {\n\
     uint64_clock_monotonic_t timestamp_begin;\n\
     uint64_clock_monotonic_t timestamp_end;\n\
+    uint64_t content_size;\n\
+    uint64_t packet_size;\n\
+    uint32_t events_discarded;\n\
+    uint32_t stream_instance_id;\n\
 };\n\
 \n\
 struct event_header {\n\
     enum : uint16_t { compact = 0 ... 65534, extended = 65535 } id;\n\
     variant <id> {\n\
         struct {\n\
-            uint32_t timestamp;\n\
+            uint32_clock_monotonic_t timestamp;\n\
         } compact;\n\
         struct {\n\
             uint32_t id;\n\
-            uint64_t timestamp;\n\
+            uint64_clock_monotonic_t timestamp;\n\
         } extended;\n\
     } v;\n\
 } align(8);\n\
@@ -267,24 +449,56 @@ ctf_create_struct (void)
   ctf->env_dir_name = NULL;
   ctf->file_buf_size = 0;
   ctf->change_file_buf_size = FALSE;
+  ctf->file_mmap = FALSE;
+  ctf->file_mmap_chunk = CTF_MMAP_CHUNK_SIZE;
+  ctf->max_file_size = 0;
+  ctf->max_files = 0;
 
   /* Default state Enable */
   ctf->file_output_disable = FALSE;
 
   ctf->metadata = NULL;
-  ctf->datastream = NULL;
 
   /* TCP connection variables */
   ctf->host_name = NULL;
   ctf->port_number = SOCKET_PORT;
 
   ctf->socket_client = NULL;
-  ctf->socket_connection = NULL;
-  ctf->output_stream = NULL;
+  ctf->sender = NULL;
+  ctf->sender_running = FALSE;
+  g_queue_init (&ctf->tcp_queue);
+  ctf->tcp_queue_bytes = 0;
+  ctf->tcp_queue_size = TCP_QUEUE_SIZE;
+  ctf->tcp_drop_oldest = TRUE;
+  ctf->tcp_metadata = NULL;
+  ctf->tcp_metadata_sent = 0;
+  ctf->tcp_dropped_packets = 0;
+  ctf->tcp_dropped_bytes = 0;
+  ctf->tcp_names_lost = FALSE;
+  ctf->tcp_names_stream = 0;
 
   /* Default TCP connection state Enable */
   ctf->tcp_output_disable = FALSE;
 
+  ctf->names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  ctf->name_count = 0;
+
+  ctf->flight = FALSE;
+  g_queue_init (&ctf->flight_packets);
+  ctf->flight_bytes = 0;
+  ctf->flight_max_size = CTF_FLIGHT_MAX_SIZE;
+  ctf->flight_max_time = 0;
+  ctf->flight_metadata = NULL;
+  ctf->snapshot_count = 0;
+  ctf->snapshot_time = 0;
+  ctf->snapshot_proctime = 0;
+  ctf->snapshot_interlatency = 0;
+
+  ctf->rings = NULL;
+  ctf->stream_count = 0;
+  ctf->writer = NULL;
+  ctf->writer_running = FALSE;
+
   /* Currently a constant UUID value is used */
   memcpy (ctf->uuid, UUID, CTF_UUID_SIZE);
 
@@ -292,59 +506,144 @@ ctf_create_struct (void)
 }
 
 static void
-generate_datastream_header (void)
+ctf_ring_release (gpointer data)
 {
-  guint64 time_stamp_begin;
-  guint64 time_stamp_end;
-  guint32 magic = 0xC1FC1FC1;
-  guint32 padding;
-  gint32 stream_id;
-  guint8 *mem;
-  guint event_size;
-  guint8 *event_mem;
-  GError *error;
+  GstCtfRing *ring;
 
-  stream_id = 0;
+  ring = (GstCtfRing *) data;
 
-  event_size = CTF_UUID_SIZE + 4 + 8 + 8 + 4 + 4;
-  /* Create Stream */
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
+  /* Called when the owner thread exits. If the descriptor is gone nobody
+     else references the ring, otherwise the writer releases it once the
+     pending events were written. */
+  g_mutex_lock (&ctf_rings_mutex);
+  if (ring->detached) {
+    g_free (ring);
+  } else {
+    g_atomic_int_set (&ring->orphaned, TRUE);
+  }
+  g_mutex_unlock (&ctf_rings_mutex);
+}
 
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* The begin of the data stream header is compound by the Magic Number,
-     the trace UUID and the Stream ID. These are all required fields. */
-  /* Magic Number */
-  CTF_EVENT_WRITE_INT32 (magic, event_mem);
-  /* Trace UUID */
-  memcpy (event_mem, ctf_descriptor->uuid, CTF_UUID_SIZE);
-  event_mem += CTF_UUID_SIZE;
-  /* Stream ID */
-  CTF_EVENT_WRITE_INT32 (stream_id, event_mem);
-  /* Time Stamp begin */
-  time_stamp_begin = 0;
-  CTF_EVENT_WRITE_INT64 (time_stamp_begin, event_mem);
-  /* Time Stamp end */
-  time_stamp_end = 0;
-  CTF_EVENT_WRITE_INT64 (time_stamp_end, event_mem);
-  /* Padding needed */
-  padding = 0x0000FFFF;
-  CTF_EVENT_WRITE_INT32 (padding, event_mem);
+static GstCtfRing *
+ctf_ring_get (void)
+{
+  GstCtfRing *ring;
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
+  ring = g_private_get (&ctf_thread_ring);
+  if (G_LIKELY (NULL != ring && FALSE == ring->detached)) {
+    return ring;
   }
 
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
+  /* First event of this thread */
+  ring = g_malloc0 (sizeof (GstCtfRing));
+  ring->mapped.fd = -1;
+  g_private_replace (&ctf_thread_ring, ring);
+
+  g_mutex_lock (&ctf_rings_mutex);
+  ring->stream_idx = ctf_descriptor->stream_count++;
+  ctf_descriptor->rings = g_list_append (ctf_descriptor->rings, ring);
+  g_mutex_unlock (&ctf_rings_mutex);
+
+  return ring;
+}
+
+/* Reserve room for an event with a payload of the given size in the ring
+ * and write its header. Returns the memory where the payload has to be
+ * encoded, or NULL if the ring is full in which case the event is dropped.
+ * The event becomes visible to the writer after ctf_ring_commit.
+ */
+static guint8 *
+ctf_ring_reserve (GstCtfRing * ring, event_id id, gsize size)
+{
+  guint8 *record;
+  guint8 *event_mem;
+  gsize record_size;
+  guint64 timestamp;
+  gboolean compact;
+  gint head;
+  gint tail;
+
+  timestamp = CTF_TIMESTAMP ();
+  /* Readers rebuild the upper bits of a compact timestamp from the
+     previous event of the stream */
+  compact = timestamp - ring->timestamp < G_MAXUINT32;
+
+  size += compact ? CTF_COMPACT_HEADER_SIZE : CTF_EXTENDED_HEADER_SIZE;
+  record_size = CTF_RECORD_SIZE (size);
+  head = ring->head;
+  tail = g_atomic_int_get (&ring->tail);
+
+  /* The end of the ring always keeps room for a wrap mark */
+  if (head >= tail) {
+    if (head + record_size <= CTF_RING_SIZE - CTF_RECORD_HEADER_SIZE) {
+      record = ring->mem + head;
+    } else if (record_size < tail) {
+      *(ctf_record_length *) (ring->mem + head) = CTF_RECORD_WRAP;
+      record = ring->mem;
+    } else {
+      goto full;
+    }
+  } else if (head + record_size < tail) {
+    record = ring->mem + head;
+  } else {
+    goto full;
+  }
+
+  *(ctf_record_length *) record = size;
+  ring->next_head = record - ring->mem + record_size;
+  ring->next_timestamp = timestamp;
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+  event_mem = record + CTF_RECORD_HEADER_SIZE;
+  if (compact) {
+    CTF_EVENT_WRITE_INT16 (id, event_mem);
+    CTF_EVENT_WRITE_INT32 (timestamp, event_mem);
+  } else {
+    CTF_EVENT_WRITE_INT16 (CTF_EXTENDED_ID, event_mem);
+    CTF_EVENT_WRITE_INT32 (id, event_mem);
+    CTF_EVENT_WRITE_INT64 (timestamp, event_mem);
   }
 
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  return event_mem;
+
+full:
+  g_atomic_int_inc (&ring->dropped);
+  return NULL;
+}
+
+static inline void
+ctf_ring_commit (GstCtfRing * ring)
+{
+  ring->timestamp = ring->next_timestamp;
+  g_atomic_int_set (&ring->head, ring->next_head);
+}
+
+/* Write the packet header and context at the beginning of a packet of the
+ * given size in bytes. Timestamps are the ones of the first and last event,
+ * the stream instance tells the thread stream the packet belongs to.
+ */
+static void
+ctf_write_packet_header (guint8 * mem, guint64 timestamp_begin,
+    guint64 timestamp_end, gsize size, guint32 events_discarded,
+    guint32 stream_instance_id)
+{
+  /* The begin of the data stream header is compound by the Magic Number,
+     the trace UUID and the Stream ID. These are all required fields. */
+  /* Magic Number */
+  CTF_EVENT_WRITE_INT32 (CTF_PACKET_MAGIC, mem);
+  /* Trace UUID */
+  memcpy (mem, ctf_descriptor->uuid, CTF_UUID_SIZE);
+  mem += CTF_UUID_SIZE;
+  /* Stream ID, all the streams share the same description */
+  CTF_EVENT_WRITE_INT32 (0, mem);
+
+  /* Packet context */
+  CTF_EVENT_WRITE_INT64 (timestamp_begin, mem);
+  CTF_EVENT_WRITE_INT64 (timestamp_end, mem);
+  /* Content and packet sizes are given in bits, packets are not padded */
+  CTF_EVENT_WRITE_INT64 ((guint64) size * 8, mem);
+  CTF_EVENT_WRITE_INT64 ((guint64) size * 8, mem);
+  CTF_EVENT_WRITE_INT32 (events_discarded, mem);
+  CTF_EVENT_WRITE_INT32 (stream_instance_id, mem);
 }
 
 static void
@@ -399,7 +698,6 @@ static void
 generate_metadata (gint major, gint minor, gint byte_order)
 {
   gint str_len;
-  GError *error;
   guint8 *event_mem;
   guint8 *mem;
   gchar uuid_string[] = "XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX0";
@@ -418,6 +716,7 @@ generate_metadata (gint major, gint minor, gint byte_order)
       uuid_string, byte_order ? "le" : "be");
   if (CTF_MEM_SIZE == str_len) {
     GST_ERROR ("Insufficient memory to create metadata");
+    g_mutex_unlock (&ctf_descriptor->mutex);
     return;
   }
 
@@ -426,10 +725,12 @@ generate_metadata (gint major, gint minor, gint byte_order)
   }
 
   if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_METADATA_ID, str_len, mem);
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, str_len + TCP_HEADER_SIZE, NULL, &error);
+    ctf_tcp_send_metadata ((gchar *) event_mem, str_len);
+  }
+
+  if (ctf_descriptor->flight) {
+    g_string_append_len (ctf_descriptor->flight_metadata, (gchar *) event_mem,
+        str_len);
   }
   g_mutex_unlock (&ctf_descriptor->mutex);
 }
@@ -501,12 +802,80 @@ file_parser_handler (gchar * line)
   strcpy (ctf_descriptor->env_dir_name, line);
 }
 
+static void
+flight_parser_handler (gchar * line)
+{
+  ctf_descriptor->flight = TRUE;
+
+  /* Snapshots are written to the given directory, if any */
+  if ('\0' != *line) {
+    file_parser_handler (line);
+  }
+}
+
+/* Parse an unsigned decimal environment variable, returns FALSE if it is
+ * not set or not valid.
+ */
+static gboolean
+ctf_env_var_to_uint64 (const gchar * name, guint64 * value)
+{
+  const gchar *env_value;
+  gchar *env_value_end;
+
+  env_value = g_getenv (name);
+  if (NULL == env_value) {
+    return FALSE;
+  }
+
+  *value = g_ascii_strtoull (env_value, &env_value_end, 10);
+  if ('\0' != *env_value_end || '-' == env_value[0]) {
+    GST_ERROR ("Invalid value \"%s\" for %s, ignoring it", env_value, name);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+ctf_process_flight_env_var (void)
+{
+  guint64 value;
+
+  if (ctf_env_var_to_uint64 ("GST_SHARK_FLIGHT_MAX_SIZE", &value)) {
+    ctf_descriptor->flight_max_size = value;
+  }
+  if (ctf_env_var_to_uint64 ("GST_SHARK_FLIGHT_MAX_TIME", &value)) {
+    ctf_descriptor->flight_max_time = value * GST_SECOND;
+  }
+  if (ctf_env_var_to_uint64 ("GST_SHARK_SNAPSHOT_PROCTIME", &value)) {
+    ctf_descriptor->snapshot_proctime = value;
+  }
+  if (ctf_env_var_to_uint64 ("GST_SHARK_SNAPSHOT_INTERLATENCY", &value)) {
+    ctf_descriptor->snapshot_interlatency = value;
+  }
+}
+
 static void
 ctf_process_env_var (void)
 {
   const gchar *env_loc_value;
   const gchar *env_file_buf_value;
   gchar *env_file_buf_value_end;
+  const gchar *env_file_mmap_value;
+#ifdef HAVE_SYS_MMAN_H
+  gchar *env_file_mmap_value_end;
+  guint64 file_mmap_chunk;
+#endif
+  const gchar *env_max_file_size_value;
+  gchar *env_max_file_size_value_end;
+  guint64 max_file_size;
+  const gchar *env_max_files_value;
+  gchar *env_max_files_value_end;
+  guint64 max_files;
+  const gchar *env_tcp_queue_value;
+  gchar *env_tcp_queue_value_end;
+  const gchar *env_tcp_drop_value;
+  guint64 tcp_queue_size;
   gchar dir_name[MAX_DIRNAME_LEN];
   gchar *env_dir_name;
   gchar *env_line;
@@ -552,6 +921,90 @@ ctf_process_env_var (void)
     }
   }
 
+  env_file_mmap_value = g_getenv ("GST_SHARK_FILE_MMAP");
+
+  if (NULL != env_file_mmap_value) {
+#ifdef HAVE_SYS_MMAN_H
+    ctf_descriptor->file_mmap = TRUE;
+    if ('\0' != env_file_mmap_value[0]) {
+      file_mmap_chunk =
+          g_ascii_strtoull (env_file_mmap_value, &env_file_mmap_value_end, 10);
+      if ('\0' == *env_file_mmap_value_end && '-' != env_file_mmap_value[0]
+          && 0 != file_mmap_chunk) {
+        ctf_descriptor->file_mmap_chunk = file_mmap_chunk;
+      } else {
+        GST_ERROR ("Invalid mmap chunk size \"%s\", using the default value: "
+            "%d", env_file_mmap_value, CTF_MMAP_CHUNK_SIZE);
+      }
+    }
+#else
+    GST_WARNING ("Memory mapped output is not supported, using stdio");
+#endif
+  }
+
+  env_max_file_size_value = g_getenv ("GST_SHARK_MAX_FILE_SIZE");
+
+  if (NULL != env_max_file_size_value) {
+    max_file_size = g_ascii_strtoull (env_max_file_size_value,
+        &env_max_file_size_value_end, 10);
+    if ('\0' == *env_max_file_size_value_end
+        && '-' != env_max_file_size_value[0]) {
+      ctf_descriptor->max_file_size = max_file_size;
+    } else {
+      GST_ERROR ("Invalid maximum file size \"%s\", files will not be rotated",
+          env_max_file_size_value);
+    }
+  }
+
+  env_max_files_value = g_getenv ("GST_SHARK_MAX_FILES");
+
+  if (NULL != env_max_files_value) {
+    max_files =
+        g_ascii_strtoull (env_max_files_value, &env_max_files_value_end, 10);
+    if ('\0' == *env_max_files_value_end && '-' != env_max_files_value[0]
+        && max_files <= G_MAXUINT) {
+      ctf_descriptor->max_files = max_files;
+    } else {
+      GST_ERROR ("Invalid maximum number of files \"%s\", keeping all of "
+          "them", env_max_files_value);
+    }
+  }
+
+  if (0 != ctf_descriptor->max_files && 0 == ctf_descriptor->max_file_size) {
+    GST_WARNING ("GST_SHARK_MAX_FILES has no effect without "
+        "GST_SHARK_MAX_FILE_SIZE");
+  }
+
+  env_tcp_queue_value = g_getenv ("GST_SHARK_TCP_QUEUE_SIZE");
+
+  if (NULL != env_tcp_queue_value) {
+    tcp_queue_size =
+        g_ascii_strtoull (env_tcp_queue_value, &env_tcp_queue_value_end, 10);
+    if ('\0' == *env_tcp_queue_value_end && '-' != env_tcp_queue_value[0]) {
+      ctf_descriptor->tcp_queue_size = tcp_queue_size;
+    } else {
+      GST_ERROR ("Invalid TCP queue size \"%s\", using the default value: %d",
+          env_tcp_queue_value, TCP_QUEUE_SIZE);
+    }
+  }
+
+  env_tcp_drop_value = g_getenv ("GST_SHARK_TCP_DROP_POLICY");
+
+  if (NULL != env_tcp_drop_value) {
+    if (0 == g_strcmp0 (env_tcp_drop_value, "oldest")) {
+      ctf_descriptor->tcp_drop_oldest = TRUE;
+    } else if (0 == g_strcmp0 (env_tcp_drop_value, "newest")) {
+      ctf_descriptor->tcp_drop_oldest = FALSE;
+    } else {
+      GST_ERROR ("Invalid TCP drop policy \"%s\", dropping the oldest packets",
+          env_tcp_drop_value);
+    }
+  }
+
+  if (ctf_descriptor->flight) {
+    ctf_process_flight_env_var ();
+  }
+
   if (G_UNLIKELY (g_getenv ("GST_SHARK_CTF_DISABLE") != NULL)) {
     env_dir_name = (gchar *) g_getenv ("PWD");
     ctf_descriptor->file_output_disable = TRUE;
@@ -597,26 +1050,23 @@ static void
 ctf_file_init (void)
 {
   gchar *metadata_file = NULL;
-  gchar *datastream_file = NULL;
 
   g_mutex_init (&ctf_descriptor->mutex);
 
+  /* Nothing is written until a snapshot is requested */
+  if (ctf_descriptor->flight) {
+    ctf_descriptor->file_output_disable = TRUE;
+    ctf_descriptor->flight_metadata = g_string_new (NULL);
+    return;
+  }
+
   if (TRUE != ctf_descriptor->file_output_disable) {
     /* Creating the output folder for the CTF output files. */
     if (create_ctf_path (ctf_descriptor->dir_name) == 0) {
-      datastream_file =
-          g_strjoin (G_DIR_SEPARATOR_S, ctf_descriptor->dir_name, "datastream",
-          NULL);
       metadata_file =
           g_strjoin (G_DIR_SEPARATOR_S, ctf_descriptor->dir_name, "metadata",
           NULL);
 
-      ctf_descriptor->datastream = g_fopen (datastream_file, "w");
-      if (ctf_descriptor->datastream == NULL) {
-        GST_ERROR ("Could not open datastream file, path does not exist.");
-        goto error;
-      }
-
       ctf_descriptor->metadata = g_fopen (metadata_file, "w");
       if (ctf_descriptor->metadata == NULL) {
         GST_ERROR ("Could not open metadata file, path does not exist.");
@@ -626,19 +1076,14 @@ ctf_file_init (void)
       if (ctf_descriptor->change_file_buf_size) {
         if (ctf_descriptor->file_buf_size == 0) {
           setvbuf (ctf_descriptor->metadata, NULL, _IONBF, 0);
-          setvbuf (ctf_descriptor->datastream, NULL, _IONBF, 0);
         } else {
           setvbuf (ctf_descriptor->metadata, NULL, _IOFBF,
               ctf_descriptor->file_buf_size);
-          setvbuf (ctf_descriptor->datastream, NULL, _IOFBF,
-              ctf_descriptor->file_buf_size);
         }
       }
 
-      ctf_descriptor->start_time = gst_util_get_timestamp ();
       ctf_descriptor->file_output_disable = FALSE;
 
-      g_free (datastream_file);
       g_free (metadata_file);
       return;
     } else {
@@ -652,533 +1097,1544 @@ ctf_file_init (void)
 
 error:
   ctf_descriptor->file_output_disable = TRUE;
-  g_free (datastream_file);
   g_free (metadata_file);
 }
 
 
-static void
-ctf_tcp_init (void)
+static GBytes *
+ctf_tcp_chunk_new (tcp_header_id id, const void *data, gsize size)
 {
-  GSocketClient *socket_client;
-  GOutputStream *output_stream;
-  GSocketConnection *socket_connection;
-  GError *error;
-
-  /* Verify if the host name was given */
-  if (NULL == ctf_descriptor->host_name) {
-    ctf_descriptor->tcp_output_disable = TRUE;
-    return;
-  }
-
-  /* Creates a new GSocketClient with the default options. */
-  socket_client = g_socket_client_new ();
-
-  g_socket_client_set_protocol (socket_client, SOCKET_PROTOCOL);
+  guint8 *chunk;
+  guint8 *mem;
 
-  /* Attempts to create a TCP connection to the named host. */
-  error = NULL;
-  socket_connection = g_socket_client_connect_to_host (socket_client,
-      ctf_descriptor->host_name, ctf_descriptor->port_number, NULL, &error);
+  chunk = g_malloc (size + TCP_HEADER_SIZE);
+  mem = chunk;
 
-  /* Verify connection */
-  if (NULL == socket_connection) {
-    g_object_unref (socket_client);
-    socket_client = NULL;
-    ctf_descriptor->tcp_output_disable = TRUE;
-    return;
-  }
+  /* Write the TCP header */
+  TCP_EVENT_HEADER_WRITE (id, size, mem);
+  memcpy (chunk + TCP_HEADER_SIZE, data, size);
 
-  output_stream =
-      g_io_stream_get_output_stream (G_IO_STREAM (socket_connection));
-  /* Store connection variables */
-  ctf_descriptor->socket_client = socket_client;
-  ctf_descriptor->socket_connection = socket_connection;
-  ctf_descriptor->output_stream = output_stream;
+  return g_bytes_new_take (chunk, size + TCP_HEADER_SIZE);
 }
 
-gboolean
-gst_ctf_init (void)
+static GstCtfTcpChunk *
+ctf_tcp_datastream_chunk_new (guint32 stream_idx, const guint8 * data,
+    gsize size, gboolean names)
 {
-  if (ctf_descriptor) {
-    GST_ERROR ("CTF Descriptor already exists.");
-    return FALSE;
-  }
+  GstCtfTcpChunk *chunk;
+  guint8 *section;
+  guint8 *mem;
+  gsize section_size;
 
-  /* Since the descriptors structure does not exist it is needed to
-     create and initialize a new one. */
-  ctf_descriptor = ctf_create_struct ();
-  /* Load and proccess enviroment variables */
-  ctf_process_env_var ();
+  section_size = sizeof (tcp_stream_index) + size;
+  section = g_malloc (section_size + TCP_HEADER_SIZE);
+  mem = section;
 
-  ctf_file_init ();
-  ctf_tcp_init ();
+  TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, section_size, mem);
+  mem = section + TCP_HEADER_SIZE;
+  CTF_EVENT_WRITE_INT32 (stream_idx, mem);
+  memcpy (mem, data, size);
 
-  generate_metadata (1, 3, BYTE_ORDER_LE);
-  generate_datastream_header ();
-  do_print_ctf_init (INIT_EVENT_ID);
+  chunk = g_new (GstCtfTcpChunk, 1);
+  chunk->bytes = g_bytes_new_take (section, section_size + TCP_HEADER_SIZE);
+  chunk->names = names;
 
+  return chunk;
+}
 
-  return TRUE;
+static void
+ctf_tcp_chunk_free (GstCtfTcpChunk * chunk)
+{
+  g_bytes_unref (chunk->bytes);
+  g_free (chunk);
 }
 
-void
-add_metadata_event_struct (const gchar * metadata_event)
+/* Account a packet that will never reach the collector. Must be called
+ * with the sender mutex held.
+ */
+static void
+ctf_tcp_drop (gsize size, gboolean names)
 {
-  GError *error;
-  gchar *event_mem;
-  guint event_size;
-  guint8 *mem;
+  ctf_descriptor->tcp_dropped_packets++;
+  ctf_descriptor->tcp_dropped_bytes += size;
+  if (names) {
+    ctf_descriptor->tcp_names_lost = TRUE;
+  }
+}
 
-  event_size = strlen (metadata_event);
+/* The metadata is kept for the whole session, so it can be sent again
+ * after a reconnection.
+ */
+static void
+ctf_tcp_send_metadata (const gchar * metadata, gsize size)
+{
+  g_mutex_lock (&ctf_descriptor->sender_mutex);
+  g_string_append_len (ctf_descriptor->tcp_metadata, metadata, size);
+  g_cond_signal (&ctf_descriptor->sender_cond);
+  g_mutex_unlock (&ctf_descriptor->sender_mutex);
+}
 
-  if (event_exceeds_mem_size (event_size)) {
-    return;
-  }
+/* Queue a datastream packet of the given stream for the sender thread.
+ * When the queue is full either the oldest queued packets or the new one
+ * are dropped, so a slow collector never blocks the caller. names tells
+ * whether the packet has name_table events.
+ */
+static void
+ctf_tcp_send_datastream (guint32 stream_idx, const guint8 * data, gsize size,
+    gboolean names)
+{
+  GstCtfTcpChunk *chunk;
+  gsize chunk_size;
 
-  mem = ctf_descriptor->mem;
-  event_mem = (gchar *) mem + TCP_HEADER_SIZE;
+  chunk_size = size + sizeof (tcp_stream_index) + TCP_HEADER_SIZE;
 
-  /* This function only writes the event structure to the metadata file, it
-     depends entirely of what is passed as an argument. */
-  g_mutex_lock (&ctf_descriptor->mutex);
+  g_mutex_lock (&ctf_descriptor->sender_mutex);
 
-  memcpy (event_mem, metadata_event, event_size);
+  if (ctf_descriptor->tcp_drop_oldest) {
+    while (!g_queue_is_empty (&ctf_descriptor->tcp_queue) &&
+        ctf_descriptor->tcp_queue_bytes + chunk_size >
+        ctf_descriptor->tcp_queue_size) {
+      GstCtfTcpChunk *oldest = g_queue_pop_head (&ctf_descriptor->tcp_queue);
+      gsize oldest_size = g_bytes_get_size (oldest->bytes);
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->metadata);
+      ctf_descriptor->tcp_queue_bytes -= oldest_size;
+      ctf_tcp_drop (oldest_size, oldest->names);
+      ctf_tcp_chunk_free (oldest);
+    }
   }
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    TCP_EVENT_HEADER_WRITE (TCP_METADATA_ID, event_size, mem);
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+  if (ctf_descriptor->tcp_queue_bytes + chunk_size >
+      ctf_descriptor->tcp_queue_size) {
+    ctf_tcp_drop (chunk_size, names);
+  } else {
+    chunk = ctf_tcp_datastream_chunk_new (stream_idx, data, size, names);
+    g_queue_push_tail (&ctf_descriptor->tcp_queue, chunk);
+    ctf_descriptor->tcp_queue_bytes += chunk_size;
+    g_cond_signal (&ctf_descriptor->sender_cond);
   }
-  g_mutex_unlock (&ctf_descriptor->mutex);
-}
 
+  g_mutex_unlock (&ctf_descriptor->sender_mutex);
+}
 
-void
-do_print_cpuusage_event (event_id id, guint32 cpu_num, gfloat * cpuload)
+static GSocketConnection *
+ctf_tcp_connect (void)
 {
-  GError *error;
-  guint8 *mem;
-  guint8 *event_mem;
-  gsize event_size;
-  gint cpu_idx;
+  GSocketConnection *socket_connection;
+  GError *error = NULL;
 
-  event_size = cpu_num * sizeof (gfloat) + CTF_HEADER_SIZE;
+  /* Attempts to create a TCP connection to the named host. */
+  socket_connection =
+      g_socket_client_connect_to_host (ctf_descriptor->socket_client,
+      ctf_descriptor->host_name, ctf_descriptor->port_number, NULL, &error);
 
-  if (event_exceeds_mem_size (event_size)) {
-    return;
+  if (NULL == socket_connection) {
+    GST_WARNING ("Could not connect to %s:%d: %s", ctf_descriptor->host_name,
+        ctf_descriptor->port_number, error->message);
+    g_clear_error (&error);
+  } else {
+    GST_INFO ("Connected to %s:%d", ctf_descriptor->host_name,
+        ctf_descriptor->port_number);
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
+  return socket_connection;
+}
 
-  /* Lock mem, datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-  /* Write CPU load for each CPU */
-  for (cpu_idx = 0; cpu_idx < cpu_num; ++cpu_idx) {
-    /* Write CPU load */
-    CTF_EVENT_WRITE_FLOAT (cpuload[cpu_idx], event_mem);
-  }
+static void
+ctf_tcp_disconnect (GSocketConnection * socket_connection)
+{
+  g_io_stream_close (G_IO_STREAM (socket_connection), NULL, NULL);
+  g_object_unref (socket_connection);
+}
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
+/* Wait for the sender condition until the given time or until the sender
+ * is stopped. Must be called with the sender mutex held.
+ */
+static void
+ctf_tcp_wait (gint64 end_time)
+{
+  while (ctf_descriptor->sender_running &&
+      g_get_monotonic_time () < end_time) {
+    if (!g_cond_wait_until (&ctf_descriptor->sender_cond,
+            &ctf_descriptor->sender_mutex, end_time)) {
+      break;
+    }
   }
+}
 
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
+static void
+ctf_tcp_report_dropped (guint64 packets, guint64 bytes)
+{
+  /* Events can only be added while the writer thread is running */
+  g_mutex_lock (&ctf_descriptor->writer_mutex);
+  if (ctf_descriptor->writer_running) {
+    do_print_tcp_dropped_event (packets, bytes);
+  }
+  g_mutex_unlock (&ctf_descriptor->writer_mutex);
+
+  GST_WARNING ("%" G_GUINT64_FORMAT " packets dropped from the TCP output",
+      packets);
+}
+
+static gpointer
+ctf_tcp_sender_thread (gpointer data)
+{
+  GSocketConnection *socket_connection = NULL;
+  GOutputStream *output_stream = NULL;
+  GBytes *metadata;
+  GstCtfTcpChunk *chunk;
+  GString *tcp_metadata;
+  GError *error = NULL;
+  guint64 dropped_packets = 0;
+  guint64 dropped_bytes = 0;
+  guint64 reported_packets = 0;
+  gint64 report_time;
+  gboolean connected = FALSE;
+  gboolean report;
+  gboolean res;
+
+  tcp_metadata = ctf_descriptor->tcp_metadata;
+  report_time = g_get_monotonic_time () + TCP_REPORT_INTERVAL;
+
+  g_mutex_lock (&ctf_descriptor->sender_mutex);
+  while (TRUE) {
+    /* Connect in the background, meanwhile the packets are queued */
+    if (NULL == socket_connection) {
+      if (!ctf_descriptor->sender_running) {
+        break;
+      }
+
+      g_mutex_unlock (&ctf_descriptor->sender_mutex);
+      socket_connection = ctf_tcp_connect ();
+      g_mutex_lock (&ctf_descriptor->sender_mutex);
+
+      if (NULL == socket_connection) {
+        ctf_tcp_wait (g_get_monotonic_time () + TCP_RECONNECT_INTERVAL);
+        continue;
+      }
+
+      output_stream =
+          g_io_stream_get_output_stream (G_IO_STREAM (socket_connection));
+      /* A new connection starts with the whole metadata, and the names
+         sent over the previous one may not have reached the collector */
+      ctf_descriptor->tcp_metadata_sent = 0;
+      if (connected) {
+        ctf_descriptor->tcp_names_lost = TRUE;
+      }
+      connected = TRUE;
+    }
+
+    while (ctf_descriptor->sender_running &&
+        g_queue_is_empty (&ctf_descriptor->tcp_queue) &&
+        ctf_descriptor->tcp_metadata_sent == tcp_metadata->len &&
+        g_get_monotonic_time () < report_time) {
+      g_cond_wait_until (&ctf_descriptor->sender_cond,
+          &ctf_descriptor->sender_mutex, report_time);
+    }
+
+    /* When stopping, send whatever is left before leaving */
+    if (!ctf_descriptor->sender_running &&
+        g_queue_is_empty (&ctf_descriptor->tcp_queue) &&
+        ctf_descriptor->tcp_metadata_sent == tcp_metadata->len) {
+      break;
+    }
+
+    metadata = NULL;
+    if (ctf_descriptor->tcp_metadata_sent < tcp_metadata->len) {
+      metadata = ctf_tcp_chunk_new (TCP_METADATA_ID,
+          tcp_metadata->str + ctf_descriptor->tcp_metadata_sent,
+          tcp_metadata->len - ctf_descriptor->tcp_metadata_sent);
+      ctf_descriptor->tcp_metadata_sent = tcp_metadata->len;
+    }
+
+    chunk = g_queue_pop_head (&ctf_descriptor->tcp_queue);
+    if (NULL != chunk) {
+      ctf_descriptor->tcp_queue_bytes -= g_bytes_get_size (chunk->bytes);
+    }
+
+    report = FALSE;
+    if (g_get_monotonic_time () >= report_time) {
+      report_time = g_get_monotonic_time () + TCP_REPORT_INTERVAL;
+      dropped_packets = ctf_descriptor->tcp_dropped_packets;
+      dropped_bytes = ctf_descriptor->tcp_dropped_bytes;
+      report = dropped_packets != reported_packets;
+      reported_packets = dropped_packets;
+    }
+
+    g_mutex_unlock (&ctf_descriptor->sender_mutex);
+
+    res = TRUE;
+    if (NULL != metadata) {
+      res = g_output_stream_write_all (output_stream,
+          g_bytes_get_data (metadata, NULL), g_bytes_get_size (metadata),
+          NULL, NULL, &error);
+      g_bytes_unref (metadata);
+    }
+    if (res && NULL != chunk) {
+      res = g_output_stream_write_all (output_stream,
+          g_bytes_get_data (chunk->bytes, NULL),
+          g_bytes_get_size (chunk->bytes), NULL, NULL, &error);
+    }
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+    if (report) {
+      ctf_tcp_report_dropped (dropped_packets, dropped_bytes);
+    }
+
+    g_mutex_lock (&ctf_descriptor->sender_mutex);
+
+    if (!res) {
+      GST_WARNING ("Failed to send trace: %s, reconnecting", error->message);
+      g_clear_error (&error);
+
+      if (NULL != chunk) {
+        ctf_tcp_drop (g_bytes_get_size (chunk->bytes), chunk->names);
+      }
+
+      ctf_tcp_disconnect (socket_connection);
+      socket_connection = NULL;
+      output_stream = NULL;
+    }
+
+    if (NULL != chunk) {
+      ctf_tcp_chunk_free (chunk);
+    }
   }
+  g_mutex_unlock (&ctf_descriptor->sender_mutex);
 
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  if (NULL != socket_connection) {
+    ctf_tcp_disconnect (socket_connection);
+  }
+
+  return NULL;
 }
 
-void
-do_print_proctime_event (event_id id, gchar * elementname, guint64 time)
+static void
+ctf_tcp_init (void)
 {
-  GError *error;
-  guint8 *mem;
-  guint8 *event_mem;
-  gsize event_size;
+  GSocketClient *socket_client;
 
-  event_size = strlen (elementname) + 1 + sizeof (time) + CTF_HEADER_SIZE;
+  /* Verify if the host name was given */
+  if (NULL == ctf_descriptor->host_name) {
+    ctf_descriptor->tcp_output_disable = TRUE;
+    return;
+  }
 
-  if (event_exceeds_mem_size (event_size)) {
+  /* Creates a new GSocketClient with the default options. */
+  socket_client = g_socket_client_new ();
+
+  g_socket_client_set_protocol (socket_client, SOCKET_PROTOCOL);
+  g_socket_client_set_timeout (socket_client, TCP_CONNECT_TIMEOUT);
+
+  ctf_descriptor->socket_client = socket_client;
+  ctf_descriptor->tcp_metadata = g_string_new (NULL);
+
+  /* Stream the name table is sent again in when names were lost */
+  g_mutex_lock (&ctf_rings_mutex);
+  ctf_descriptor->tcp_names_stream = ctf_descriptor->stream_count++;
+  g_mutex_unlock (&ctf_rings_mutex);
+
+  /* The connection is done by the sender thread, so a missing or slow
+     collector does not delay the pipeline */
+  g_mutex_init (&ctf_descriptor->sender_mutex);
+  g_cond_init (&ctf_descriptor->sender_cond);
+
+  ctf_descriptor->sender_running = TRUE;
+  ctf_descriptor->sender =
+      g_thread_new ("GstSharkCtfSender", ctf_tcp_sender_thread, NULL);
+}
+
+static void
+ctf_tcp_close (void)
+{
+  GstCtfTcpChunk *chunk;
+
+  if (NULL == ctf_descriptor->sender) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
+  g_mutex_lock (&ctf_descriptor->sender_mutex);
+  ctf_descriptor->sender_running = FALSE;
+  g_cond_signal (&ctf_descriptor->sender_cond);
+  g_mutex_unlock (&ctf_descriptor->sender_mutex);
 
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-  /* Write element name */
-  CTF_EVENT_WRITE_STRING (elementname, event_mem);
-  /* Write time */
-  CTF_EVENT_WRITE_INT64 (time, event_mem);
+  g_thread_join (ctf_descriptor->sender);
+  ctf_descriptor->sender = NULL;
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem -= event_size;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
+  while ((chunk = g_queue_pop_head (&ctf_descriptor->tcp_queue))) {
+    ctf_tcp_chunk_free (chunk);
   }
+  g_string_free (ctf_descriptor->tcp_metadata, TRUE);
+  ctf_descriptor->tcp_metadata = NULL;
 
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
+  g_cond_clear (&ctf_descriptor->sender_cond);
+  g_mutex_clear (&ctf_descriptor->sender_mutex);
+
+  g_object_unref (ctf_descriptor->socket_client);
+  ctf_descriptor->socket_client = NULL;
+}
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+#ifdef HAVE_SYS_MMAN_H
+static gboolean
+ctf_mapped_file_open (GstCtfMappedFile * file, const gchar * filename)
+{
+  file->fd = g_open (filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (file->fd < 0) {
+    GST_ERROR ("Could not open datastream file %s: %s", filename,
+        g_strerror (errno));
+    return FALSE;
   }
 
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  file->data = NULL;
+  file->offset = 0;
+  file->mapped = 0;
+  file->size = 0;
+
+  return TRUE;
 }
 
-void
-do_print_framerate_event (event_id id, gchar * elementname, guint64 fps)
+static void
+ctf_mapped_file_close (GstCtfMappedFile * file)
 {
-  GError *error;
-  guint8 *mem;
-  guint8 *event_mem;
-  gsize event_size;
+  if (file->fd < 0) {
+    return;
+  }
+
+  if (NULL != file->data) {
+    munmap (file->data, file->mapped);
+    file->data = NULL;
+  }
+  /* Release the blocks preallocated past the last packet */
+  if (0 != ftruncate (file->fd, file->size)) {
+    GST_WARNING ("Could not trim datastream file: %s", g_strerror (errno));
+  }
+  close (file->fd);
+  file->fd = -1;
+}
 
-  event_size = strlen (elementname) + 1 + sizeof (guint64) + CTF_HEADER_SIZE;
+/* Map a window of the file that takes the next size bytes. The window
+ * starts at the page of the end of the file and is preallocated without
+ * moving the end of the file.
+ */
+static gboolean
+ctf_mapped_file_map (GstCtfMappedFile * file, gsize size)
+{
+  gsize page_size;
+  gsize chunk;
+  gsize offset;
+  gsize mapped;
+  guint8 *data;
+
+  page_size = sysconf (_SC_PAGESIZE);
+  /* The chunk size is not necessarily a power of two */
+  chunk = (ctf_descriptor->file_mmap_chunk + page_size - 1) / page_size;
+  chunk *= page_size;
+  offset = file->size - file->size % page_size;
+  mapped = (file->size - offset + size + chunk - 1) / chunk * chunk;
+
+#ifdef FALLOC_FL_KEEP_SIZE
+  if (0 != fallocate (file->fd, FALLOC_FL_KEEP_SIZE, offset, mapped)) {
+    GST_WARNING ("Could not preallocate datastream file: %s",
+        g_strerror (errno));
+  }
+#endif
 
-  if (event_exceeds_mem_size (event_size)) {
+  data = mmap (NULL, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd,
+      offset);
+  if (MAP_FAILED == data) {
+    GST_ERROR ("Could not map datastream file: %s", g_strerror (errno));
+    return FALSE;
+  }
+  if (NULL != file->data) {
+    munmap (file->data, file->mapped);
+  }
+  file->data = data;
+  file->offset = offset;
+  file->mapped = mapped;
+
+  return TRUE;
+}
+
+/* Append a complete packet. The end of the file is moved once to cover
+ * it, so readers never see more than the packet being copied in.
+ */
+static gboolean
+ctf_mapped_file_write (GstCtfMappedFile * file, const guint8 * packet,
+    gsize size)
+{
+  gsize page_size;
+  gsize start;
+
+  if (file->size + size > file->offset + file->mapped) {
+    if (!ctf_mapped_file_map (file, size)) {
+      return FALSE;
+    }
+  }
+
+  /* Stores past the end of the file would fault */
+  if (0 != ftruncate (file->fd, file->size + size)) {
+    GST_ERROR ("Could not extend datastream file: %s", g_strerror (errno));
+    return FALSE;
+  }
+  memcpy (file->data + file->size - file->offset, packet, size);
+
+  page_size = sysconf (_SC_PAGESIZE);
+  start = file->size - file->size % page_size;
+  file->size += size;
+
+  /* Start the writeback of the complete packet */
+  msync (file->data + start - file->offset, file->size - start, MS_ASYNC);
+
+  return TRUE;
+}
+#endif
+
+static void
+ctf_ring_open_datastream (GstCtfRing * ring)
+{
+  gchar *datastream_name;
+  gchar *datastream_file;
+
+  /* Rotated streams are split in datastream_<stream>_<sequence> files */
+  if (0 != ctf_descriptor->max_file_size) {
+    datastream_name = g_strdup_printf ("datastream_%u_%u", ring->stream_idx,
+        ring->file_count);
+  } else {
+    datastream_name = g_strdup_printf ("datastream_%u", ring->stream_idx);
+  }
+  datastream_file =
+      g_strjoin (G_DIR_SEPARATOR_S, ctf_descriptor->dir_name, datastream_name,
+      NULL);
+  g_free (datastream_name);
+
+#ifdef HAVE_SYS_MMAN_H
+  if (ctf_descriptor->file_mmap) {
+    if (ctf_mapped_file_open (&ring->mapped, datastream_file)) {
+      goto opened;
+    }
+    g_free (datastream_file);
     return;
   }
+#endif
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
+  ring->datastream = g_fopen (datastream_file, "w");
+  if (NULL == ring->datastream) {
+    GST_ERROR ("Could not open datastream file %s", datastream_file);
+    g_free (datastream_file);
+    return;
+  }
+  if (ctf_descriptor->change_file_buf_size) {
+    if (ctf_descriptor->file_buf_size == 0) {
+      setvbuf (ring->datastream, NULL, _IONBF, 0);
+    } else {
+      setvbuf (ring->datastream, NULL, _IOFBF, ctf_descriptor->file_buf_size);
+    }
+  }
 
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-  /* Write element name */
-  CTF_EVENT_WRITE_STRING (elementname, event_mem);
-  /* Write fps */
-  CTF_EVENT_WRITE_INT64 (fps, event_mem);
+#ifdef HAVE_SYS_MMAN_H
+opened:
+#endif
+  ring->file_size = 0;
+  ring->file_count++;
+  g_queue_push_tail (&ring->files, datastream_file);
+
+  /* Delete the oldest files of the stream */
+  while (0 != ctf_descriptor->max_files &&
+      g_queue_get_length (&ring->files) > ctf_descriptor->max_files) {
+    datastream_file = g_queue_pop_head (&ring->files);
+    if (0 != g_unlink (datastream_file)) {
+      GST_WARNING ("Could not delete datastream file %s", datastream_file);
+    }
+    g_free (datastream_file);
+  }
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
+  /* The first events of the stream may be gone along with the names they
+     defined, every following file repeats the whole name table */
+  if (ring->file_count > 1) {
+    ctf_ring_write_name_table (ring);
   }
+}
 
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
+static inline gboolean
+ctf_ring_datastream_is_open (GstCtfRing * ring)
+{
+  return NULL != ring->datastream || ring->mapped.fd >= 0;
+}
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+static void
+ctf_ring_close_datastream (GstCtfRing * ring)
+{
+#ifdef HAVE_SYS_MMAN_H
+  ctf_mapped_file_close (&ring->mapped);
+#endif
+  if (NULL != ring->datastream) {
+    fclose (ring->datastream);
+    ring->datastream = NULL;
   }
+}
 
-  g_mutex_unlock (&ctf_descriptor->mutex);
+/* Release the datastream of a ring that will not be written anymore */
+static void
+ctf_ring_finish_datastream (GstCtfRing * ring)
+{
+  ctf_ring_close_datastream (ring);
+  g_queue_foreach (&ring->files, (GFunc) g_free, NULL);
+  g_queue_clear (&ring->files);
 }
 
-void
-do_print_interlatency_event (event_id id,
-    gchar * originpad, gchar * destinationpad, guint64 time)
+/* Open the datastream of the ring if needed and return where its next
+ * packet has to be built. The size of a packet is only known once it is
+ * complete, so it is built in the descriptor memory and written as a
+ * whole.
+ */
+static guint8 *
+ctf_ring_packet_begin (GstCtfRing * ring)
 {
-  GError *error;
-  guint8 *mem;
-  guint8 *event_mem;
-  gsize event_size;
+  if (FALSE == ctf_descriptor->file_output_disable &&
+      !ctf_ring_datastream_is_open (ring)) {
+    ctf_ring_open_datastream (ring);
+  }
 
-  event_size =
-      strlen (originpad) + 1 + strlen (destinationpad) + 1 + sizeof (guint64) +
-      CTF_HEADER_SIZE;
+  return ctf_descriptor->mem + TCP_HEADER_SIZE;
+}
 
-  if (event_exceeds_mem_size (event_size)) {
+static guint64
+ctf_flight_packet_timestamp (GstCtfFlightPacket * flight_packet, gsize offset)
+{
+  const guint8 *packet;
+
+  packet = g_bytes_get_data (flight_packet->packet, NULL);
+
+  return CTF_EVENT_READ (64, packet + offset);
+}
+
+static void
+ctf_flight_packet_free (GstCtfFlightPacket * flight_packet)
+{
+  g_bytes_unref (flight_packet->packet);
+  g_slice_free (GstCtfFlightPacket, flight_packet);
+}
+
+/* Keep a copy of the packet and forget the ones that fall out of the
+ * configured size or time window.
+ */
+static void
+ctf_flight_push (GstCtfRing * ring, const guint8 * packet, gsize size)
+{
+  GstCtfFlightPacket *flight_packet;
+  GstCtfFlightPacket *oldest;
+  guint64 timestamp_end;
+  GQueue *packets;
+
+  packets = &ctf_descriptor->flight_packets;
+
+  flight_packet = g_slice_new (GstCtfFlightPacket);
+  flight_packet->stream_idx = ring->stream_idx;
+  flight_packet->packet = g_bytes_new (packet, size);
+  g_queue_push_tail (packets, flight_packet);
+  ctf_descriptor->flight_bytes += size;
+
+  timestamp_end = ctf_flight_packet_timestamp (flight_packet,
+      CTF_PACKET_TIMESTAMP_END_OFFSET);
+
+  while (g_queue_get_length (packets) > 1) {
+    oldest = g_queue_peek_head (packets);
+    if (ctf_descriptor->flight_bytes <= ctf_descriptor->flight_max_size &&
+        (0 == ctf_descriptor->flight_max_time ||
+            timestamp_end - ctf_flight_packet_timestamp (oldest,
+                CTF_PACKET_TIMESTAMP_END_OFFSET) <=
+            ctf_descriptor->flight_max_time)) {
+      break;
+    }
+    g_queue_pop_head (packets);
+    ctf_descriptor->flight_bytes -= g_bytes_get_size (oldest->packet);
+    ctf_flight_packet_free (oldest);
+  }
+}
+
+static void
+ctf_flight_write_packet (const guint8 * packet, gsize size, gpointer user_data)
+{
+  fwrite (packet, sizeof (gchar), size, (FILE *) user_data);
+}
+
+static FILE *
+ctf_flight_open_file (const gchar * dir_name, const gchar * name)
+{
+  gchar *file_name;
+  FILE *file;
+
+  file_name = g_strjoin (G_DIR_SEPARATOR_S, dir_name, name, NULL);
+  file = g_fopen (file_name, "w");
+  if (NULL == file) {
+    GST_ERROR ("Could not open snapshot file %s", file_name);
+  }
+  g_free (file_name);
+
+  return file;
+}
+
+/* Write the recorded packets as a complete trace in a new snapshot_<n>
+ * directory. The name table gets its own stream since the packets that
+ * defined the names may be gone.
+ */
+static void
+ctf_flight_snapshot (void)
+{
+  GstCtfFlightPacket *flight_packet;
+  GHashTable *datastreams;
+  gchar *snapshot_dir;
+  gchar *datastream_name;
+  gconstpointer data;
+  gsize size;
+  GList *node;
+  FILE *file;
+
+  if (0 != create_ctf_path (ctf_descriptor->dir_name)) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
+  snapshot_dir = g_strdup_printf ("%s" G_DIR_SEPARATOR_S "snapshot_%u",
+      ctf_descriptor->dir_name, ctf_descriptor->snapshot_count++);
+  if (0 != create_ctf_path (snapshot_dir)) {
+    g_free (snapshot_dir);
+    return;
+  }
+
+  GST_INFO ("Writing %u recorded packets to %s",
+      g_queue_get_length (&ctf_descriptor->flight_packets), snapshot_dir);
+
+  datastreams = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) fclose);
 
-  /* Lock mem and datastream and output_stream resources */
   g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-  /* Add event payload */
-  /* Write origin pad name */
-  CTF_EVENT_WRITE_STRING (originpad, event_mem);
-  /* Write destination pad name */
-  CTF_EVENT_WRITE_STRING (destinationpad, event_mem);
-  /* Write time */
-  CTF_EVENT_WRITE_INT64 (time, event_mem);
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
+  file = ctf_flight_open_file (snapshot_dir, "metadata");
+  if (NULL != file) {
+    fwrite (ctf_descriptor->flight_metadata->str, sizeof (gchar),
+        ctf_descriptor->flight_metadata->len, file);
+    fclose (file);
   }
 
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
-
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+  flight_packet = g_queue_peek_head (&ctf_descriptor->flight_packets);
+  if (NULL != flight_packet) {
+    file = ctf_flight_open_file (snapshot_dir, "datastream_names");
+    if (NULL != file) {
+      ctf_write_name_table (ctf_flight_packet_timestamp (flight_packet,
+              CTF_PACKET_TIMESTAMP_BEGIN_OFFSET), CTF_NAMES_STREAM_INSTANCE,
+          0, ctf_flight_write_packet, file);
+      fclose (file);
+    }
   }
+
   g_mutex_unlock (&ctf_descriptor->mutex);
+
+  for (node = ctf_descriptor->flight_packets.head; NULL != node;
+      node = g_list_next (node)) {
+    flight_packet = (GstCtfFlightPacket *) node->data;
+
+    if (!g_hash_table_lookup_extended (datastreams,
+            GUINT_TO_POINTER (flight_packet->stream_idx), NULL,
+            (gpointer *) & file)) {
+      datastream_name = g_strdup_printf ("datastream_%u",
+          flight_packet->stream_idx);
+      file = ctf_flight_open_file (snapshot_dir, datastream_name);
+      g_free (datastream_name);
+      if (NULL == file) {
+        continue;
+      }
+      g_hash_table_insert (datastreams,
+          GUINT_TO_POINTER (flight_packet->stream_idx), file);
+    }
+
+    data = g_bytes_get_data (flight_packet->packet, &size);
+    fwrite (data, sizeof (gchar), size, file);
+  }
+
+  g_hash_table_unref (datastreams);
+  g_free (snapshot_dir);
 }
 
-void
-do_print_scheduling_event (event_id id, gchar * elementname, guint64 time)
+/* Take the requested snapshot, if any. Requests close to the previous
+ * snapshot are merged into the next one, which then covers the rest of
+ * the incident.
+ */
+static void
+ctf_flight_check_snapshot (gboolean force)
 {
-  GError *error;
-  guint8 *mem;
-  guint8 *event_mem;
-  gsize event_size;
+  gint64 now;
 
-  event_size = strlen (elementname) + 1 + sizeof (guint64) + CTF_HEADER_SIZE;
+  if (FALSE == ctf_descriptor->flight ||
+      !g_atomic_int_get (&ctf_snapshot_requested)) {
+    return;
+  }
 
-  if (event_exceeds_mem_size (event_size)) {
+  now = g_get_monotonic_time ();
+  if (!force && 0 != ctf_descriptor->snapshot_time &&
+      now - ctf_descriptor->snapshot_time < CTF_SNAPSHOT_INTERVAL) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
+  g_atomic_int_set (&ctf_snapshot_requested, FALSE);
+  ctf_descriptor->snapshot_time = now;
+  ctf_flight_snapshot ();
+}
 
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-  /* Add event payload */
-  /* Write element name */
-  CTF_EVENT_WRITE_STRING (elementname, event_mem);
-  /* Write time */
-  CTF_EVENT_WRITE_INT64 (time, event_mem);
+static void
+ctf_ring_write_file (GstCtfRing * ring, const guint8 * packet, gsize size)
+{
+#ifdef HAVE_SYS_MMAN_H
+  if (ring->mapped.fd >= 0 &&
+      ctf_mapped_file_write (&ring->mapped, packet, size)) {
+    ring->file_size += size;
+  }
+#endif
+  if (NULL != ring->datastream) {
+    fwrite (packet, sizeof (gchar), size, ring->datastream);
+    ring->file_size += size;
+  }
+}
 
+static void
+ctf_write_datastream (GstCtfRing * ring, const guint8 * packet, gsize size,
+    gboolean names)
+{
   if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
+    ctf_ring_write_file (ring, packet, size);
+  }
+
+  if (ctf_descriptor->flight) {
+    ctf_flight_push (ring, packet, size);
   }
 
   if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
+    /* A CTF stream has to be monotonic, packets of different streams are
+       interleaved on the connection but tagged with their stream */
+    ctf_tcp_send_datastream (ring->stream_idx, packet, size, names);
+  }
+}
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+/* Skip the wrap mark, if any, and return the next record of the ring or
+ * NULL if there is nothing left up to the given head.
+ */
+static guint8 *
+ctf_ring_peek (GstCtfRing * ring, gint head)
+{
+  if (ring->tail == head) {
+    return NULL;
   }
 
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  if (CTF_RECORD_WRAP == *(ctf_record_length *) (ring->mem + ring->tail)) {
+    g_atomic_int_set (&ring->tail, 0);
+    if (ring->tail == head) {
+      return NULL;
+    }
+  }
+
+  return ring->mem + ring->tail;
 }
 
-void
-do_print_queue_level_event (event_id id, const gchar * elementname,
-    guint32 bytes, guint32 max_bytes, guint32 buffers, guint32 max_buffers,
-    guint64 time, guint64 max_time)
+/* Rebuild the full timestamp of the next record the same way readers do */
+static guint64
+ctf_ring_record_timestamp (GstCtfRing * ring, guint8 * record)
 {
-  GError *error;
-  guint8 *mem;
+  guint8 *header;
+  guint64 timestamp;
+
+  header = record + CTF_RECORD_HEADER_SIZE;
+
+  if (CTF_EXTENDED_ID == CTF_EVENT_READ (16, header)) {
+    timestamp = CTF_EVENT_READ (64, header + sizeof (guint16) +
+        sizeof (guint32));
+  } else {
+    timestamp = ring->flush_timestamp & G_GUINT64_CONSTANT (0xFFFFFFFF00000000);
+    timestamp |= CTF_EVENT_READ (32, header + sizeof (guint16));
+    if (timestamp < ring->flush_timestamp) {
+      timestamp += G_GUINT64_CONSTANT (0x100000000);
+    }
+  }
+
+  ring->flush_timestamp = timestamp;
+
+  return timestamp;
+}
+
+static gboolean
+ctf_record_is_name (guint8 * record)
+{
+  guint8 *header;
+  guint32 id;
+
+  header = record + CTF_RECORD_HEADER_SIZE;
+
+  id = CTF_EVENT_READ (16, header);
+  if (CTF_EXTENDED_ID == id) {
+    id = CTF_EVENT_READ (32, header + sizeof (guint16));
+  }
+
+  return NAME_EVENT_ID == id;
+}
+
+/* Encode the whole name table as packets of the given stream instance,
+ * built in the descriptor memory, and hand them to write_packet. The
+ * packets carry the events discarded so far by the stream, as any other
+ * packet of it.
+ */
+static void
+ctf_write_name_table (guint64 timestamp, guint32 stream_instance_id,
+    guint32 events_discarded, ctf_packet_write_func write_packet,
+    gpointer user_data)
+{
+  GHashTableIter iter;
+  gpointer name;
+  gpointer name_id;
+  guint8 *packet;
   guint8 *event_mem;
   gsize event_size;
+  gsize used;
+
+  packet = ctf_descriptor->mem + TCP_HEADER_SIZE;
+  used = CTF_PACKET_HEADER_SIZE;
+
+  g_mutex_lock (&ctf_names_mutex);
+
+  g_hash_table_iter_init (&iter, ctf_descriptor->names);
+  while (g_hash_table_iter_next (&iter, &name, &name_id)) {
+    event_size = CTF_EXTENDED_HEADER_SIZE + sizeof (guint32) +
+        strlen (name) + 1;
+    if (used + event_size > CTF_AVAILABLE_MEM_SIZE) {
+      ctf_write_packet_header (packet, timestamp, timestamp, used,
+          events_discarded, stream_instance_id);
+      write_packet (packet, used, user_data);
+      used = CTF_PACKET_HEADER_SIZE;
+    }
 
-  event_size =
-      strlen (elementname) + 1 + 4 * sizeof (guint32) + 2 * sizeof (guint64) +
-      CTF_HEADER_SIZE;
+    event_mem = packet + used;
+    CTF_EVENT_WRITE_INT16 (CTF_EXTENDED_ID, event_mem);
+    CTF_EVENT_WRITE_INT32 (NAME_EVENT_ID, event_mem);
+    CTF_EVENT_WRITE_INT64 (timestamp, event_mem);
+    CTF_EVENT_WRITE_INT32 (GPOINTER_TO_UINT (name_id), event_mem);
+    CTF_EVENT_WRITE_STRING (name, event_mem);
+    used += event_size;
+  }
 
-  if (event_exceeds_mem_size (event_size)) {
-    return;
+  g_mutex_unlock (&ctf_names_mutex);
+
+  if (used > CTF_PACKET_HEADER_SIZE) {
+    ctf_write_packet_header (packet, timestamp, timestamp, used,
+        events_discarded, stream_instance_id);
+    write_packet (packet, used, user_data);
   }
+}
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
+static void
+ctf_tcp_write_name_packet (const guint8 * packet, gsize size,
+    gpointer user_data)
+{
+  ctf_tcp_send_datastream (ctf_descriptor->tcp_names_stream, packet, size,
+      TRUE);
+}
+
+/* Send the whole name table again if the collector may have missed part
+ * of it. Must be called with the descriptor mutex held.
+ */
+static void
+ctf_tcp_send_name_table (void)
+{
+  gboolean names_lost;
+
+  g_mutex_lock (&ctf_descriptor->sender_mutex);
+  names_lost = ctf_descriptor->tcp_names_lost;
+  ctf_descriptor->tcp_names_lost = FALSE;
+  g_mutex_unlock (&ctf_descriptor->sender_mutex);
+
+  if (names_lost) {
+    ctf_write_name_table (CTF_TIMESTAMP (), ctf_descriptor->tcp_names_stream,
+        0, ctf_tcp_write_name_packet, NULL);
+  }
+}
+
+static void
+ctf_ring_write_name_packet (const guint8 * packet, gsize size,
+    gpointer user_data)
+{
+  ctf_ring_write_file ((GstCtfRing *) user_data, packet, size);
+}
+
+/* Write the name table at the current position of the ring datastream file,
+ * keeping the stream timestamps monotonic.
+ */
+static void
+ctf_ring_write_name_table (GstCtfRing * ring)
+{
+  ctf_write_name_table (ring->flush_timestamp, ring->stream_idx,
+      ring->dropped_reported, ctf_ring_write_name_packet, ring);
+}
+
+/* Maximum size of the next packet of the ring, given the size of its
+ * first event. Starts a new datastream file when the current one can not
+ * take it without exceeding the maximum file size.
+ */
+static gsize
+ctf_ring_packet_limit (GstCtfRing * ring, gsize length)
+{
+  gsize max_file_size;
+  gsize limit;
+
+  max_file_size = ctf_descriptor->max_file_size;
+  if (0 == max_file_size || ctf_descriptor->file_output_disable) {
+    return CTF_AVAILABLE_MEM_SIZE;
+  }
+
+  if (ctf_ring_datastream_is_open (ring) && 0 != ring->file_size &&
+      ring->file_size + CTF_PACKET_HEADER_SIZE + length > max_file_size) {
+    ctf_ring_close_datastream (ring);
+  }
+  if (!ctf_ring_datastream_is_open (ring)) {
+    ctf_ring_open_datastream (ring);
+  }
+
+  /* A packet always takes at least one event */
+  limit = CTF_PACKET_HEADER_SIZE + length;
+  if (ring->file_size + limit < max_file_size) {
+    limit = max_file_size - ring->file_size;
+  }
+
+  return MIN (limit, CTF_AVAILABLE_MEM_SIZE);
+}
+
+/* Write the pending events of a ring as one or more packets of its stream */
+static void
+ctf_flush_ring (GstCtfRing * ring)
+{
+  ctf_record_length length;
+  guint8 *packet;
+  guint8 *record;
+  guint64 timestamp_begin;
+  guint64 timestamp_end;
+  gboolean names;
+  gsize limit;
+  gsize used;
+  gint dropped;
+  gint head;
+
+  dropped = g_atomic_int_get (&ring->dropped);
+  if (dropped != ring->dropped_reported) {
+    GST_WARNING ("Event ring of stream %u full, %d events dropped",
+        ring->stream_idx, dropped - ring->dropped_reported);
+    ring->dropped_reported = dropped;
+  }
+
+  head = g_atomic_int_get (&ring->head);
+  record = ctf_ring_peek (ring, head);
+
+  while (NULL != record) {
+    limit = ctf_ring_packet_limit (ring, *(ctf_record_length *) record);
+    packet = ctf_ring_packet_begin (ring);
+    used = CTF_PACKET_HEADER_SIZE;
+    timestamp_begin = ring->flush_timestamp;
+    timestamp_end = timestamp_begin;
+    names = FALSE;
+
+    do {
+      length = *(ctf_record_length *) record;
+      if (used + length > limit) {
+        break;
+      }
+
+      timestamp_end = ctf_ring_record_timestamp (ring, record);
+      if (CTF_PACKET_HEADER_SIZE == used) {
+        timestamp_begin = timestamp_end;
+      }
+      names |= ctf_record_is_name (record);
+      memcpy (packet + used, record + CTF_RECORD_HEADER_SIZE, length);
+      used += length;
+
+      /* Hand the space back to the producer */
+      g_atomic_int_set (&ring->tail, ring->tail + CTF_RECORD_SIZE (length));
+      record = ctf_ring_peek (ring, head);
+    } while (NULL != record);
+
+    ctf_write_packet_header (packet, timestamp_begin, timestamp_end, used,
+        dropped, ring->stream_idx);
+    ctf_write_datastream (ring, packet, used, names);
+  }
+}
+
+/* Drain every ring into the outputs */
+static void
+ctf_flush_rings (void)
+{
+  GList *ring_list;
+  GList *node;
+
+  g_mutex_lock (&ctf_rings_mutex);
+  ring_list = g_list_copy (ctf_descriptor->rings);
+  g_mutex_unlock (&ctf_rings_mutex);
 
-  /* Lock mem and datastream and output_stream resources */
   g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-  /* Add event payload */
-  /* Write element name */
-  CTF_EVENT_WRITE_STRING (elementname, event_mem);
+  for (node = ring_list; NULL != node; node = g_list_next (node)) {
+    ctf_flush_ring ((GstCtfRing *) node->data);
+  }
+  if (FALSE == ctf_descriptor->tcp_output_disable) {
+    ctf_tcp_send_name_table ();
+  }
+  g_mutex_unlock (&ctf_descriptor->mutex);
 
-  /* Write bytes */
-  CTF_EVENT_WRITE_INT32 (bytes, event_mem);
+  /* Release the rings of the threads that are gone */
+  g_mutex_lock (&ctf_rings_mutex);
+  for (node = ring_list; NULL != node; node = g_list_next (node)) {
+    GstCtfRing *ring = (GstCtfRing *) node->data;
 
-  /* Write bytes */
-  CTF_EVENT_WRITE_INT32 (max_bytes, event_mem);
+    if (g_atomic_int_get (&ring->orphaned) &&
+        ring->tail == g_atomic_int_get (&ring->head)) {
+      ctf_descriptor->rings = g_list_remove (ctf_descriptor->rings, ring);
+      ctf_ring_finish_datastream (ring);
+      g_free (ring);
+    }
+  }
+  g_mutex_unlock (&ctf_rings_mutex);
 
-  /* Write buffers */
-  CTF_EVENT_WRITE_INT32 (buffers, event_mem);
+  g_list_free (ring_list);
+}
 
-  /* Write buffers */
-  CTF_EVENT_WRITE_INT32 (max_buffers, event_mem);
+static gpointer
+ctf_writer_thread (gpointer data)
+{
+  gint64 end_time;
+
+  g_mutex_lock (&ctf_descriptor->writer_mutex);
+  while (ctf_descriptor->writer_running) {
+    end_time = g_get_monotonic_time () + CTF_FLUSH_INTERVAL;
+    g_cond_wait_until (&ctf_descriptor->writer_cond,
+        &ctf_descriptor->writer_mutex, end_time);
+
+    g_mutex_unlock (&ctf_descriptor->writer_mutex);
+    ctf_flush_rings ();
+    ctf_flight_check_snapshot (FALSE);
+    g_mutex_lock (&ctf_descriptor->writer_mutex);
+  }
+  g_mutex_unlock (&ctf_descriptor->writer_mutex);
 
-  /* Write time */
-  CTF_EVENT_WRITE_INT64 (time, event_mem);
+  /* Write whatever was produced before closing */
+  ctf_flush_rings ();
+  ctf_flight_check_snapshot (TRUE);
 
-  /* Write time */
-  CTF_EVENT_WRITE_INT64 (max_time, event_mem);
+  return NULL;
+}
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
+static void
+ctf_writer_init (void)
+{
+  g_mutex_init (&ctf_descriptor->writer_mutex);
+  g_cond_init (&ctf_descriptor->writer_cond);
+
+  ctf_descriptor->writer_running = TRUE;
+  ctf_descriptor->writer =
+      g_thread_new ("GstSharkCtfWriter", ctf_writer_thread, NULL);
+}
+
+static void
+ctf_writer_close (void)
+{
+  GList *node;
+
+  g_mutex_lock (&ctf_descriptor->writer_mutex);
+  ctf_descriptor->writer_running = FALSE;
+  g_cond_signal (&ctf_descriptor->writer_cond);
+  g_mutex_unlock (&ctf_descriptor->writer_mutex);
+
+  g_thread_join (ctf_descriptor->writer);
+  ctf_descriptor->writer = NULL;
+
+  g_cond_clear (&ctf_descriptor->writer_cond);
+  g_mutex_clear (&ctf_descriptor->writer_mutex);
+
+  /* Rings still owned by a live thread are released by that thread */
+  g_mutex_lock (&ctf_rings_mutex);
+  for (node = ctf_descriptor->rings; NULL != node; node = g_list_next (node)) {
+    GstCtfRing *ring = (GstCtfRing *) node->data;
+
+    ctf_ring_finish_datastream (ring);
+    if (g_atomic_int_get (&ring->orphaned)) {
+      g_free (ring);
+    } else {
+      ring->detached = TRUE;
+    }
+  }
+  g_list_free (ctf_descriptor->rings);
+  ctf_descriptor->rings = NULL;
+  g_mutex_unlock (&ctf_rings_mutex);
+}
+
+/* *INDENT-OFF* */
+/* Metadata of the events in the schema table, indexed by event ID */
+#define GST_CTF_METADATA_uint32 \
+  "integer { size = 32; align = 8; signed = 0; encoding = none; base = 10; }"
+#define GST_CTF_METADATA_uint64 \
+  "integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; }"
+#define GST_CTF_METADATA_string "string"
+
+#define GST_CTF_FIELD_METADATA(type, field) \
+  "        " GST_CTF_METADATA_##type " " #field ";\n"
+
+#define GST_CTF_EVENT_METADATA_CUSTOM(name, FIELDS) NULL
+#define GST_CTF_EVENT_METADATA_GENERATED(name, FIELDS) \
+  "event {\n"                                          \
+  "    name = " #name ";\n"                            \
+  "    id = %d;\n"                                     \
+  "    stream_id = %d;\n"                              \
+  "    fields := struct {\n"                           \
+  FIELDS (GST_CTF_FIELD_METADATA)                      \
+  "    };\n"                                           \
+  "};\n"                                               \
+  "\n"
+#define GST_CTF_EVENT_METADATA(name, id, kind, FIELDS) \
+  GST_CTF_EVENT_METADATA_##kind (name, FIELDS),
+
+static const gchar *ctf_event_metadata[] = {
+  GST_CTF_EVENTS (GST_CTF_EVENT_METADATA)
+};
+
+/* Encoders of the events in the schema table */
+#define GST_CTF_SIZE_uint32(field) sizeof (guint32)
+#define GST_CTF_SIZE_uint64(field) sizeof (guint64)
+#define GST_CTF_SIZE_string(field) (strlen (field) + 1)
+#define GST_CTF_FIELD_SIZE(type, field) + GST_CTF_SIZE_##type (field)
+
+#define GST_CTF_WRITE_uint32(field,mem) CTF_EVENT_WRITE_INT32 (field, mem)
+#define GST_CTF_WRITE_uint64(field,mem) CTF_EVENT_WRITE_INT64 (field, mem)
+#define GST_CTF_WRITE_string(field,mem) CTF_EVENT_WRITE_STRING (field, mem)
+#define GST_CTF_FIELD_WRITE(type, field) GST_CTF_WRITE_##type (field, event_mem);
+
+#define GST_CTF_EVENT_ENCODER_CUSTOM(name, id, FIELDS)
+#define GST_CTF_EVENT_ENCODER_GENERATED(name, id, FIELDS)             \
+void                                                                  \
+do_print_##name##_event (GST_CTF_PARAMS (FIELDS))                     \
+{                                                                     \
+  GstCtfRing *ring;                                                   \
+  guint8 *event_mem;                                                  \
+                                                                      \
+  ring = ctf_ring_get ();                                             \
+  event_mem = ctf_ring_reserve (ring, id, 0 FIELDS (GST_CTF_FIELD_SIZE)); \
+  if (NULL == event_mem) {                                            \
+    return;                                                           \
+  }                                                                   \
+                                                                      \
+  FIELDS (GST_CTF_FIELD_WRITE)                                        \
+                                                                      \
+  ctf_ring_commit (ring);                                             \
+}
+#define GST_CTF_EVENT_ENCODER(name, id, kind, FIELDS) \
+  GST_CTF_EVENT_ENCODER_##kind (name, id, FIELDS)
+
+GST_CTF_EVENTS (GST_CTF_EVENT_ENCODER)
+/* *INDENT-ON* */
+
+void
+gst_ctf_add_event_metadata (event_id id)
+{
+  gchar *metadata_event;
+
+  g_return_if_fail (id < G_N_ELEMENTS (ctf_event_metadata));
+  g_return_if_fail (NULL != ctf_event_metadata[id]);
+
+  metadata_event = g_strdup_printf (ctf_event_metadata[id], id, 0);
+  add_metadata_event_struct (metadata_event);
+  g_free (metadata_event);
+}
+
+#ifdef G_OS_UNIX
+static void
+ctf_sigusr1_handler (int signum)
+{
+  /* The writer thread polls the request */
+  g_atomic_int_set (&ctf_snapshot_requested, TRUE);
+}
+#endif
+
+gboolean
+gst_ctf_init (void)
+{
+  if (ctf_descriptor) {
+    GST_ERROR ("CTF Descriptor already exists.");
+    return FALSE;
   }
 
+  /* Since the descriptors structure does not exist it is needed to
+     create and initialize a new one. */
+  ctf_descriptor = ctf_create_struct ();
+  /* Load and proccess enviroment variables */
+  ctf_process_env_var ();
+
+  ctf_file_init ();
+  ctf_tcp_init ();
+
+  generate_metadata (1, 3, BYTE_ORDER_LE);
+
+  /* Element and pad names are written once in the name table, the rest of
+     the events refer to them by their ID */
+  gst_ctf_add_event_metadata (NAME_EVENT_ID);
   if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
+    gst_ctf_add_event_metadata (TCP_DROPPED_EVENT_ID);
+  }
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+  ctf_name_id_quark = g_quark_from_static_string ("GstSharkCtfNameId");
+
+#ifdef G_OS_UNIX
+  if (ctf_descriptor->flight) {
+    struct sigaction action;
+
+    /* SIGUSR1 requests a snapshot of the flight recorder */
+    memset (&action, 0, sizeof (action));
+    action.sa_handler = ctf_sigusr1_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset (&action.sa_mask);
+    sigaction (SIGUSR1, &action, &ctf_old_sigusr1);
   }
+#endif
 
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  /* Event timestamps are relative to this time, for any output */
+  ctf_descriptor->start_time = gst_util_get_timestamp ();
+  ctf_writer_init ();
+  do_print_ctf_init (INIT_EVENT_ID);
+
+
+  return TRUE;
+}
+
+gboolean
+gst_ctf_flight_recorder_enabled (void)
+{
+  return NULL != ctf_descriptor && ctf_descriptor->flight;
 }
 
 void
-do_print_bitrate_event (event_id id, gchar * elementname, guint64 bps)
+gst_ctf_snapshot (void)
 {
-  GError *error;
-  guint8 *mem;
-  guint8 *event_mem;
-  gsize event_size;
+  if (!gst_ctf_flight_recorder_enabled ()) {
+    return;
+  }
+
+  /* Wake up the writer only for the first of a burst of requests */
+  if (g_atomic_int_compare_and_exchange (&ctf_snapshot_requested, FALSE,
+          TRUE)) {
+    g_mutex_lock (&ctf_descriptor->writer_mutex);
+    g_cond_signal (&ctf_descriptor->writer_cond);
+    g_mutex_unlock (&ctf_descriptor->writer_mutex);
+  }
+}
 
-  event_size = strlen (elementname) + 1 + sizeof (bps) + CTF_HEADER_SIZE;
+void
+gst_ctf_snapshot_on_threshold (event_id id, GstClockTime value)
+{
+  GstClockTime threshold;
 
-  if (event_exceeds_mem_size (event_size)) {
+  if (G_LIKELY (!gst_ctf_flight_recorder_enabled ())) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
+  switch (id) {
+    case PROCTIME_EVENT_ID:
+      threshold = ctf_descriptor->snapshot_proctime;
+      break;
+    case INTERLATENCY_EVENT_ID:
+      threshold = ctf_descriptor->snapshot_interlatency;
+      break;
+    default:
+      return;
+  }
 
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-  /* Write element name */
-  CTF_EVENT_WRITE_STRING (elementname, event_mem);
-  /* Write bitrate */
-  CTF_EVENT_WRITE_INT64 (bps, event_mem);
+  if (0 != threshold && value > threshold) {
+    GST_INFO ("Value %" GST_TIME_FORMAT " over the snapshot threshold",
+        GST_TIME_ARGS (value));
+    gst_ctf_snapshot ();
+  }
+}
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
+/* Returns the ID of the name, adding it to the name table the first time
+ * it is seen. Returns 0 if the name could not be defined because the ring
+ * of the thread is full, in which case the caller should not keep the ID.
+ */
+guint32
+gst_ctf_intern_string (const gchar * name)
+{
+  GstCtfRing *ring;
+  gpointer value;
+  guint8 *event_mem;
+  guint32 name_id;
+
+  g_return_val_if_fail (name, 0);
+
+  ring = ctf_ring_get ();
+
+  /* The name only becomes known once its name table event is committed.
+     Holding the lock until then keeps other threads from using the ID
+     before its definition, and a name whose event did not fit in the ring
+     is defined again the next time it is used. */
+  g_mutex_lock (&ctf_names_mutex);
+  value = g_hash_table_lookup (ctf_descriptor->names, name);
+  if (NULL != value) {
+    name_id = GPOINTER_TO_UINT (value);
+    goto out;
   }
 
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
+  event_mem = ctf_ring_reserve (ring, NAME_EVENT_ID,
+      sizeof (guint32) + strlen (name) + 1);
+  if (NULL == event_mem) {
+    name_id = 0;
+    goto out;
+  }
+
+  name_id = ++ctf_descriptor->name_count;
+  CTF_EVENT_WRITE_INT32 (name_id, event_mem);
+  CTF_EVENT_WRITE_STRING (name, event_mem);
+  ctf_ring_commit (ring);
+
+  g_hash_table_insert (ctf_descriptor->names, g_strdup (name),
+      GUINT_TO_POINTER (name_id));
+
+out:
+  g_mutex_unlock (&ctf_names_mutex);
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+  return name_id;
+}
+
+guint32
+gst_ctf_element_name_id (GstElement * element)
+{
+  guint32 name_id;
+
+  g_return_val_if_fail (element, 0);
+
+  name_id =
+      GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (element),
+          ctf_name_id_quark));
+  if (G_UNLIKELY (0 == name_id)) {
+    name_id = gst_ctf_intern_string (GST_OBJECT_NAME (element));
+    g_object_set_qdata (G_OBJECT (element), ctf_name_id_quark,
+        GUINT_TO_POINTER (name_id));
   }
 
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  return name_id;
+}
+
+guint32
+gst_ctf_pad_name_id (GstPad * pad)
+{
+  gchar *name;
+  guint32 name_id;
+
+  g_return_val_if_fail (pad, 0);
+
+  name_id =
+      GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (pad),
+          ctf_name_id_quark));
+  if (G_UNLIKELY (0 == name_id)) {
+    /* Pads are named as elementName_padName */
+    name = g_strdup_printf ("%s_%s", GST_DEBUG_PAD_NAME (pad));
+    name_id = gst_ctf_intern_string (name);
+    g_free (name);
+    g_object_set_qdata (G_OBJECT (pad), ctf_name_id_quark,
+        GUINT_TO_POINTER (name_id));
+  }
+
+  return name_id;
 }
 
 void
-do_print_buffer_event (event_id id, const gchar * pad, GstClockTime pts,
-    GstClockTime dts, GstClockTime duration, guint64 offset,
-    guint64 offset_end, guint64 size, GstBufferFlags flags, guint32 refcount)
+add_metadata_event_struct (const gchar * metadata_event)
 {
-  GError *error;
+  gchar *event_mem;
+  guint event_size;
   guint8 *mem;
-  guint8 *event_mem;
-  gsize event_size;
 
-  event_size =
-      strlen (pad) + 1 + 6 * sizeof (guint64) + 2 * sizeof (guint32) +
-      CTF_HEADER_SIZE;
+  event_size = strlen (metadata_event);
 
   if (event_exceeds_mem_size (event_size)) {
     return;
   }
 
   mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
+  event_mem = (gchar *) mem + TCP_HEADER_SIZE;
 
-  /* Lock mem and datastream and output_stream resources */
+  /* This function only writes the event structure to the metadata file, it
+     depends entirely of what is passed as an argument. */
   g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-
-  /* Write event specific fields */
-  CTF_EVENT_WRITE_STRING (pad, event_mem);
-  CTF_EVENT_WRITE_INT64 (pts, event_mem);
-  CTF_EVENT_WRITE_INT64 (dts, event_mem);
-  CTF_EVENT_WRITE_INT64 (duration, event_mem);
-  CTF_EVENT_WRITE_INT64 (offset, event_mem);
-  CTF_EVENT_WRITE_INT64 (offset_end, event_mem);
-  CTF_EVENT_WRITE_INT64 (size, event_mem);
-  CTF_EVENT_WRITE_INT32 (flags, event_mem);
-  CTF_EVENT_WRITE_INT32 (refcount, event_mem);
+
+  memcpy (event_mem, metadata_event, event_size);
 
   if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem -= event_size;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
+    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->metadata);
   }
-
   if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
-
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+    ctf_tcp_send_metadata (event_mem, event_size);
+  }
+  if (ctf_descriptor->flight) {
+    g_string_append_len (ctf_descriptor->flight_metadata, event_mem,
+        event_size);
   }
-
   g_mutex_unlock (&ctf_descriptor->mutex);
 }
 
+
 void
-do_print_ctf_init (event_id id)
+do_print_cpuusage_event (event_id id, guint32 cpu_num, gfloat * cpuload)
 {
-  GError *error;
-  guint32 unknown = 0;
-  guint8 *mem;
+  GstCtfRing *ring;
   guint8 *event_mem;
   gsize event_size;
+  gint cpu_idx;
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
-
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-  /* Write padding */
-  CTF_EVENT_WRITE_INT32 (unknown, event_mem);
+  event_size = cpu_num * sizeof (gfloat);
 
-  /* Computer event size */
-  event_size = event_mem - (mem + TCP_HEADER_SIZE);
+  ring = ctf_ring_get ();
+  event_mem = ctf_ring_reserve (ring, id, event_size);
+  if (NULL == event_mem) {
+    return;
+  }
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
+  /* Write CPU load for each CPU */
+  for (cpu_idx = 0; cpu_idx < cpu_num; ++cpu_idx) {
+    /* Write CPU load */
+    CTF_EVENT_WRITE_FLOAT (cpuload[cpu_idx], event_mem);
   }
 
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
+  ctf_ring_commit (ring);
+}
+
+void
+do_print_ctf_init (event_id id)
+{
+  GstCtfRing *ring;
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+  /* The init event only has a header */
+  ring = ctf_ring_get ();
+  if (NULL == ctf_ring_reserve (ring, id, 0)) {
+    return;
   }
 
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  ctf_ring_commit (ring);
 }
 
 void
 gst_ctf_close (void)
 {
-  GError *error;
-  gboolean res;
-  fclose (ctf_descriptor->metadata);
-  fclose (ctf_descriptor->datastream);
+  /* Write the pending events before releasing the outputs */
+  ctf_writer_close ();
+  ctf_tcp_close ();
+
+  if (ctf_descriptor->flight) {
+#ifdef G_OS_UNIX
+    sigaction (SIGUSR1, &ctf_old_sigusr1, NULL);
+#endif
+    g_queue_foreach (&ctf_descriptor->flight_packets,
+        (GFunc) ctf_flight_packet_free, NULL);
+    g_queue_clear (&ctf_descriptor->flight_packets);
+    g_string_free (ctf_descriptor->flight_metadata, TRUE);
+  }
+
+  if (NULL != ctf_descriptor->metadata) {
+    fclose (ctf_descriptor->metadata);
+  }
   g_mutex_clear (&ctf_descriptor->mutex);
 
   if (NULL != ctf_descriptor->dir_name) {
@@ -1187,17 +2643,7 @@ gst_ctf_close (void)
   if (NULL != ctf_descriptor->host_name) {
     g_free (ctf_descriptor->host_name);
   }
-  /* Closes the stream, releasing resources related to it. */
-  if (NULL != ctf_descriptor->output_stream) {
-    res = g_output_stream_close (ctf_descriptor->output_stream, NULL, &error);
-    if (FALSE == res) {
-      GST_ERROR ("Failed to close output stream");
-    }
-  }
-
-  if (NULL != ctf_descriptor->socket_client) {
-    g_object_unref (ctf_descriptor->socket_client);
-  }
-
+  g_hash_table_unref (ctf_descriptor->names);
   g_free (ctf_descriptor);
+  ctf_descriptor = NULL;
 }
@@ -22,38 +22,36 @@
 #define __GST_CTF_H__
 
 #include <gst/gst.h>
+#include "gstctfevents.h"
 G_BEGIN_DECLS typedef struct _GstCtfDescriptor GstCtfDescriptor;
 
+/* *INDENT-OFF* */
+#define GST_CTF_EVENT_ID(name, id, kind, FIELDS) id,
 typedef enum
 {
-  INIT_EVENT_ID,
-  CPUUSAGE_EVENT_ID,
-  PROCTIME_EVENT_ID,
-  INTERLATENCY_EVENT_ID,
-  FPS_EVENT_ID,
-  SCHED_TIME_EVENT_ID,
-  QUEUE_LEVEL_EVENT_ID,
-  BITRATE_EVENT_ID,
-  BUFFER_EVENT_ID,
+  GST_CTF_EVENTS (GST_CTF_EVENT_ID)
 } event_id;
 
+#define GST_CTF_EVENT_PROTOTYPE_CUSTOM(name, FIELDS)
+#define GST_CTF_EVENT_PROTOTYPE_GENERATED(name, FIELDS) \
+  void do_print_##name##_event (GST_CTF_PARAMS (FIELDS));
+#define GST_CTF_EVENT_PROTOTYPE(name, id, kind, FIELDS) \
+  GST_CTF_EVENT_PROTOTYPE_##kind (name, FIELDS)
+/* *INDENT-ON* */
+
 gchar *get_ctf_path_name (void);
 gboolean gst_ctf_init (void);
 void gst_ctf_close (void);
 void add_metadata_event_struct (const gchar * metadata_event);
+void gst_ctf_add_event_metadata (event_id id);
+guint32 gst_ctf_intern_string (const gchar * name);
+guint32 gst_ctf_element_name_id (GstElement * element);
+guint32 gst_ctf_pad_name_id (GstPad * pad);
+gboolean gst_ctf_flight_recorder_enabled (void);
+void gst_ctf_snapshot (void);
+void gst_ctf_snapshot_on_threshold (event_id id, GstClockTime value);
 void do_print_cpuusage_event (event_id id, guint32 cpunum, gfloat * cpuload);
-void do_print_proctime_event (event_id id, gchar * elementname, guint64 time);
-void do_print_framerate_event (event_id id, gchar * elementname, guint64 fps);
-void do_print_interlatency_event (event_id id,
-    char *originpad, gchar * destinationpad, guint64 time);
-void do_print_scheduling_event (event_id id, gchar * elementname, guint64 time);
-void do_print_queue_level_event (event_id id, const gchar * elementname, guint32 bytes,
-    guint32 max_bytes, guint32 buffers, guint32 max_buffers, guint64 time, guint64 max_time);
-void do_print_bitrate_event (event_id id, gchar * elementname, guint64 bps);
-void do_print_buffer_event (event_id id, const gchar * pad, GstClockTime pts,
-    GstClockTime dts, GstClockTime duration, guint64 offset,
-    guint64 offset_end, guint64 size, GstBufferFlags flags,
-    guint32 refcount);
+GST_CTF_EVENTS (GST_CTF_EVENT_PROTOTYPE)
 void do_print_ctf_init (event_id id);
 G_END_DECLS
 #endif /*__GST_CTF_H__*/
@@ -0,0 +1,183 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2016 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __GST_CTF_EVENTS_H__
+#define __GST_CTF_EVENTS_H__
+
+/* CTF event schema
+ *
+ * Every event is described once in GST_CTF_EVENTS as
+ *
+ *   EVENT (name, event_id, kind, FIELDS)
+ *
+ * where FIELDS is a macro listing the event fields as F (type, field) in
+ * the order they are written. The table generates the event_id enum, and
+ * for GENERATED events also the CTF metadata and the
+ * do_print_<name>_event encoder, taking one argument per field. CUSTOM
+ * events are described and written by hand.
+ *
+ * Supported field types are uint32, uint64 and string. Events without
+ * string fields have a size known at compile time.
+ *
+ * The position of an event in the table is its CTF ID, so new events
+ * have to be appended.
+ */
+
+/* *INDENT-OFF* */
+#define GST_CTF_NO_FIELDS(F)
+
+#define GST_CTF_PROCTIME_FIELDS(F) \
+  F (uint32, element)              \
+  F (uint64, _time)
+
+#define GST_CTF_INTERLATENCY_FIELDS(F) \
+  F (uint32, from_pad)                 \
+  F (uint32, to_pad)                   \
+  F (uint64, _time)
+
+#define GST_CTF_FRAMERATE_FIELDS(F) \
+  F (uint32, pad)                   \
+  F (uint64, _fps)
+
+#define GST_CTF_SCHEDULING_FIELDS(F) \
+  F (uint32, pad)                    \
+  F (uint64, _time)
+
+#define GST_CTF_QUEUELEVEL_FIELDS(F) \
+  F (uint32, queue)                  \
+  F (uint32, size_bytes)             \
+  F (uint32, max_size_bytes)         \
+  F (uint32, size_buffers)           \
+  F (uint32, max_size_buffers)       \
+  F (uint64, size_time)              \
+  F (uint64, max_size_time)
+
+#define GST_CTF_BITRATE_FIELDS(F) \
+  F (uint32, pad)                 \
+  F (uint64, _bps)
+
+#define GST_CTF_BUFFER_FIELDS(F) \
+  F (uint32, pad)                \
+  F (uint64, pts)                \
+  F (uint64, dts)                \
+  F (uint64, duration)           \
+  F (uint64, offset)             \
+  F (uint64, offset_end)         \
+  F (uint64, size)               \
+  F (uint32, flags)              \
+  F (uint32, refcount)
+
+#define GST_CTF_NAME_TABLE_FIELDS(F) \
+  F (uint32, name_id)                \
+  F (string, name)
+
+#define GST_CTF_TCP_DROPPED_FIELDS(F) \
+  F (uint64, packets)                 \
+  F (uint64, bytes)
+
+#define GST_CTF_PROCTIME_PADS_FIELDS(F) \
+  F (uint32, sink_pad)                  \
+  F (uint32, src_pad)                   \
+  F (uint64, _time)
+
+#define GST_CTF_PROCESS_CPUUSAGE_FIELDS(F) \
+  F (uint64, _time)                        \
+  F (uint64, _period)
+
+#define GST_CTF_THREAD_CPUUSAGE_FIELDS(F) \
+  F (uint32, thread)                      \
+  F (uint32, tid)                         \
+  F (uint64, _time)                       \
+  F (uint64, _period)
+
+#define GST_CTF_CPUTIME_FIELDS(F) \
+  F (uint32, element)             \
+  F (uint64, _time)               \
+  F (uint64, _cpu_time)
+
+#define GST_CTF_STACKPROFILE_FIELDS(F) \
+  F (uint32, element)                  \
+  F (uint32, tid)                      \
+  F (uint64, _delay)                   \
+  F (string, stack)
+
+#define GST_CTF_OFFCPU_FIELDS(F) \
+  F (uint32, src_pad)            \
+  F (uint32, sink_pad)           \
+  F (uint64, pushes)             \
+  F (uint64, _time)              \
+  F (uint64, _blocked)           \
+  F (uint64, switches)
+
+#define GST_CTF_AGGREGATE_FIELDS(F) \
+  F (uint32, series)                \
+  F (uint32, source)                \
+  F (uint32, target)                \
+  F (uint64, count)                 \
+  F (uint64, min)                   \
+  F (uint64, max)                   \
+  F (uint64, mean)                  \
+  F (uint64, p50)                   \
+  F (uint64, p90)                   \
+  F (uint64, p99)                   \
+  F (uint64, p999)
+
+#define GST_CTF_EVENTS(EVENT)                                                 \
+  EVENT (init, INIT_EVENT_ID, CUSTOM, GST_CTF_NO_FIELDS)                      \
+  EVENT (cpuusage, CPUUSAGE_EVENT_ID, CUSTOM, GST_CTF_NO_FIELDS)              \
+  EVENT (proctime, PROCTIME_EVENT_ID, GENERATED, GST_CTF_PROCTIME_FIELDS)     \
+  EVENT (interlatency, INTERLATENCY_EVENT_ID, GENERATED,                      \
+      GST_CTF_INTERLATENCY_FIELDS)                                            \
+  EVENT (framerate, FPS_EVENT_ID, GENERATED, GST_CTF_FRAMERATE_FIELDS)        \
+  EVENT (scheduling, SCHED_TIME_EVENT_ID, GENERATED,                          \
+      GST_CTF_SCHEDULING_FIELDS)                                              \
+  EVENT (queuelevel, QUEUE_LEVEL_EVENT_ID, GENERATED,                         \
+      GST_CTF_QUEUELEVEL_FIELDS)                                              \
+  EVENT (bitrate, BITRATE_EVENT_ID, GENERATED, GST_CTF_BITRATE_FIELDS)        \
+  EVENT (buffer, BUFFER_EVENT_ID, GENERATED, GST_CTF_BUFFER_FIELDS)           \
+  EVENT (name_table, NAME_EVENT_ID, GENERATED, GST_CTF_NAME_TABLE_FIELDS)     \
+  EVENT (tcp_dropped, TCP_DROPPED_EVENT_ID, GENERATED,                        \
+      GST_CTF_TCP_DROPPED_FIELDS)                                             \
+  EVENT (proctime_pads, PROCTIME_PADS_EVENT_ID, GENERATED,                    \
+      GST_CTF_PROCTIME_PADS_FIELDS)                                           \
+  EVENT (process_cpuusage, PROCESS_CPUUSAGE_EVENT_ID, GENERATED,              \
+      GST_CTF_PROCESS_CPUUSAGE_FIELDS)                                        \
+  EVENT (thread_cpuusage, THREAD_CPUUSAGE_EVENT_ID, GENERATED,                \
+      GST_CTF_THREAD_CPUUSAGE_FIELDS)                                         \
+  EVENT (cputime, CPUTIME_EVENT_ID, GENERATED, GST_CTF_CPUTIME_FIELDS)        \
+  EVENT (stackprofile, STACKPROFILE_EVENT_ID, GENERATED,                      \
+      GST_CTF_STACKPROFILE_FIELDS)                                            \
+  EVENT (offcpu, OFFCPU_EVENT_ID, GENERATED, GST_CTF_OFFCPU_FIELDS)          \
+  EVENT (aggregate, AGGREGATE_EVENT_ID, GENERATED, GST_CTF_AGGREGATE_FIELDS)
+
+/* C type of every field type */
+#define GST_CTF_TYPE_uint32 guint32
+#define GST_CTF_TYPE_uint64 guint64
+#define GST_CTF_TYPE_string const gchar *
+
+/* Encoder parameter list, the leading comma of the list is dropped */
+#define GST_CTF_PARAM(type, field) , GST_CTF_TYPE_##type field
+#define GST_CTF_DROP_FIRST(first, ...) __VA_ARGS__
+#define GST_CTF_DROP_FIRST_EXPANDED(list) GST_CTF_DROP_FIRST (list)
+#define GST_CTF_PARAMS(FIELDS) \
+  GST_CTF_DROP_FIRST_EXPANDED (FIELDS (GST_CTF_PARAM))
+/* *INDENT-ON* */
+
+#endif /*__GST_CTF_EVENTS_H__*/
@@ -39,9 +39,9 @@ struct _GstFramerateTracer
 {
   GstPeriodicTracer parent;
 
-  GHashTable *frame_counters;
-  guint callback_id;
-  guint pipes_running;
+  /* Counters of every pad seen, each pad also points to its own */
+  GPtrArray *frame_counters;
+  GQuark counter_quark;
 };
 
 #define _do_init \
@@ -58,7 +58,7 @@ static gboolean print_framerate (GstPeriodicTracer * tracer);
 static void reset_counters (GstPeriodicTracer * tracer);
 static void consider_frames (GstFramerateTracer * self, GstPad * pad,
     guint amount);
-static void destroy_hashtable_value (gpointer data);
+static void free_counter (gpointer data);
 static void pad_push_buffer_pre (GstFramerateTracer * self, guint64 ts,
     GstPad * pad, GstBuffer * buffer);
 static void pad_push_list_pre (GstFramerateTracer * self, GstClockTime ts,
@@ -67,24 +67,16 @@ static void pad_pull_range_pre (GstFramerateTracer * self, GstClockTime ts,
     GstPad * pad, guint64 offset, guint size);
 static void gst_framerate_tracer_finalize (GObject * obj);
 
-typedef struct _GstFramerateHash GstFramerateHash;
+typedef struct _GstFramerateCounter GstFramerateCounter;
 
-struct _GstFramerateHash
+struct _GstFramerateCounter
 {
   gchar *fullname;
+  guint32 name_id;
   guint counter;
 };
 
-static const gchar framerate_metadata_event[] = "event {\n\
-    name = framerate;\n\
-    id = %d;\n\
-    stream_id = %d;\n\
-    fields := struct {\n\
-        string pad;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _fps;\n\
-    };\n\
-};\n\
-\n";
+static volatile gint framerate_instances = 0;
 
 static void
 gst_framerate_tracer_class_init (GstFramerateTracerClass * klass)
@@ -115,10 +107,15 @@ static void
 gst_framerate_tracer_init (GstFramerateTracer * self)
 {
   GstSharkTracer *stracer = GST_SHARK_TRACER (self);
+  gchar *quark_name;
 
-  self->frame_counters =
-      g_hash_table_new_full (g_direct_hash, g_direct_equal,
-      gst_object_unref, destroy_hashtable_value);
+  self->frame_counters = g_ptr_array_new_with_free_func (free_counter);
+
+  /* Every instance keeps its own counter in the pads */
+  quark_name = g_strdup_printf ("GstSharkFramerate%d",
+      g_atomic_int_add (&framerate_instances, 1));
+  self->counter_quark = g_quark_from_string (quark_name);
+  g_free (quark_name);
 
   gst_shark_tracer_register_hook (stracer, "pad-push-pre",
       G_CALLBACK (pad_push_buffer_pre));
@@ -132,20 +129,17 @@ static void
 reset_counters (GstPeriodicTracer * tracer)
 {
   GstFramerateTracer *self;
-  GHashTableIter iter;
-  gpointer key, value;
-  GstFramerateHash *pad_table;
+  GstFramerateCounter *pad_table;
+  guint i;
 
   g_return_if_fail (tracer);
 
   self = GST_FRAMERATE_TRACER (tracer);
 
   GST_OBJECT_LOCK (self);
-  g_hash_table_iter_init (&iter, self->frame_counters);
-
-  while (g_hash_table_iter_next (&iter, &key, &value)) {
-    pad_table = (GstFramerateHash *) value;
-    pad_table->counter = 0;
+  for (i = 0; i < self->frame_counters->len; i++) {
+    pad_table = g_ptr_array_index (self->frame_counters, i);
+    GST_PERIODIC_COUNTER_TAKE (pad_table->counter);
   }
   GST_OBJECT_UNLOCK (self);
 }
@@ -153,39 +147,41 @@ reset_counters (GstPeriodicTracer * tracer)
 static void
 create_metadata_event (GstPeriodicTracer * tracer)
 {
-  gchar *metadata_event;
-
-  metadata_event = g_strdup_printf (framerate_metadata_event, FPS_EVENT_ID, 0);
-
   /* Add event in metadata file */
-  add_metadata_event_struct (metadata_event);
-  g_free (metadata_event);
+  gst_ctf_add_event_metadata (FPS_EVENT_ID);
 }
 
 static gboolean
 print_framerate (GstPeriodicTracer * tracer)
 {
   GstFramerateTracer *self;
-  GHashTableIter iter;
-  gpointer key, value;
-  GstFramerateHash *pad_table;
+  GstFramerateCounter *pad_table;
+  GstClockTime period;
+  guint counter;
+  guint fps;
+  guint i;
 
   self = GST_FRAMERATE_TRACER (tracer);
+  period = gst_periodic_tracer_get_period (tracer);
 
   /* Lock the tracer to make sure no new pad is added while we are logging */
   GST_OBJECT_LOCK (self);
 
-  /* Using the iterator functions to go through the Hash table and print the framerate 
-     of every element stored */
-  g_hash_table_iter_init (&iter, self->frame_counters);
-  while (g_hash_table_iter_next (&iter, &key, &value)) {
-    pad_table = (GstFramerateHash *) value;
-
-    gst_tracer_record_log (tr_framerate, pad_table->fullname,
-        pad_table->counter);
-    do_print_framerate_event (FPS_EVENT_ID, pad_table->fullname,
-        pad_table->counter);
-    pad_table->counter = 0;
+  /* Go through the counters and print the framerate of every pad seen */
+  for (i = 0; i < self->frame_counters->len; i++) {
+    pad_table = g_ptr_array_index (self->frame_counters, i);
+
+    /* Frames counted during the period, reported per second */
+    counter = GST_PERIODIC_COUNTER_TAKE (pad_table->counter);
+    fps = (guint) gst_util_uint64_scale (counter, GST_SECOND, period);
+
+    if (gst_shark_tracer_log_enabled ()) {
+      gst_tracer_record_log (tr_framerate, pad_table->fullname, fps);
+    }
+    if (G_UNLIKELY (0 == pad_table->name_id)) {
+      pad_table->name_id = gst_ctf_intern_string (pad_table->fullname);
+    }
+    do_print_framerate_event (pad_table->name_id, fps);
   }
 
   GST_OBJECT_UNLOCK (self);
@@ -209,38 +205,55 @@ make_char_array_valid (gchar * src)
   return src;
 }
 
-static void
-consider_frames (GstFramerateTracer * self, GstPad * pad, guint amount)
+/* The counter of a pad is created the first time it is seen, the
+   tracer owns it and the pad keeps a pointer to it */
+static GstFramerateCounter *
+get_counter (GstFramerateTracer * self, GstPad * pad)
 {
-  GstFramerateHash *pad_frames;
+  GstFramerateCounter *pad_frames;
   gchar *fullname;
 
-  g_return_if_fail (self);
-  g_return_if_fail (pad);
+  pad_frames = g_object_get_qdata (G_OBJECT (pad), self->counter_quark);
+  if (G_LIKELY (NULL != pad_frames)) {
+    return pad_frames;
+  }
+
+  /* The full name of every pad has the format elementName_padName and it is going 
+     to be used for displaying the framerate in a friendly user way */
+  fullname = g_strdup_printf ("%s_%s", GST_DEBUG_PAD_NAME (pad));
+  fullname = make_char_array_valid (fullname);
+
+  pad_frames = g_malloc (sizeof (GstFramerateCounter));
+  pad_frames->fullname = fullname;
+  pad_frames->name_id = gst_ctf_intern_string (fullname);
+  pad_frames->counter = 0;
+
+  /* Another streaming thread may have seen the pad meanwhile */
+  if (!g_object_replace_qdata (G_OBJECT (pad), self->counter_quark, NULL,
+          pad_frames, NULL, NULL)) {
+    free_counter (pad_frames);
+    return g_object_get_qdata (G_OBJECT (pad), self->counter_quark);
+  }
 
-  pad_frames =
-      (GstFramerateHash *) g_hash_table_lookup (self->frame_counters, pad);
+  GST_OBJECT_LOCK (self);
+  g_ptr_array_add (self->frame_counters, pad_frames);
+  GST_OBJECT_UNLOCK (self);
 
-  if (NULL != pad_frames) {
-    pad_frames->counter += amount;
-  } else {
+  GST_INFO_OBJECT (self, "Counting the frames of %s", fullname);
 
-    /* The full name of every pad has the format elementName_padName and it is going 
-       to be used for displaying the framerate in a friendly user way */
-    fullname = g_strdup_printf ("%s_%s", GST_DEBUG_PAD_NAME (pad));
-    fullname = make_char_array_valid (fullname);
+  return pad_frames;
+}
 
-    pad_frames = g_malloc (sizeof (GstFramerateHash));
-    pad_frames->fullname = fullname;
-    pad_frames->counter = amount;
+static void
+consider_frames (GstFramerateTracer * self, GstPad * pad, guint amount)
+{
+  GstFramerateCounter *pad_frames;
 
-    GST_OBJECT_LOCK (self);
-    g_hash_table_insert (self->frame_counters, gst_object_ref (pad),
-        pad_frames);
-    GST_OBJECT_UNLOCK (self);
+  g_return_if_fail (self);
+  g_return_if_fail (pad);
 
-    GST_INFO_OBJECT (self, "The %s key was added to the Hash Table", fullname);
-  }
+  pad_frames = get_counter (self, pad);
+  GST_PERIODIC_COUNTER_ADD (pad_frames->counter, amount);
 }
 
 static void
@@ -265,13 +278,11 @@ pad_pull_range_pre (GstFramerateTracer * self, GstClockTime ts, GstPad * pad,
 }
 
 static void
-destroy_hashtable_value (gpointer data)
+free_counter (gpointer data)
 {
-  GstFramerateHash *value;
+  GstFramerateCounter *value;
 
-  /* In order to properly free the memory of a element of the Hash table
-     it is needed to free the memory of the structure in every value */
-  value = (GstFramerateHash *) data;
+  value = (GstFramerateCounter *) data;
 
   g_free (value->fullname);
   g_free (value);
@@ -282,7 +293,7 @@ gst_framerate_tracer_finalize (GObject * obj)
 {
   GstFramerateTracer *self = GST_FRAMERATE_TRACER (obj);
 
-  g_hash_table_destroy (self->frame_counters);
+  g_ptr_array_free (self->frame_counters, TRUE);
 
   G_OBJECT_CLASS (gst_framerate_tracer_parent_class)->finalize (obj);
 }
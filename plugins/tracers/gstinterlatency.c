@@ -28,6 +28,19 @@
  *
  * A tracing module that determines latencies between src and intermediate elements
  * by injecting custom events at sources and process them in the pads.
+ *
+ * With mode=meta the source pad and timestamp travel with every buffer
+ * as a #GstMeta instead, so each buffer is measured against its own
+ * source, also after mixers and tee. Elements producing new buffers
+ * without copying the metas get the ones received on their sink pads
+ * since their previous output.
+ *
+ * With sample-interval=100ms or sample-every=N only one source buffer
+ * in that period or count carries a probe, whichever comes first, and
+ * the buffers in between are not measured.
+ *
+ * With aggregate=<window> the latencies of every pair of pads are logged
+ * once per window as their count, min, max, mean and percentiles.
  */
 /* TODO(ensonic): if there are two sources feeding into a mixer/muxer and later
  * we fan-out with tee and have two sinks, each sink would get all two events,
@@ -35,6 +48,7 @@
  * arrives on the sink we don't know to which event it correlates. Better would
  * be to use the buffer meta in 1.0 instead of the event. Or we track a min/max
  * latency.
+ * mode=meta does the former, the event remains the default.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -56,24 +70,252 @@ G_DEFINE_TYPE_WITH_CODE (GstInterLatencyTracer, gst_interlatency_tracer,
 static GQuark latency_probe_id;
 static GQuark latency_probe_pad;
 static GQuark latency_probe_ts;
+static GQuark latency_inputs_id;
+static GQuark latency_pull_id;
+static GQuark latency_sample_id;
 
 #ifdef GST_STABLE_RELEASE
 static GstTracerRecord *tr_interlatency;
 #endif
 
-static const gchar interlatency_metadata_event[] = "event {\n\
-    name = interlatency;\n\
-    id = %d;\n\
-    stream_id = %d;\n\
-    fields := struct {\n\
-        string from_pad;\n\
-        string to_pad;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _time;\n\
-    };\n\
-};\n\
-\n";
-
 static void gst_interlatency_tracer_dispose (GObject * object);
+static void gst_interlatency_tracer_finalize (GObject * object);
+
+/* latency meta */
+
+typedef struct _GstSharkLatencyMeta GstSharkLatencyMeta;
+typedef struct _GstSharkLatencyInputs GstSharkLatencyInputs;
+
+struct _GstSharkLatencyMeta
+{
+  GstMeta meta;
+
+  GstPad *src_pad;
+  guint64 ts;
+};
+
+/* The metas received on the sink pads of an element since its last
+ * output, one per source pad */
+struct _GstSharkLatencyInputs
+{
+  GMutex mutex;
+  GArray *latest;
+};
+
+typedef struct
+{
+  GstPad *src_pad;
+  guint64 ts;
+} GstSharkLatencyInput;
+
+static GType gst_shark_latency_meta_api_get_type (void);
+#define GST_SHARK_LATENCY_META_API_TYPE (gst_shark_latency_meta_api_get_type())
+
+static const GstMetaInfo *gst_shark_latency_meta_get_info (void);
+#define GST_SHARK_LATENCY_META_INFO (gst_shark_latency_meta_get_info())
+
+static GType
+gst_shark_latency_meta_api_get_type (void)
+{
+  static volatile GType type = 0;
+  /* No tags, transforming elements keep it on their output */
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstSharkLatencyMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+
+  return type;
+}
+
+static gboolean
+gst_shark_latency_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  GstSharkLatencyMeta *latency_meta = (GstSharkLatencyMeta *) meta;
+
+  latency_meta->src_pad = NULL;
+  latency_meta->ts = GST_CLOCK_TIME_NONE;
+
+  return TRUE;
+}
+
+static void
+gst_shark_latency_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  GstSharkLatencyMeta *latency_meta = (GstSharkLatencyMeta *) meta;
+
+  gst_object_replace ((GstObject **) & latency_meta->src_pad, NULL);
+}
+
+static GstSharkLatencyMeta *
+add_latency_meta (GstBuffer * buffer, GstPad * src_pad, guint64 ts)
+{
+  GstSharkLatencyMeta *latency_meta;
+
+  latency_meta = (GstSharkLatencyMeta *) gst_buffer_add_meta (buffer,
+      GST_SHARK_LATENCY_META_INFO, NULL);
+  if (latency_meta) {
+    latency_meta->src_pad = gst_object_ref (src_pad);
+    latency_meta->ts = ts;
+  }
+
+  return latency_meta;
+}
+
+static gboolean
+gst_shark_latency_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstSharkLatencyMeta *latency_meta = (GstSharkLatencyMeta *) meta;
+
+  if (!GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  return NULL != add_latency_meta (dest, latency_meta->src_pad,
+      latency_meta->ts);
+}
+
+static const GstMetaInfo *
+gst_shark_latency_meta_get_info (void)
+{
+  static const GstMetaInfo *info = NULL;
+
+  if (g_once_init_enter (&info)) {
+    const GstMetaInfo *meta = gst_meta_register (GST_SHARK_LATENCY_META_API_TYPE,
+        "GstSharkLatencyMeta", sizeof (GstSharkLatencyMeta),
+        gst_shark_latency_meta_init, gst_shark_latency_meta_free,
+        gst_shark_latency_meta_transform);
+    g_once_init_leave (&info, meta);
+  }
+
+  return info;
+}
+
+static GstSharkLatencyMeta *
+iterate_latency_meta (GstBuffer * buffer, gpointer * state)
+{
+  GstMeta *meta;
+
+  while ((meta = gst_buffer_iterate_meta (buffer, state))) {
+    if (meta->info->api == GST_SHARK_LATENCY_META_API_TYPE)
+      return (GstSharkLatencyMeta *) meta;
+  }
+
+  return NULL;
+}
+
+static void
+free_latency_inputs (GstSharkLatencyInputs * inputs)
+{
+  guint i;
+
+  for (i = 0; i < inputs->latest->len; i++)
+    gst_object_unref (g_array_index (inputs->latest, GstSharkLatencyInput,
+            i).src_pad);
+
+  g_array_free (inputs->latest, TRUE);
+  g_mutex_clear (&inputs->mutex);
+  g_free (inputs);
+}
+
+static GstSharkLatencyInputs *
+get_latency_inputs (GstElement * element)
+{
+  GstSharkLatencyInputs *inputs;
+
+  inputs = g_object_get_qdata ((GObject *) element, latency_inputs_id);
+  if (G_LIKELY (inputs))
+    return inputs;
+
+  GST_OBJECT_LOCK (element);
+  inputs = g_object_get_qdata ((GObject *) element, latency_inputs_id);
+  if (!inputs) {
+    GST_DEBUG_OBJECT (element, "Forwarding latency metas of its inputs");
+
+    inputs = g_new0 (GstSharkLatencyInputs, 1);
+    g_mutex_init (&inputs->mutex);
+    inputs->latest = g_array_new (FALSE, FALSE, sizeof (GstSharkLatencyInput));
+    g_object_set_qdata_full ((GObject *) element, latency_inputs_id, inputs,
+        (GDestroyNotify) free_latency_inputs);
+  }
+  GST_OBJECT_UNLOCK (element);
+
+  return inputs;
+}
+
+/* Remember the metas of a buffer entering an element that drops them */
+static void
+store_latency_inputs (GstElement * element, GstBuffer * buffer)
+{
+  GstSharkLatencyInputs *inputs;
+  GstSharkLatencyMeta *latency_meta;
+  gpointer state = NULL;
+  guint i;
+
+  inputs = g_object_get_qdata ((GObject *) element, latency_inputs_id);
+  if (G_LIKELY (!inputs))
+    return;
+
+  latency_meta = iterate_latency_meta (buffer, &state);
+  if (!latency_meta)
+    return;
+
+  g_mutex_lock (&inputs->mutex);
+  do {
+    GstSharkLatencyInput *input = NULL;
+
+    for (i = 0; i < inputs->latest->len; i++) {
+      input = &g_array_index (inputs->latest, GstSharkLatencyInput, i);
+      if (input->src_pad == latency_meta->src_pad)
+        break;
+    }
+
+    if (i == inputs->latest->len) {
+      GstSharkLatencyInput new_input;
+
+      new_input.src_pad = gst_object_ref (latency_meta->src_pad);
+      g_array_append_val (inputs->latest, new_input);
+      input = &g_array_index (inputs->latest, GstSharkLatencyInput, i);
+    }
+
+    input->ts = latency_meta->ts;
+  } while ((latency_meta = iterate_latency_meta (buffer, &state)));
+  g_mutex_unlock (&inputs->mutex);
+}
+
+/* Give a buffer without metas the ones received by its element since its
+ * last output. They are consumed, otherwise sources that stopped would be
+ * measured again on every output with an ever growing latency. */
+static void
+forward_latency_inputs (GstElement * element, GstBuffer * buffer)
+{
+  GstSharkLatencyInputs *inputs;
+  gpointer state = NULL;
+  guint i;
+
+  if (iterate_latency_meta (buffer, &state))
+    return;
+
+  if (!gst_buffer_is_writable (buffer)) {
+    GST_LOG_OBJECT (element, "Buffer %p is not writable", buffer);
+    return;
+  }
+
+  inputs = get_latency_inputs (element);
+
+  g_mutex_lock (&inputs->mutex);
+  for (i = 0; i < inputs->latest->len; i++) {
+    GstSharkLatencyInput *input =
+        &g_array_index (inputs->latest, GstSharkLatencyInput, i);
+
+    add_latency_meta (buffer, input->src_pad, input->ts);
+    gst_object_unref (input->src_pad);
+  }
+  g_array_set_size (inputs->latest, 0);
+  g_mutex_unlock (&inputs->mutex);
+}
 
 /* data helpers */
 
@@ -111,44 +353,116 @@ get_real_pad_parent (GstPad * pad)
   return GST_ELEMENT_CAST (parent);
 }
 
+/* sampling */
+
+typedef struct
+{
+  GstClockTime last_ts;
+  guint count;
+} GstSharkLatencySample;
+
+/* Whether the buffer leaving a source pad at ts carries a probe. Only
+ * the streaming thread of the pad gets here, so the state is unlocked */
+static gboolean
+sample_latency_probe (GstInterLatencyTracer * interlatency_tracer,
+    GstPad * pad, guint64 ts)
+{
+  GstSharkLatencySample *sample;
+
+  if (G_LIKELY (!interlatency_tracer->sampling))
+    return TRUE;
+
+  sample = g_object_get_qdata ((GObject *) pad, latency_sample_id);
+  if (G_UNLIKELY (!sample)) {
+    sample = g_new0 (GstSharkLatencySample, 1);
+    g_object_set_qdata_full ((GObject *) pad, latency_sample_id, sample,
+        g_free);
+    /* The first buffer is always measured */
+  } else {
+    sample->count++;
+    if ((0 == interlatency_tracer->sample_every
+            || sample->count < interlatency_tracer->sample_every)
+        && (!GST_CLOCK_TIME_IS_VALID (interlatency_tracer->sample_interval)
+            || GST_CLOCK_DIFF (sample->last_ts,
+                ts) < (GstClockTimeDiff) interlatency_tracer->sample_interval))
+      return FALSE;
+  }
+
+  sample->count = 0;
+  sample->last_ts = ts;
+
+  return TRUE;
+}
+
 /* hooks */
 
 static void
 log_latency (GstInterLatencyTracer * interlatency_tracer,
+    GstPad * src_pad, guint64 src_ts, GstPad * sink_pad, guint64 sink_ts)
+{
+  guint64 time;
+
+  time = GST_CLOCK_DIFF (src_ts, sink_ts);
+
+  if (NULL != interlatency_tracer->aggregate) {
+    gst_shark_aggregate_add (interlatency_tracer->aggregate, sink_ts,
+        gst_ctf_pad_name_id (src_pad), gst_shark_tracer_pad_name (src_pad),
+        gst_ctf_pad_name_id (sink_pad), gst_shark_tracer_pad_name (sink_pad),
+        time);
+    gst_ctf_snapshot_on_threshold (INTERLATENCY_EVENT_ID, time);
+    return;
+  }
+
+  if (gst_shark_tracer_log_enabled ()) {
+    const gchar *src = gst_shark_tracer_pad_name (src_pad);
+    const gchar *sink = gst_shark_tracer_pad_name (sink_pad);
+    gchar time_string[GST_SHARK_TIME_STRING_SIZE];
+
+    g_snprintf (time_string, sizeof (time_string), "%" GST_TIME_FORMAT,
+        GST_TIME_ARGS (time));
+
+#ifdef GST_STABLE_RELEASE
+    gst_tracer_record_log (tr_interlatency, src, sink, time_string);
+#else
+    /* TODO(ensonic): report format is still unstable */
+    gst_tracer_log_trace (gst_structure_new ("interlatency",
+            "from_pad", G_TYPE_STRING, src,
+            "to_pad", G_TYPE_STRING, sink,
+            "time", G_TYPE_STRING, time_string, NULL));
+#endif
+  }
+
+  do_print_interlatency_event (gst_ctf_pad_name_id (src_pad),
+      gst_ctf_pad_name_id (sink_pad), time);
+  gst_ctf_snapshot_on_threshold (INTERLATENCY_EVENT_ID, time);
+}
+
+static void
+log_probe_latency (GstInterLatencyTracer * interlatency_tracer,
     const GstStructure * data, GstPad * sink_pad, guint64 sink_ts)
 {
   GstPad *src_pad = NULL;
   guint64 src_ts;
-  gchar *src = NULL, *sink = NULL;
-  guint64 time;
-  GString *time_string = NULL;
 
   gst_structure_id_get (data,
       latency_probe_pad, GST_TYPE_PAD, &src_pad,
       latency_probe_ts, G_TYPE_UINT64, &src_ts, NULL);
 
-  src = g_strdup_printf ("%s_%s", GST_DEBUG_PAD_NAME (src_pad));
-  sink = g_strdup_printf ("%s_%s", GST_DEBUG_PAD_NAME (sink_pad));
+  log_latency (interlatency_tracer, src_pad, src_ts, sink_pad, sink_ts);
 
-  time = GST_CLOCK_DIFF (src_ts, sink_ts);
-
-  time_string = g_string_new ("");
-  g_string_printf (time_string, "%" GST_TIME_FORMAT, GST_TIME_ARGS (time));
+  gst_object_unref (src_pad);
+}
 
-#ifdef GST_STABLE_RELEASE
-  gst_tracer_record_log (tr_interlatency, src, sink, time_string->str);
-#else
-  /* TODO(ensonic): report format is still unstable */
-  gst_tracer_log_trace (gst_structure_new ("interlatency",
-          "from_pad", G_TYPE_STRING, src,
-          "to_pad", G_TYPE_STRING, sink,
-          "time", G_TYPE_STRING, time_string->str, NULL));
-#endif
-  do_print_interlatency_event (INTERLATENCY_EVENT_ID, src, sink, time);
+static void
+log_meta_latency (GstInterLatencyTracer * interlatency_tracer,
+    GstBuffer * buffer, GstPad * sink_pad, guint64 sink_ts)
+{
+  GstSharkLatencyMeta *latency_meta;
+  gpointer state = NULL;
 
-  g_string_free (time_string, TRUE);
-  g_free (src);
-  g_free (sink);
+  while ((latency_meta = iterate_latency_meta (buffer, &state)))
+    log_latency (interlatency_tracer, latency_meta->src_pad, latency_meta->ts,
+        sink_pad, sink_ts);
 }
 
 static void
@@ -176,10 +490,20 @@ calculate_latency (GstInterLatencyTracer * interlatency_tracer,
   g_return_if_fail (pad);
 
   if (!GST_IS_BIN (parent)) {
-    GstEvent *ev = g_object_get_qdata ((GObject *) pad, latency_probe_id);
+    GstEvent *ev;
+
+    /* A sampled probe is only measured with the buffer that follows it */
+    if (interlatency_tracer->sampling)
+      ev = g_object_steal_qdata ((GObject *) pad, latency_probe_id);
+    else
+      ev = g_object_get_qdata ((GObject *) pad, latency_probe_id);
 
     if (GST_IS_EVENT (ev))
-      log_latency (interlatency_tracer, gst_event_get_structure (ev), pad, ts);
+      log_probe_latency (interlatency_tracer, gst_event_get_structure (ev),
+          pad, ts);
+
+    if (ev && interlatency_tracer->sampling)
+      gst_event_unref (ev);
   }
 }
 
@@ -200,7 +524,8 @@ do_push_buffer_pre (GstTracer * self, guint64 ts, GstPad * pad)
   }
 
   if (parent && GST_OBJECT_FLAG_IS_SET (parent, GST_ELEMENT_FLAG_SOURCE)) {
-    send_latency_probe (parent, pad, ts);
+    if (sample_latency_probe (interlatency_tracer, pad, ts))
+      send_latency_probe (parent, pad, ts);
     calculate_latency (interlatency_tracer, peer_parent, peer_pad, ts);
   } else
     calculate_latency (interlatency_tracer, parent, pad, ts);
@@ -211,6 +536,61 @@ do_push_buffer_pre (GstTracer * self, guint64 ts, GstPad * pad)
 
 }
 
+static void
+calculate_meta_latency (GstInterLatencyTracer * interlatency_tracer,
+    GstPad * pad, GstBuffer * buffer, guint64 ts)
+{
+  GstElement *parent = get_real_pad_parent (pad);
+  GstPad *peer_pad = GST_PAD_PEER (pad);
+  GstElement *peer_parent = get_real_pad_parent (peer_pad);
+
+  if (!peer_pad || !parent || GST_IS_BIN (parent))
+    return;
+
+  if (GST_OBJECT_FLAG_IS_SET (parent, GST_ELEMENT_FLAG_SOURCE)) {
+    if (sample_latency_probe (interlatency_tracer, pad, ts)) {
+      if (gst_buffer_is_writable (buffer))
+        add_latency_meta (buffer, pad, ts);
+      else
+        GST_LOG_OBJECT (pad, "Buffer %p is not writable", buffer);
+    }
+  } else {
+    forward_latency_inputs (parent, buffer);
+    log_meta_latency (interlatency_tracer, buffer, pad, ts);
+  }
+
+  if (peer_parent && !GST_IS_BIN (peer_parent)) {
+    if (GST_OBJECT_FLAG_IS_SET (peer_parent, GST_ELEMENT_FLAG_SINK)
+        || GST_OBJECT_FLAG_IS_SET (parent, GST_ELEMENT_FLAG_SOURCE))
+      log_meta_latency (interlatency_tracer, buffer, peer_pad, ts);
+
+    store_latency_inputs (peer_parent, buffer);
+  }
+}
+
+static void
+do_push_buffer_meta_pre (GstTracer * self, guint64 ts, GstPad * pad,
+    GstBuffer * buffer)
+{
+  calculate_meta_latency (GST_INTERLATENCY_TRACER_CAST (self), pad, buffer,
+      ts);
+}
+
+static void
+do_push_list_meta_pre (GstTracer * self, guint64 ts, GstPad * pad,
+    GstBufferList * list)
+{
+  GstInterLatencyTracer *interlatency_tracer;
+  guint i, len;
+
+  interlatency_tracer = GST_INTERLATENCY_TRACER_CAST (self);
+
+  len = gst_buffer_list_length (list);
+  for (i = 0; i < len; i++)
+    calculate_meta_latency (interlatency_tracer, pad,
+        gst_buffer_list_get (list, i), ts);
+}
+
 static void
 do_pull_range_pre (GstTracer * self, guint64 ts, GstPad * pad)
 {
@@ -222,9 +602,10 @@ do_pull_range_pre (GstTracer * self, guint64 ts, GstPad * pad)
   interlatency_tracer = GST_INTERLATENCY_TRACER_CAST (self);
 
   if (parent_peer
-      && GST_OBJECT_FLAG_IS_SET (parent_peer, GST_ELEMENT_FLAG_SOURCE))
-    send_latency_probe (parent_peer, peer_pad, ts);
-  else
+      && GST_OBJECT_FLAG_IS_SET (parent_peer, GST_ELEMENT_FLAG_SOURCE)) {
+    if (sample_latency_probe (interlatency_tracer, peer_pad, ts))
+      send_latency_probe (parent_peer, peer_pad, ts);
+  } else
     calculate_latency (interlatency_tracer, parent_peer, peer_pad, ts);
 }
 
@@ -240,6 +621,69 @@ do_pull_range_post (GstTracer * self, guint64 ts, GstPad * pad)
     calculate_latency (interlatency_tracer, parent, pad, ts);
 }
 
+/* The buffer is only known after the pull, so the time the source was
+ * asked for it is kept on its pad */
+static void
+do_pull_range_meta_pre (GstTracer * self, guint64 ts, GstPad * pad)
+{
+  GstInterLatencyTracer *interlatency_tracer;
+  GstPad *peer_pad = GST_PAD_PEER (pad);
+  GstElement *parent_peer = get_real_pad_parent (peer_pad);
+  guint64 *pull_ts;
+
+  interlatency_tracer = GST_INTERLATENCY_TRACER_CAST (self);
+
+  if (!parent_peer || GST_IS_BIN (parent_peer)
+      || !GST_OBJECT_FLAG_IS_SET (parent_peer, GST_ELEMENT_FLAG_SOURCE))
+    return;
+
+  pull_ts = g_object_get_qdata ((GObject *) peer_pad, latency_pull_id);
+  if (G_UNLIKELY (!pull_ts)) {
+    pull_ts = g_new (guint64, 1);
+    g_object_set_qdata_full ((GObject *) peer_pad, latency_pull_id, pull_ts,
+        g_free);
+  }
+
+  if (sample_latency_probe (interlatency_tracer, peer_pad, ts))
+    *pull_ts = ts;
+  else
+    *pull_ts = GST_CLOCK_TIME_NONE;
+}
+
+static void
+do_pull_range_meta_post (GstTracer * self, guint64 ts, GstPad * pad,
+    GstBuffer * buffer, GstFlowReturn res)
+{
+  GstInterLatencyTracer *interlatency_tracer;
+  GstElement *parent = get_real_pad_parent (pad);
+  GstPad *peer_pad = GST_PAD_PEER (pad);
+  GstElement *parent_peer = get_real_pad_parent (peer_pad);
+
+  interlatency_tracer = GST_INTERLATENCY_TRACER_CAST (self);
+
+  if (GST_FLOW_OK != res || !buffer || !parent_peer || GST_IS_BIN (parent_peer))
+    return;
+
+  if (GST_OBJECT_FLAG_IS_SET (parent_peer, GST_ELEMENT_FLAG_SOURCE)) {
+    guint64 *pull_ts = g_object_get_qdata ((GObject *) peer_pad,
+        latency_pull_id);
+
+    if (pull_ts && GST_CLOCK_TIME_IS_VALID (*pull_ts)
+        && gst_buffer_is_writable (buffer))
+      add_latency_meta (buffer, peer_pad, *pull_ts);
+  } else {
+    forward_latency_inputs (parent_peer, buffer);
+    log_meta_latency (interlatency_tracer, buffer, peer_pad, ts);
+  }
+
+  if (parent && !GST_IS_BIN (parent)) {
+    if (GST_OBJECT_FLAG_IS_SET (parent, GST_ELEMENT_FLAG_SINK))
+      log_meta_latency (interlatency_tracer, buffer, pad, ts);
+
+    store_latency_inputs (parent, buffer);
+  }
+}
+
 static void
 do_push_event_pre (GstTracer * self, guint64 ts, GstPad * pad, GstEvent * ev)
 {
@@ -267,6 +711,101 @@ do_push_event_pre (GstTracer * self, guint64 ts, GstPad * pad, GstEvent * ev)
 
 /* tracer class */
 
+static void
+gst_interlatency_tracer_constructed (GObject * obj)
+{
+  GstInterLatencyTracer *self;
+  GstTracer *tracer;
+  GList *mode, *interval, *every;
+  GstClockTime window;
+
+  /* Let the parent parse the params */
+  G_OBJECT_CLASS (parent_class)->constructed (obj);
+
+  self = GST_INTERLATENCY_TRACER (obj);
+  tracer = GST_TRACER (obj);
+
+  mode = gst_shark_tracer_get_param (GST_SHARK_TRACER (self), "mode");
+  if (NULL != mode) {
+    if (0 == g_strcmp0 (mode->data, "meta")) {
+      self->meta = TRUE;
+    } else if (0 != g_strcmp0 (mode->data, "event")) {
+      GST_ERROR_OBJECT (self, "Unknown interlatency mode \"%s\"",
+          (gchar *) mode->data);
+    }
+  }
+
+  interval = gst_shark_tracer_get_param (GST_SHARK_TRACER (self),
+      "sample-interval");
+  if (NULL != interval) {
+    /* Milliseconds if no unit is given */
+    self->sample_interval =
+        gst_shark_tracer_parse_time (interval->data, GST_MSECOND);
+    if (!GST_CLOCK_TIME_IS_VALID (self->sample_interval))
+      GST_ERROR_OBJECT (self, "Invalid sample interval \"%s\"",
+          (gchar *) interval->data);
+  }
+
+  every = gst_shark_tracer_get_param (GST_SHARK_TRACER (self),
+      "sample-every");
+  if (NULL != every) {
+    /* On error, 0 is set */
+    self->sample_every = g_ascii_strtoull (every->data, NULL, 0);
+    if (0 == self->sample_every)
+      GST_ERROR_OBJECT (self, "Invalid sample count \"%s\"",
+          (gchar *) every->data);
+  }
+
+  self->sampling = GST_CLOCK_TIME_IS_VALID (self->sample_interval)
+      || self->sample_every > 1;
+  if (self->sampling)
+    GST_INFO_OBJECT (self, "Sampling probes every %u buffers or %"
+        GST_TIME_FORMAT, self->sample_every,
+        GST_TIME_ARGS (self->sample_interval));
+
+  window = gst_shark_aggregate_get_window (GST_SHARK_TRACER (self));
+  if (GST_CLOCK_TIME_IS_VALID (window))
+    self->aggregate = gst_shark_aggregate_new ("interlatency", window);
+
+  if (self->meta) {
+    GST_INFO_OBJECT (self, "Carrying latency probes in buffer metas");
+
+    /* Make sure the meta is registered before the first buffer */
+    gst_shark_latency_meta_get_info ();
+
+    gst_tracing_register_hook (tracer, "pad-push-pre",
+        G_CALLBACK (do_push_buffer_meta_pre));
+    gst_tracing_register_hook (tracer, "pad-push-list-pre",
+        G_CALLBACK (do_push_list_meta_pre));
+    gst_tracing_register_hook (tracer, "pad-pull-range-pre",
+        G_CALLBACK (do_pull_range_meta_pre));
+    gst_tracing_register_hook (tracer, "pad-pull-range-post",
+        G_CALLBACK (do_pull_range_meta_post));
+    return;
+  }
+
+  /* In push mode, pre/post will be called before/after the peer chain
+   * function has been called. For this reason, we only use -pre to avoid
+   * accounting for the processing time of the peer element (the sink).
+   */
+  gst_tracing_register_hook (tracer, "pad-push-pre",
+      G_CALLBACK (do_push_buffer_pre));
+  gst_tracing_register_hook (tracer, "pad-push-list-pre",
+      G_CALLBACK (do_push_buffer_pre));
+
+  /* While in pull mode, pre/post will happend before and after the upstream
+   * pull_range call is made, so it already only account for the upstream
+   * processing time. As a side effect, in pull mode, we can measure the
+   * source processing latency, while in push mode, we can't .
+   */
+  gst_tracing_register_hook (tracer, "pad-pull-range-pre",
+      G_CALLBACK (do_pull_range_pre));
+  gst_tracing_register_hook (tracer, "pad-pull-range-post",
+      G_CALLBACK (do_pull_range_post));
+  gst_tracing_register_hook (tracer, "pad-push-event-pre",
+      G_CALLBACK (do_push_event_pre));
+}
+
 static void
 gst_interlatency_tracer_class_init (GstInterLatencyTracerClass * klass)
 {
@@ -277,6 +816,9 @@ gst_interlatency_tracer_class_init (GstInterLatencyTracerClass * klass)
   latency_probe_id = g_quark_from_static_string ("latency_probe.id");
   latency_probe_pad = g_quark_from_static_string ("latency_probe.pad");
   latency_probe_ts = g_quark_from_static_string ("latency_probe.ts");
+  latency_inputs_id = g_quark_from_static_string ("latency_probe.inputs");
+  latency_pull_id = g_quark_from_static_string ("latency_probe.pull");
+  latency_sample_id = g_quark_from_static_string ("latency_probe.sample");
 
   /* announce trace formats */
   /* *INDENT-OFF* */
@@ -310,43 +852,37 @@ gst_interlatency_tracer_class_init (GstInterLatencyTracerClass * klass)
 #endif
   /* *INDENT-ON* */
 
+  oclass->constructed = gst_interlatency_tracer_constructed;
   oclass->dispose = gst_interlatency_tracer_dispose;
+  oclass->finalize = gst_interlatency_tracer_finalize;
 }
 
 static void
 gst_interlatency_tracer_init (GstInterLatencyTracer * self)
 {
-  GstTracer *tracer = GST_TRACER (self);
-  gchar *metadata_event = NULL;
-
-  /* In push mode, pre/post will be called before/after the peer chain
-   * function has been called. For this reason, we only use -pre to avoid
-   * accounting for the processing time of the peer element (the sink).
-   */
-  gst_tracing_register_hook (tracer, "pad-push-pre",
-      G_CALLBACK (do_push_buffer_pre));
-  gst_tracing_register_hook (tracer, "pad-push-list-pre",
-      G_CALLBACK (do_push_buffer_pre));
-
-  /* While in pull mode, pre/post will happend before and after the upstream
-   * pull_range call is made, so it already only account for the upstream
-   * processing time. As a side effect, in pull mode, we can measure the
-   * source processing latency, while in push mode, we can't .
-   */
-  gst_tracing_register_hook (tracer, "pad-pull-range-pre",
-      G_CALLBACK (do_pull_range_pre));
-  gst_tracing_register_hook (tracer, "pad-pull-range-post",
-      G_CALLBACK (do_pull_range_post));
-  gst_tracing_register_hook (tracer, "pad-push-event-pre",
-      G_CALLBACK (do_push_event_pre));
-
-  metadata_event =
-      g_strdup_printf (interlatency_metadata_event, INTERLATENCY_EVENT_ID, 0);
-  add_metadata_event_struct (metadata_event);
-  g_free (metadata_event);
+  /* The hooks depend on the mode and are registered once the params are
+   * known */
+  self->meta = FALSE;
+  self->sampling = FALSE;
+  self->sample_interval = GST_CLOCK_TIME_NONE;
+  self->sample_every = 0;
+  self->aggregate = NULL;
+
+  gst_ctf_add_event_metadata (INTERLATENCY_EVENT_ID);
 }
 
 static void
 gst_interlatency_tracer_dispose (GObject * object)
 {
 }
+
+static void
+gst_interlatency_tracer_finalize (GObject * object)
+{
+  GstInterLatencyTracer *self = GST_INTERLATENCY_TRACER (object);
+
+  gst_shark_aggregate_free (self->aggregate);
+  self->aggregate = NULL;
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
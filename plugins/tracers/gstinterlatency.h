@@ -25,6 +25,7 @@
 #define __GST_INTERLATENCY_TRACER_H__
 
 #include "gstsharktracer.h"
+#include "gstaggregate.h"
 
 G_BEGIN_DECLS
 #define GST_TYPE_INTERLATENCY_TRACER \
@@ -50,6 +51,11 @@ struct _GstInterLatencyTracer
 {
   GstSharkTracer parent;
   /*< private > */
+  gboolean meta;
+  gboolean sampling;
+  GstClockTime sample_interval;
+  guint sample_every;
+  GstSharkAggregate *aggregate;
 };
 
 struct _GstInterLatencyTracerClass
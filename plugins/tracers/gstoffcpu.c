@@ -0,0 +1,532 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/**
+ * SECTION:gstoffcpu
+ * @short_description: log the time streaming threads spend blocked
+ *
+ * A tracing module that splits the time of every push into the time the
+ * thread was running and the time it was blocked, waiting on a queue, a
+ * clock or downstream backpressure. The thread CPU time and voluntary
+ * context switches are sampled when a push starts and when it returns.
+ *
+ * Pushes done by downstream elements within a push are charged to their
+ * own link, so the blocked time is reported where the thread waited. The
+ * totals of every link are logged once per period, see
+ * #GstPeriodicTracer.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* RUSAGE_THREAD */
+#endif
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#ifndef RUSAGE_THREAD
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "gstoffcpu.h"
+#include "gstctf.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_off_cpu_debug);
+#define GST_CAT_DEFAULT gst_off_cpu_debug
+
+/**
+ * GstOffCpuTracer:
+ *
+ * Opaque #GstOffCpuTracer data structure
+ */
+struct _GstOffCpuTracer
+{
+  GstPeriodicTracer parent;
+
+  /* Counters of every link seen, the pad pushing also points to its own */
+  GPtrArray *links;
+  GQuark link_quark;
+};
+
+/* Totals of a link during the current period */
+typedef struct _GstOffCpuLink GstOffCpuLink;
+struct _GstOffCpuLink
+{
+  gchar *src_pad;
+  gchar *sink_pad;
+  guint32 src_pad_id;
+  guint32 sink_pad_id;
+  guint64 pushes;
+  guint64 time;
+  guint64 blocked;
+  guint64 switches;
+};
+
+/* Values sampled at the start and end of a push: wall time, thread CPU
+ * time and voluntary context switches */
+enum
+{
+  SAMPLE_WALL,
+  SAMPLE_CPU,
+  SAMPLE_SWITCHES
+};
+
+/* Pushes in progress in a thread, the data of a frame is its link */
+typedef struct _GstOffCpuThread GstOffCpuThread;
+struct _GstOffCpuThread
+{
+  GArray *frames;
+#ifndef RUSAGE_THREAD
+  gint status_fd;
+#endif
+};
+
+#define _do_init \
+    GST_DEBUG_CATEGORY_INIT (gst_off_cpu_debug, "offcpu", 0, "offcpu tracer");
+
+G_DEFINE_TYPE_WITH_CODE (GstOffCpuTracer, gst_off_cpu_tracer,
+    GST_TYPE_PERIODIC_TRACER, _do_init);
+
+static GstTracerRecord *tr_off_cpu;
+
+static volatile gint off_cpu_instances = 0;
+
+static void free_thread (gpointer data);
+static GPrivate off_cpu_thread = G_PRIVATE_INIT (free_thread);
+
+static void
+free_thread (gpointer data)
+{
+  GstOffCpuThread *thread;
+
+  thread = (GstOffCpuThread *) data;
+
+#ifndef RUSAGE_THREAD
+  if (thread->status_fd >= 0) {
+    close (thread->status_fd);
+  }
+#endif
+  g_array_unref (thread->frames);
+  g_free (thread);
+}
+
+static GstOffCpuThread *
+get_thread (void)
+{
+  GstOffCpuThread *thread;
+#ifndef RUSAGE_THREAD
+  gchar *path;
+#endif
+
+  thread = g_private_get (&off_cpu_thread);
+  if (G_LIKELY (NULL != thread)) {
+    return thread;
+  }
+
+  thread = g_new0 (GstOffCpuThread, 1);
+  thread->frames = g_array_sized_new (FALSE, FALSE, sizeof (GstSharkFrame),
+      16);
+#ifndef RUSAGE_THREAD
+  path = g_strdup_printf ("/proc/self/task/%d/status",
+      (gint) syscall (SYS_gettid));
+  thread->status_fd = open (path, O_RDONLY | O_CLOEXEC);
+  g_free (path);
+#endif
+  g_private_set (&off_cpu_thread, thread);
+
+  return thread;
+}
+
+#ifndef RUSAGE_THREAD
+/* The leading new line skips nonvoluntary_ctxt_switches */
+#define VOLUNTARY_SWITCHES_KEY "\nvoluntary_ctxt_switches:"
+
+static guint64
+read_voluntary_switches (GstOffCpuThread * thread)
+{
+  gchar buf[2048];
+  gchar *line;
+  gssize size;
+
+  if (thread->status_fd < 0) {
+    return 0;
+  }
+
+  size = pread (thread->status_fd, buf, sizeof (buf) - 1, 0);
+  if (size <= 0) {
+    return 0;
+  }
+  buf[size] = '\0';
+
+  line = strstr (buf, VOLUNTARY_SWITCHES_KEY);
+  if (NULL == line) {
+    return 0;
+  }
+
+  return g_ascii_strtoull (line + strlen (VOLUNTARY_SWITCHES_KEY), NULL, 10);
+}
+#endif
+
+static void
+take_sample (GstOffCpuThread * thread, GstClockTime ts, guint64 * sample)
+{
+#ifdef RUSAGE_THREAD
+  struct rusage usage;
+
+  /* A single call gives both the CPU time and the context switches */
+  sample[SAMPLE_WALL] = ts;
+  sample[SAMPLE_CPU] = 0;
+  sample[SAMPLE_SWITCHES] = 0;
+  if (0 == getrusage (RUSAGE_THREAD, &usage)) {
+    sample[SAMPLE_CPU] = GST_TIMEVAL_TO_TIME (usage.ru_utime) +
+        GST_TIMEVAL_TO_TIME (usage.ru_stime);
+    sample[SAMPLE_SWITCHES] = usage.ru_nvcsw;
+  }
+#else
+  struct timespec now;
+
+  sample[SAMPLE_WALL] = ts;
+  sample[SAMPLE_CPU] = 0;
+  if (0 == clock_gettime (CLOCK_THREAD_CPUTIME_ID, &now)) {
+    sample[SAMPLE_CPU] = GST_TIMESPEC_TO_TIME (now);
+  }
+  sample[SAMPLE_SWITCHES] = read_voluntary_switches (thread);
+#endif
+}
+
+static void
+free_link (gpointer data)
+{
+  GstOffCpuLink *link;
+
+  link = (GstOffCpuLink *) data;
+
+  g_free (link->src_pad);
+  g_free (link->sink_pad);
+  g_free (link);
+}
+
+/* The link of a pad is created the first time it is seen, the tracer owns
+   it and the pad keeps a pointer to it */
+static GstOffCpuLink *
+get_link (GstOffCpuTracer * self, GstPad * pad, GstPad * peer)
+{
+  GstOffCpuLink *link;
+  GstPad *src_pad;
+  GstPad *sink_pad;
+
+  link = g_object_get_qdata (G_OBJECT (pad), self->link_quark);
+  if (G_LIKELY (NULL != link)) {
+    return link;
+  }
+
+  /* Pads pulling are the sink of their link */
+  src_pad = GST_PAD_IS_SRC (pad) ? pad : peer;
+  sink_pad = GST_PAD_IS_SRC (pad) ? peer : pad;
+
+  link = g_malloc0 (sizeof (GstOffCpuLink));
+  link->src_pad = g_strdup (gst_shark_tracer_pad_name (src_pad));
+  link->sink_pad = g_strdup (gst_shark_tracer_pad_name (sink_pad));
+  link->src_pad_id = gst_ctf_pad_name_id (src_pad);
+  link->sink_pad_id = gst_ctf_pad_name_id (sink_pad);
+
+  /* Another streaming thread may have seen the pad meanwhile */
+  if (!g_object_replace_qdata (G_OBJECT (pad), self->link_quark, NULL,
+          link, NULL, NULL)) {
+    free_link (link);
+    return g_object_get_qdata (G_OBJECT (pad), self->link_quark);
+  }
+
+  GST_OBJECT_LOCK (self);
+  g_ptr_array_add (self->links, link);
+  GST_OBJECT_UNLOCK (self);
+
+  GST_INFO_OBJECT (self, "Measuring the blocked time of %s -> %s",
+      link->src_pad, link->sink_pad);
+
+  return link;
+}
+
+static void
+push_frame (GstOffCpuTracer * self, guint64 ts, GstPad * pad)
+{
+  guint64 start[GST_SHARK_FRAME_VALUES] = { 0 };
+  GstOffCpuThread *thread;
+  GstOffCpuLink *link;
+  GstPad *peer;
+
+  peer = gst_pad_get_peer (pad);
+  if (NULL == peer) {
+    return;
+  }
+
+  thread = get_thread ();
+
+  link = NULL;
+  if (NULL != GST_OBJECT_PARENT (pad)
+      && gst_shark_tracer_object_is_filtered (GST_SHARK_TRACER (self),
+          GST_OBJECT_PARENT (pad))) {
+    link = get_link (self, pad, peer);
+  }
+  gst_object_unref (peer);
+
+  /* Sampled last so the bookkeeping above is not charged to the link */
+  take_sample (thread, ts, start);
+
+  gst_shark_tracer_push_frame (thread->frames, pad, link, start);
+}
+
+static void
+pop_frame (GstOffCpuTracer * self, guint64 ts, GstPad * pad)
+{
+  guint64 end[GST_SHARK_FRAME_VALUES] = { 0 };
+  guint64 exclusive[GST_SHARK_FRAME_VALUES];
+  GstOffCpuThread *thread;
+  GstOffCpuLink *link;
+  GstSharkFrame frame;
+  guint64 time;
+  guint64 cpu;
+
+  thread = g_private_get (&off_cpu_thread);
+  if (NULL == thread || 0 == thread->frames->len) {
+    return;
+  }
+
+  take_sample (thread, ts, end);
+
+  /* Pushes done downstream are charged to their own link. The pre hook
+     skips pads without a peer. */
+  if (!gst_shark_tracer_pop_frame (thread->frames, pad, end, &frame,
+          exclusive)) {
+    return;
+  }
+
+  link = frame.data;
+  if (NULL == link) {
+    return;
+  }
+
+  time = exclusive[SAMPLE_WALL];
+  cpu = exclusive[SAMPLE_CPU];
+
+  GST_PERIODIC_COUNTER_ADD (link->pushes, 1);
+  GST_PERIODIC_COUNTER_ADD (link->time, time);
+  GST_PERIODIC_COUNTER_ADD (link->blocked, time > cpu ? time - cpu : 0);
+  GST_PERIODIC_COUNTER_ADD (link->switches, exclusive[SAMPLE_SWITCHES]);
+}
+
+static void
+do_push_buffer_pre (GstOffCpuTracer * self, guint64 ts, GstPad * pad,
+    GstBuffer * buffer)
+{
+  push_frame (self, ts, pad);
+}
+
+static void
+do_push_list_pre (GstOffCpuTracer * self, guint64 ts, GstPad * pad,
+    GstBufferList * list)
+{
+  push_frame (self, ts, pad);
+}
+
+static void
+do_pull_range_pre (GstOffCpuTracer * self, guint64 ts, GstPad * pad,
+    guint64 offset, guint size)
+{
+  push_frame (self, ts, pad);
+}
+
+static void
+do_push_post (GstOffCpuTracer * self, guint64 ts, GstPad * pad,
+    GstFlowReturn res)
+{
+  pop_frame (self, ts, pad);
+}
+
+static void
+do_pull_range_post (GstOffCpuTracer * self, guint64 ts, GstPad * pad,
+    GstBuffer * buffer, GstFlowReturn res)
+{
+  pop_frame (self, ts, pad);
+}
+
+static gboolean
+do_print_off_cpu (GstPeriodicTracer * tracer)
+{
+  GstOffCpuTracer *self;
+  GstOffCpuLink *link;
+  gchar time_string[GST_SHARK_TIME_STRING_SIZE];
+  gchar blocked_string[GST_SHARK_TIME_STRING_SIZE];
+  guint64 pushes;
+  guint64 time;
+  guint64 blocked;
+  guint64 switches;
+  guint i;
+
+  self = GST_OFF_CPU_TRACER (tracer);
+
+  /* Lock the tracer to make sure no new link is added while we are logging */
+  GST_OBJECT_LOCK (self);
+
+  for (i = 0; i < self->links->len; i++) {
+    link = g_ptr_array_index (self->links, i);
+
+    pushes = GST_PERIODIC_COUNTER_TAKE (link->pushes);
+    time = GST_PERIODIC_COUNTER_TAKE (link->time);
+    blocked = GST_PERIODIC_COUNTER_TAKE (link->blocked);
+    switches = GST_PERIODIC_COUNTER_TAKE (link->switches);
+
+    /* Nothing went through the link during the period */
+    if (0 == pushes) {
+      continue;
+    }
+
+    if (gst_shark_tracer_log_enabled ()) {
+      g_snprintf (time_string, sizeof (time_string), "%" GST_TIME_FORMAT,
+          GST_TIME_ARGS (time));
+      g_snprintf (blocked_string, sizeof (blocked_string), "%"
+          GST_TIME_FORMAT, GST_TIME_ARGS (blocked));
+      gst_tracer_record_log (tr_off_cpu, link->src_pad, link->sink_pad,
+          pushes, time_string, blocked_string, switches);
+    }
+
+    do_print_offcpu_event (link->src_pad_id, link->sink_pad_id, pushes, time,
+        blocked, switches);
+  }
+
+  GST_OBJECT_UNLOCK (self);
+
+  return TRUE;
+}
+
+static void
+reset_counters (GstPeriodicTracer * tracer)
+{
+  GstOffCpuTracer *self;
+  GstOffCpuLink *link;
+  guint i;
+
+  self = GST_OFF_CPU_TRACER (tracer);
+
+  GST_OBJECT_LOCK (self);
+  for (i = 0; i < self->links->len; i++) {
+    link = g_ptr_array_index (self->links, i);
+    GST_PERIODIC_COUNTER_TAKE (link->pushes);
+    GST_PERIODIC_COUNTER_TAKE (link->time);
+    GST_PERIODIC_COUNTER_TAKE (link->blocked);
+    GST_PERIODIC_COUNTER_TAKE (link->switches);
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+create_metadata_event (GstPeriodicTracer * tracer)
+{
+  /* Add event in metadata file */
+  gst_ctf_add_event_metadata (OFFCPU_EVENT_ID);
+}
+
+/* tracer class */
+
+static void
+gst_off_cpu_tracer_finalize (GObject * obj)
+{
+  GstOffCpuTracer *self = GST_OFF_CPU_TRACER (obj);
+
+  g_ptr_array_free (self->links, TRUE);
+
+  G_OBJECT_CLASS (gst_off_cpu_tracer_parent_class)->finalize (obj);
+}
+
+static void
+gst_off_cpu_tracer_class_init (GstOffCpuTracerClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstPeriodicTracerClass *ptracer_class = GST_PERIODIC_TRACER_CLASS (klass);
+
+  gobject_class->finalize = gst_off_cpu_tracer_finalize;
+
+  ptracer_class->timer_callback = GST_DEBUG_FUNCPTR (do_print_off_cpu);
+  ptracer_class->reset = GST_DEBUG_FUNCPTR (reset_counters);
+  ptracer_class->write_header = GST_DEBUG_FUNCPTR (create_metadata_event);
+
+  tr_off_cpu = gst_tracer_record_new ("offcpu.class",
+      "src_pad", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_PAD, NULL),
+      "sink_pad", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_PAD, NULL),
+      "pushes", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "Pushes during the period",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL),
+      "time", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_PROCESS, NULL),
+      "blocked", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_PROCESS, NULL),
+      "switches", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "Voluntary context switches",
+          "flags", GST_TYPE_TRACER_VALUE_FLAGS,
+          GST_TRACER_VALUE_FLAGS_AGGREGATED, NULL), NULL);
+}
+
+static void
+gst_off_cpu_tracer_init (GstOffCpuTracer * self)
+{
+  GstTracer *tracer = GST_TRACER (self);
+  gchar *quark_name;
+
+  self->links = g_ptr_array_new_with_free_func (free_link);
+
+  /* Every instance keeps its own link in the pads */
+  quark_name = g_strdup_printf ("GstSharkOffCpu%d",
+      g_atomic_int_add (&off_cpu_instances, 1));
+  self->link_quark = g_quark_from_string (quark_name);
+  g_free (quark_name);
+
+  /* Filters are applied when the push starts, the post hooks must always
+     see the pushes to keep the per thread stack balanced */
+  gst_tracing_register_hook (tracer, "pad-push-pre",
+      G_CALLBACK (do_push_buffer_pre));
+  gst_tracing_register_hook (tracer, "pad-push-post",
+      G_CALLBACK (do_push_post));
+  gst_tracing_register_hook (tracer, "pad-push-list-pre",
+      G_CALLBACK (do_push_list_pre));
+  gst_tracing_register_hook (tracer, "pad-push-list-post",
+      G_CALLBACK (do_push_post));
+  gst_tracing_register_hook (tracer, "pad-pull-range-pre",
+      G_CALLBACK (do_pull_range_pre));
+  gst_tracing_register_hook (tracer, "pad-pull-range-post",
+      G_CALLBACK (do_pull_range_post));
+}
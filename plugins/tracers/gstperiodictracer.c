@@ -18,8 +18,17 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
 #include "gstperiodictracer.h"
 
+#ifdef HAVE_CLOCK_NANOSLEEP
+#include <errno.h>
+#include <time.h>
+#endif
+
 GST_DEBUG_CATEGORY_STATIC (gst_periodic_debug);
 #define GST_CAT_DEFAULT gst_periodic_debug
 
@@ -29,22 +38,30 @@ static void element_change_state_post (GstTracer * self, guint64 ts,
 static void install_callback (GstPeriodicTracer * self);
 static void remove_callback (GstPeriodicTracer * self);
 static void reset_internal (GstPeriodicTracer * self);
-static gboolean callback_internal (gpointer * data);
+static gboolean callback_internal (GstPeriodicTracer * self);
+static gpointer timer_thread_func (gpointer data);
 static void write_header_internal (GstPeriodicTracer * self);
-static gint set_period (GstPeriodicTracer * self);
+static GstClockTime set_period (GstPeriodicTracer * self);
+static void gst_periodic_tracer_finalize (GObject * obj);
 
 #define GST_PERIODIC_TRACER_PRIVATE(o) \
   gst_periodic_tracer_get_instance_private(GST_PERIODIC_TRACER(o))
 
-#define DEFAULT_TIMEOUT_INTERVAL 1
+#define DEFAULT_TIMEOUT_INTERVAL (GST_SECOND)
 
 typedef struct _GstPeriodicTracerPrivate GstPeriodicTracerPrivate;
 struct _GstPeriodicTracerPrivate
 {
   guint pipes_running;
-  guint callback_id;
+  /* Every timer thread started belongs to a generation, threads of an
+     older generation finish at their next tick */
+  guint timer_generation;
+  /* Held across the generation check and the callback, and while
+     resetting, so the callback of a timer thread about to finish never
+     runs along with the reset or the callback of the next one */
+  GMutex callback_lock;
   gboolean header_written;
-  gint period;
+  GstClockTime period;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GstPeriodicTracer, gst_periodic_tracer,
@@ -53,6 +70,10 @@ G_DEFINE_TYPE_WITH_PRIVATE (GstPeriodicTracer, gst_periodic_tracer,
 static void
 gst_periodic_tracer_class_init (GstPeriodicTracerClass * klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gst_periodic_tracer_finalize;
+
   GST_DEBUG_CATEGORY_INIT (gst_periodic_debug, "periodictracer", 0,
       "base periodic tracer");
 
@@ -71,7 +92,8 @@ gst_periodic_tracer_init (GstPeriodicTracer * self)
   tracer = GST_TRACER (self);
 
   priv->pipes_running = 0;
-  priv->callback_id = 0;
+  priv->timer_generation = 0;
+  g_mutex_init (&priv->callback_lock);
   priv->header_written = FALSE;
   priv->period = DEFAULT_TIMEOUT_INTERVAL;
 
@@ -79,6 +101,35 @@ gst_periodic_tracer_init (GstPeriodicTracer * self)
       G_CALLBACK (element_change_state_post));
 }
 
+static void
+gst_periodic_tracer_finalize (GObject * obj)
+{
+  GstPeriodicTracerPrivate *priv;
+
+  priv = GST_PERIODIC_TRACER_PRIVATE (obj);
+
+  g_mutex_clear (&priv->callback_lock);
+
+  G_OBJECT_CLASS (gst_periodic_tracer_parent_class)->finalize (obj);
+}
+
+GstClockTime
+gst_periodic_tracer_get_period (GstPeriodicTracer * self)
+{
+  GstPeriodicTracerPrivate *priv;
+  GstClockTime period;
+
+  g_return_val_if_fail (self, DEFAULT_TIMEOUT_INTERVAL);
+
+  priv = GST_PERIODIC_TRACER_PRIVATE (self);
+
+  GST_OBJECT_LOCK (self);
+  period = priv->period;
+  GST_OBJECT_UNLOCK (self);
+
+  return period;
+}
+
 static void
 element_change_state_post (GstTracer * tracer, guint64 ts,
     GstElement * element, GstStateChange transition,
@@ -144,6 +195,8 @@ static void
 install_callback (GstPeriodicTracer * self)
 {
   GstPeriodicTracerPrivate *priv;
+  GThread *thread;
+  GError *error = NULL;
 
   g_return_if_fail (self);
 
@@ -156,9 +209,19 @@ install_callback (GstPeriodicTracer * self)
         "First pipeline started running, starting profiling");
 
     priv->period = set_period (self);
-    priv->callback_id =
-        g_timeout_add_seconds (priv->period,
-        (GSourceFunc) callback_internal, (gpointer) self);
+    priv->timer_generation++;
+
+    /* The thread keeps the tracer alive until it finishes */
+    thread = g_thread_try_new ("GstSharkTimer", timer_thread_func,
+        gst_object_ref (self), &error);
+    if (NULL == thread) {
+      GST_ERROR_OBJECT (self, "Unable to start the timer thread: %s",
+          error->message);
+      g_error_free (error);
+      gst_object_unref (self);
+    } else {
+      g_thread_unref (thread);
+    }
   }
 
   priv->pipes_running++;
@@ -180,8 +243,9 @@ remove_callback (GstPeriodicTracer * self)
 
   if (1 == priv->pipes_running) {
     GST_INFO_OBJECT (self, "Last pipeline stopped running, stopped profiling");
-    g_source_remove (priv->callback_id);
-    priv->callback_id = 0;
+    /* The timer thread notices at its next tick, so a slow period never
+       blocks the state change */
+    priv->timer_generation++;
   }
 
   priv->pipes_running--;
@@ -194,27 +258,29 @@ static void
 reset_internal (GstPeriodicTracer * self)
 {
   GstPeriodicTracerClass *klass;
+  GstPeriodicTracerPrivate *priv;
 
   g_return_if_fail (self);
 
   klass = GST_PERIODIC_TRACER_GET_CLASS (self);
+  priv = GST_PERIODIC_TRACER_PRIVATE (self);
 
   /* It is okay if subclass didn't provide a reset implementation */
   if (klass->reset) {
     GST_DEBUG_OBJECT (self, "Resetting ourselves");
+    g_mutex_lock (&priv->callback_lock);
     klass->reset (self);
+    g_mutex_unlock (&priv->callback_lock);
   }
 }
 
 static gboolean
-callback_internal (gpointer * data)
+callback_internal (GstPeriodicTracer * self)
 {
-  GstPeriodicTracer *self;
   GstPeriodicTracerClass *klass;
 
-  g_return_val_if_fail (data, FALSE);
+  g_return_val_if_fail (self, FALSE);
 
-  self = GST_PERIODIC_TRACER (data);
   klass = GST_PERIODIC_TRACER_GET_CLASS (self);
 
   /* This is a required method, if no implementation was provided, we
@@ -224,13 +290,108 @@ callback_internal (gpointer * data)
   return klass->timer_callback (self);
 }
 
-static gint
+static GstClockTime
+timer_now (void)
+{
+#ifdef HAVE_CLOCK_NANOSLEEP
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return GST_TIMESPEC_TO_TIME (now);
+#else
+  return g_get_monotonic_time () * GST_USECOND;
+#endif
+}
+
+static void
+timer_sleep_until (GstClockTime deadline)
+{
+#ifdef HAVE_CLOCK_NANOSLEEP
+  struct timespec until;
+
+  GST_TIME_TO_TIMESPEC (deadline, until);
+
+  /* Sleep again if a signal interrupted us */
+  while (EINTR == clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &until,
+          NULL));
+#else
+  GstClockTime now = timer_now ();
+
+  if (deadline > now) {
+    g_usleep ((deadline - now) / GST_USECOND);
+  }
+#endif
+}
+
+/* Ticks are scheduled at absolute deadlines, so the time taken by the
+   callback does not accumulate as drift */
+static gpointer
+timer_thread_func (gpointer data)
+{
+  GstPeriodicTracer *self;
+  GstPeriodicTracerPrivate *priv;
+  GstClockTime period;
+  GstClockTime deadline;
+  GstClockTime now;
+  guint generation;
+  gboolean running;
+
+  self = GST_PERIODIC_TRACER (data);
+  priv = GST_PERIODIC_TRACER_PRIVATE (self);
+
+  GST_OBJECT_LOCK (self);
+  generation = priv->timer_generation;
+  period = priv->period;
+  GST_OBJECT_UNLOCK (self);
+
+  GST_DEBUG_OBJECT (self, "Timer ticking every %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (period));
+
+  deadline = timer_now () + period;
+
+  do {
+    timer_sleep_until (deadline);
+
+    g_mutex_lock (&priv->callback_lock);
+
+    GST_OBJECT_LOCK (self);
+    running = generation == priv->timer_generation;
+    GST_OBJECT_UNLOCK (self);
+
+    if (running) {
+      running = callback_internal (self);
+    }
+
+    g_mutex_unlock (&priv->callback_lock);
+
+    deadline += period;
+
+    /* Skip the ticks we are already late for instead of bursting */
+    now = timer_now ();
+    if (G_UNLIKELY (now >= deadline)) {
+      guint64 missed = (now - deadline) / period + 1;
+
+      GST_WARNING_OBJECT (self, "Timer overrun, skipping %" G_GUINT64_FORMAT
+          " ticks", missed);
+      deadline += missed * period;
+    }
+  } while (running);
+
+  GST_DEBUG_OBJECT (self, "Timer stopped");
+
+  gst_object_unref (self);
+
+  return NULL;
+}
+
+static GstClockTime
 set_period (GstPeriodicTracer * self)
 {
   GList *list = NULL;
   GstSharkTracer *tracer = NULL;
   static const gchar *name = "period";
-  gint period = -1;
+  GstClockTime period;
 
   g_return_val_if_fail (self, DEFAULT_TIMEOUT_INTERVAL);
 
@@ -239,15 +400,16 @@ set_period (GstPeriodicTracer * self)
   list = gst_shark_tracer_get_param (tracer, name);
 
   if (NULL == list) {
-    GST_INFO_OBJECT (self, "No period specifying, using default of %d",
-        DEFAULT_TIMEOUT_INTERVAL);
+    GST_INFO_OBJECT (self, "No period specifying, using default of %"
+        GST_TIME_FORMAT, GST_TIME_ARGS (DEFAULT_TIMEOUT_INTERVAL));
     period = DEFAULT_TIMEOUT_INTERVAL;
   } else {
     GST_INFO_OBJECT (self, "Attempting to parse provided period \"%s\"",
         (gchar *) list->data);
-    period = g_ascii_strtoull (list->data, NULL, 0);
-    /* On error, 0 is set */
-    if (0 == period) {
+    /* A period without unit is in seconds, as it always was */
+    period = gst_shark_tracer_parse_time (list->data, GST_SECOND);
+    if (!GST_CLOCK_TIME_IS_VALID (period) || 0 == period) {
+      GST_ERROR_OBJECT (self, "Invalid period \"%s\"", (gchar *) list->data);
       period = DEFAULT_TIMEOUT_INTERVAL;
     }
   }
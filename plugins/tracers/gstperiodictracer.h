@@ -25,6 +25,20 @@
 
 G_BEGIN_DECLS
 
+/* Counters updated by the streaming threads and collected by the timer.
+   Only the counts have to be atomic, so no ordering is imposed. */
+#ifdef __ATOMIC_RELAXED
+#define GST_PERIODIC_COUNTER_ADD(counter, value) \
+  ((void) __atomic_fetch_add (&(counter), (value), __ATOMIC_RELAXED))
+#define GST_PERIODIC_COUNTER_TAKE(counter) \
+  __atomic_exchange_n (&(counter), 0, __ATOMIC_RELAXED)
+#else
+#define GST_PERIODIC_COUNTER_ADD(counter, value) \
+  ((void) __sync_fetch_and_add (&(counter), (value)))
+#define GST_PERIODIC_COUNTER_TAKE(counter) \
+  __sync_lock_test_and_set (&(counter), 0)
+#endif
+
 #define GST_TYPE_PERIODIC_TRACER (gst_periodic_tracer_get_type())
 G_DECLARE_DERIVABLE_TYPE (GstPeriodicTracer, gst_periodic_tracer, GST, PERIODIC_TRACER, GstSharkTracer)
 
@@ -37,6 +51,8 @@ struct _GstPeriodicTracerClass
   void (* write_header) (GstPeriodicTracer * tracer);
 };
 
+GstClockTime gst_periodic_tracer_get_period (GstPeriodicTracer * self);
+
 G_END_DECLS
 
 #endif /* __GST_PERIODIC_TRACER_H__ */
@@ -28,6 +28,9 @@
 #include "gstgraphic.h"
 #include "gstcpuusage.h"
 #include "gstproctime.h"
+#include "gstcputime.h"
+#include "gststackprofile.h"
+#include "gstoffcpu.h"
 #include "gstinterlatency.h"
 #include "gstscheduletime.h"
 #include "gstframerate.h"
@@ -52,6 +55,18 @@ plugin_init (GstPlugin * plugin)
           gst_proc_time_tracer_get_type ())) {
     return FALSE;
   }
+  if (!gst_tracer_register (plugin, "cputime",
+          gst_cpu_time_tracer_get_type ())) {
+    return FALSE;
+  }
+  if (!gst_tracer_register (plugin, "stackprofile",
+          gst_stack_profile_tracer_get_type ())) {
+    return FALSE;
+  }
+  if (!gst_tracer_register (plugin, "offcpu",
+          gst_off_cpu_tracer_get_type ())) {
+    return FALSE;
+  }
   if (!gst_tracer_register (plugin, "interlatency",
           gst_interlatency_tracer_get_type ())) {
     return FALSE;
@@ -22,10 +22,26 @@
  * @short_description: log cpu usage stats
  *
  * A tracing module that take proctime() snapshots and logs them.
+ *
+ * Elements with several sink or src pads are measured per pad pair, from
+ * the input they are processing when they push an output. This only works
+ * when the output is pushed from the thread that pushed the input, so
+ * elements that push from their own thread, like aggregators and
+ * compositors, or that pull their input, like demuxers in pull mode, are
+ * not reported.
+ *
+ * With correlate=buffer every input buffer is followed through the
+ * element by its PTS, or offset, so elements holding several buffers
+ * (queues, encoders, jitterbuffers) report the time each buffer spent
+ * inside them.
+ *
+ * With aggregate=<window> the times are not logged one by one, each window
+ * logs their count, min, max, mean and percentiles instead.
  */
 
 #include "gstproctimecompute.h"
 #include "gstproctime.h"
+#include "gstaggregate.h"
 #include "gstctf.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_proc_time_debug);
@@ -41,6 +57,8 @@ struct _GstProcTimeTracer
   GstSharkTracer parent;
 
   GstProcTime *proc_time;
+  GstSharkAggregate *aggregate;
+  GstSharkAggregate *pads_aggregate;
 };
 
 #define _do_init \
@@ -50,58 +68,95 @@ G_DEFINE_TYPE_WITH_CODE (GstProcTimeTracer, gst_proc_time_tracer,
     GST_SHARK_TYPE_TRACER, _do_init);
 
 static GstTracerRecord *tr_proc_time;
-
-static const gchar proc_time_metadata_event[] = "event {\n\
-    name = proctime;\n\
-    id = %d;\n\
-    stream_id = %d;\n\
-    fields := struct {\n\
-        string element; \n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _time;\n\
-    };\n\
-};\n\
-\n";
+static GstTracerRecord *tr_proc_time_pads;
 
 static void
-do_push_buffer_pre (GstTracer * self, guint64 ts, GstPad * pad)
+do_push_buffer_pre (GstTracer * self, guint64 ts, GstPad * pad,
+    GstBuffer * buffer)
 {
   GstProcTimeTracer *proc_time_tracer;
   GstSharkTracer *shark_tracer;
   GstProcTime *proc_time;
 
   GstPad *pad_peer;
-  gchar *name;
+  GstPad *sink_pad;
+  GstElement *element;
   GstClockTime time;
-  gchar *time_string;
+  gchar time_string[GST_SHARK_TIME_STRING_SIZE];
   gboolean should_log;
   gboolean should_calculate;
 
   proc_time_tracer = GST_PROC_TIME_TRACER (self);
   shark_tracer = GST_SHARK_TRACER (proc_time_tracer);
   proc_time = proc_time_tracer->proc_time;
-  name = GST_OBJECT_NAME (GST_OBJECT_PARENT (pad));
 
   pad_peer = gst_pad_get_peer (pad);
   if (!pad_peer) {
     return;
   }
 
-  should_calculate = gst_shark_tracer_element_is_filtered (shark_tracer, name);
+  should_calculate =
+      gst_shark_tracer_object_is_filtered (shark_tracer,
+      GST_OBJECT_PARENT (pad));
   should_log =
-      gst_proctime_proc_time (proc_time, &time, pad_peer, pad, ts,
+      gst_proctime_proc_time (proc_time, &time, pad_peer, pad, buffer, ts,
       should_calculate);
 
   if (should_log) {
-    time_string = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (time));
+    element = GST_ELEMENT (GST_OBJECT_PARENT (pad));
+
+    if (NULL != proc_time_tracer->aggregate) {
+      gst_shark_aggregate_add (proc_time_tracer->aggregate, ts,
+          gst_ctf_element_name_id (element), GST_OBJECT_NAME (element), 0,
+          NULL, time);
+    } else {
+      if (gst_shark_tracer_log_enabled ()) {
+        g_snprintf (time_string, sizeof (time_string), "%" GST_TIME_FORMAT,
+            GST_TIME_ARGS (time));
+        gst_tracer_record_log (tr_proc_time, GST_OBJECT_NAME (element),
+            time_string);
+      }
+
+      do_print_proctime_event (gst_ctf_element_name_id (element), time);
+    }
+    gst_ctf_snapshot_on_threshold (PROCTIME_EVENT_ID, time);
+  } else if (should_calculate &&
+      gst_proctime_pad_proc_time (proc_time, &time, &sink_pad, pad, ts)) {
+    /* Elements with several pads are reported per pad pair */
+    if (NULL != proc_time_tracer->pads_aggregate) {
+      gst_shark_aggregate_add (proc_time_tracer->pads_aggregate, ts,
+          gst_ctf_pad_name_id (sink_pad), gst_shark_tracer_pad_name (sink_pad),
+          gst_ctf_pad_name_id (pad), gst_shark_tracer_pad_name (pad), time);
+    } else {
+      if (gst_shark_tracer_log_enabled ()) {
+        g_snprintf (time_string, sizeof (time_string), "%" GST_TIME_FORMAT,
+            GST_TIME_ARGS (time));
+        gst_tracer_record_log (tr_proc_time_pads,
+            gst_shark_tracer_pad_name (sink_pad),
+            gst_shark_tracer_pad_name (pad), time_string);
+      }
+
+      do_print_proctime_pads_event (gst_ctf_pad_name_id (sink_pad),
+          gst_ctf_pad_name_id (pad), time);
+    }
+    gst_ctf_snapshot_on_threshold (PROCTIME_EVENT_ID, time);
+  }
+
+  /* The downstream element processes this buffer until the push returns */
+  gst_proctime_push_input (proc_time, pad_peer, pad, ts);
 
-    gst_tracer_record_log (tr_proc_time, name, time_string);
+  gst_object_unref (pad_peer);
+}
 
-    do_print_proctime_event (PROCTIME_EVENT_ID, name, time);
+static void
+do_push_buffer_post (GstTracer * self, guint64 ts, GstPad * pad,
+    GstFlowReturn res)
+{
+  GstProcTimeTracer *proc_time_tracer;
 
-    g_free (time_string);
-  }
+  proc_time_tracer = GST_PROC_TIME_TRACER (self);
 
-  gst_object_unref (pad_peer);
+  gst_proctime_pop_input (proc_time_tracer->proc_time, pad, ts);
 }
 
 static void
@@ -116,8 +171,62 @@ do_element_new (GObject * self, GstClockTime ts, GstElement * element)
   gst_proctime_add_new_element (proc_time, element);
 }
 
+static void
+do_element_add_pad (GObject * self, GstClockTime ts, GstElement * element,
+    GstPad * pad)
+{
+  GstProcTimeTracer *proc_time_tracer;
+
+  proc_time_tracer = GST_PROC_TIME_TRACER (self);
+
+  /* Elements with sometimes or request pads may become 1:1 later */
+  gst_proctime_add_new_element (proc_time_tracer->proc_time, element);
+}
+
+static void
+do_element_remove_pad (GObject * self, GstClockTime ts, GstElement * element,
+    GstPad * pad)
+{
+  GstProcTimeTracer *proc_time_tracer;
+
+  proc_time_tracer = GST_PROC_TIME_TRACER (self);
+
+  gst_proctime_remove_pad (proc_time_tracer->proc_time, pad);
+}
+
 /* tracer class */
 
+static void
+gst_proc_time_tracer_constructed (GObject * obj)
+{
+  GstProcTimeTracer *self;
+  GList *correlate;
+  GstClockTime window;
+
+  /* Let the parent parse the params */
+  G_OBJECT_CLASS (gst_proc_time_tracer_parent_class)->constructed (obj);
+
+  self = GST_PROC_TIME_TRACER (obj);
+
+  correlate = gst_shark_tracer_get_param (GST_SHARK_TRACER (self),
+      "correlate");
+  if (NULL != correlate) {
+    if (0 == g_strcmp0 (correlate->data, "buffer")) {
+      GST_INFO_OBJECT (self, "Correlating buffers by PTS or offset");
+      gst_proctime_set_correlate (self->proc_time, TRUE);
+    } else {
+      GST_ERROR_OBJECT (self, "Unknown correlation mode \"%s\"",
+          (gchar *) correlate->data);
+    }
+  }
+
+  window = gst_shark_aggregate_get_window (GST_SHARK_TRACER (self));
+  if (GST_CLOCK_TIME_IS_VALID (window)) {
+    self->aggregate = gst_shark_aggregate_new ("proctime", window);
+    self->pads_aggregate = gst_shark_aggregate_new ("proctimepads", window);
+  }
+}
+
 static void
 gst_proc_time_tracer_finalize (GObject * obj)
 {
@@ -128,6 +237,11 @@ gst_proc_time_tracer_finalize (GObject * obj)
   gst_proctime_free (self->proc_time);
   self->proc_time = NULL;
 
+  gst_shark_aggregate_free (self->aggregate);
+  self->aggregate = NULL;
+  gst_shark_aggregate_free (self->pads_aggregate);
+  self->pads_aggregate = NULL;
+
   G_OBJECT_CLASS (gst_proc_time_tracer_parent_class)->finalize (obj);
 }
 
@@ -137,6 +251,7 @@ gst_proc_time_tracer_class_init (GstProcTimeTracerClass * klass)
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
 
+  gobject_class->constructed = gst_proc_time_tracer_constructed;
   gobject_class->finalize = gst_proc_time_tracer_finalize;
 
   tr_proc_time = gst_tracer_record_new ("proctime.class",
@@ -147,6 +262,20 @@ gst_proc_time_tracer_class_init (GstProcTimeTracerClass * klass)
       gst_structure_new ("scope", "type", G_TYPE_GTYPE, G_TYPE_STRING,
           "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
           GST_TRACER_VALUE_SCOPE_PROCESS, NULL), NULL);
+
+  tr_proc_time_pads = gst_tracer_record_new ("proctimepads.class",
+      "sink_pad", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_PAD, NULL),
+      "src_pad", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_PAD, NULL),
+      "time", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_PROCESS, NULL), NULL);
 }
 
 
@@ -154,18 +283,24 @@ static void
 gst_proc_time_tracer_init (GstProcTimeTracer * self)
 {
   GstTracer *tracer = GST_TRACER (self);
-  gchar *metadata_event = NULL;
 
   self->proc_time = gst_proctime_new ();
 
   gst_tracing_register_hook (tracer, "pad-push-pre",
       G_CALLBACK (do_push_buffer_pre));
 
+  gst_tracing_register_hook (tracer, "pad-push-post",
+      G_CALLBACK (do_push_buffer_post));
+
   gst_tracing_register_hook (tracer, "element-new",
       G_CALLBACK (do_element_new));
 
-  metadata_event =
-      g_strdup_printf (proc_time_metadata_event, PROCTIME_EVENT_ID, 0);
-  add_metadata_event_struct (metadata_event);
-  g_free (metadata_event);
+  gst_tracing_register_hook (tracer, "element-add-pad",
+      G_CALLBACK (do_element_add_pad));
+
+  gst_tracing_register_hook (tracer, "element-remove-pad",
+      G_CALLBACK (do_element_remove_pad));
+
+  gst_ctf_add_event_metadata (PROCTIME_EVENT_ID);
+  gst_ctf_add_event_metadata (PROCTIME_PADS_EVENT_ID);
 }
@@ -23,56 +23,287 @@
 typedef struct _GstProcTimeElement GstProcTimeElement;
 struct _GstProcTimeElement
 {
+  /* Owned by the list of elements, the qdata of both pads and the buffer
+     hooks using it */
+  gint ref_count;
   GstPad *src_pad;
   GstPad *sink_pad;
   GstClockTime start_time;
+  /* Buffers inside the element when correlating, oldest first. Inputs
+     and outputs may happen in different threads. */
+  GArray *pending;
+  GMutex mutex;
+  /* The outputs do not match the inputs, e.g. the element rewrites the
+     timestamps, so it is measured as if not correlating */
+  gint mismatch;
 };
 
+/* Buffer inside an element, identified by its PTS or offset */
+typedef struct _GstProcTimePending GstProcTimePending;
+struct _GstProcTimePending
+{
+  guint64 key;
+  GstClockTime start_time;
+};
+
+/* Elements with more inputs never matched by an output are not
+   correlated anymore */
+#define PROCTIME_MAX_PENDING (1024)
+
+/* Every tracked element is attached to both of its pads as qdata, so the
+ * buffer hooks find it in constant time. The buffer hooks take their own
+ * reference with g_object_dup_qdata and never lock, an element stopped
+ * being tracked meanwhile is only freed once they release it. The mutex
+ * serializes the changes done when pads are added or removed.
+ */
 struct _GstProcTime
 {
   GList *elements;
+  GMutex mutex;
+  GQuark quark;
+  gboolean correlate;
 };
 
-static void free_element (gpointer data);
+/* Buffer pushed into an element by the current thread. Elements with
+ * several pads are measured from the input being processed when they push
+ * on one of their src pads, without the time spent downstream by the
+ * pushes they already did for that input (e.g. other tee branches).
+ */
+typedef struct _GstProcTimeInput GstProcTimeInput;
+struct _GstProcTimeInput
+{
+  GstPad *src_pad;
+  GstPad *sink_pad;
+  GstClockTime start_time;
+  GstClockTime children_time;
+};
+
+static volatile gint proctime_count = 0;
+
+static void free_inputs (gpointer data);
+static GPrivate proctime_inputs = G_PRIVATE_INIT (free_inputs);
+
 static void gst_proctime_add_in_list (GstProcTime * proc_time,
     GstPad * sink_pad, GstPad * src_pad);
 
+static GstProcTimeElement *
+gst_proctime_element_ref (GstProcTimeElement * element)
+{
+  g_atomic_int_inc (&element->ref_count);
+
+  return element;
+}
+
 static void
-free_element (gpointer data)
+gst_proctime_element_unref (gpointer data)
 {
   GstProcTimeElement *element;
 
   element = (GstProcTimeElement *) data;
 
+  if (!g_atomic_int_dec_and_test (&element->ref_count)) {
+    return;
+  }
+
   gst_object_unref (element->src_pad);
   element->src_pad = NULL;
 
   gst_object_unref (element->sink_pad);
   element->sink_pad = NULL;
 
+  if (NULL != element->pending) {
+    g_array_unref (element->pending);
+    g_mutex_clear (&element->mutex);
+  }
+
   g_free (element);
 }
 
+static void
+free_inputs (gpointer data)
+{
+  g_array_unref ((GArray *) data);
+}
+
+/* Stack of the pushes in progress in the current thread */
+static GArray *
+gst_proctime_get_inputs (void)
+{
+  GArray *inputs;
+
+  inputs = g_private_get (&proctime_inputs);
+  if (G_UNLIKELY (NULL == inputs)) {
+    inputs = g_array_sized_new (FALSE, FALSE, sizeof (GstProcTimeInput), 16);
+    g_private_set (&proctime_inputs, inputs);
+  }
+
+  return inputs;
+}
+
+/* Element attached to the pad, only valid with the mutex held */
+static inline GstProcTimeElement *
+gst_proctime_get_element (GstProcTime * proc_time, GstPad * pad)
+{
+  return g_object_get_qdata (G_OBJECT (pad), proc_time->quark);
+}
+
+static gpointer
+gst_proctime_dup_element (gpointer data, gpointer user_data)
+{
+  if (NULL == data) {
+    return NULL;
+  }
+
+  return gst_proctime_element_ref ((GstProcTimeElement *) data);
+}
+
+/* Element attached to the pad, if any, with a reference the caller has to
+ * release with gst_proctime_element_unref. The reference is taken while the
+ * qdata is locked, so it can be used without the mutex.
+ */
+static inline GstProcTimeElement *
+gst_proctime_ref_element (GstProcTime * proc_time, GstPad * pad)
+{
+  return g_object_dup_qdata (G_OBJECT (pad), proc_time->quark,
+      gst_proctime_dup_element, NULL);
+}
+
+/* Attach the element to the pad, which holds a reference until detached */
+static void
+gst_proctime_attach_element (GstProcTime * proc_time,
+    GstProcTimeElement * element, GstPad * pad)
+{
+  g_object_set_qdata_full (G_OBJECT (pad), proc_time->quark,
+      gst_proctime_element_ref (element), gst_proctime_element_unref);
+}
+
+/* Detach the element from its pads and release the reference of the list,
+ * with mutex held */
+static void
+gst_proctime_detach_element (GstProcTime * proc_time,
+    GstProcTimeElement * element)
+{
+  g_object_set_qdata (G_OBJECT (element->sink_pad), proc_time->quark, NULL);
+  g_object_set_qdata (G_OBJECT (element->src_pad), proc_time->quark, NULL);
+  gst_proctime_element_unref (element);
+}
+
 GstProcTime *
 gst_proctime_new (void)
 {
   GstProcTime *self;
+  gchar *quark_name;
 
   self = g_malloc (sizeof (GstProcTime));
 
   g_return_val_if_fail (self, NULL);
 
   self->elements = NULL;
+  g_mutex_init (&self->mutex);
+  self->correlate = FALSE;
+
+  quark_name = g_strdup_printf ("GstSharkProcTime%d",
+      g_atomic_int_add (&proctime_count, 1));
+  self->quark = g_quark_from_string (quark_name);
+  g_free (quark_name);
 
   return self;
 }
 
+void
+gst_proctime_set_correlate (GstProcTime * self, gboolean correlate)
+{
+  g_return_if_fail (self);
+
+  /* Elements already tracked keep their mode */
+  self->correlate = correlate;
+}
+
+/* Key used to find the buffer at the output of the element, FALSE if the
+ * buffer can not be identified.
+ */
+static gboolean
+gst_proctime_buffer_key (GstBuffer * buffer, guint64 * key)
+{
+  if (NULL == buffer) {
+    return FALSE;
+  }
+
+  if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+    *key = GST_BUFFER_PTS (buffer);
+  } else if (GST_BUFFER_OFFSET_IS_VALID (buffer)) {
+    *key = GST_BUFFER_OFFSET (buffer);
+  } else {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+gst_proctime_pending_push (GstProcTimeElement * element, guint64 key,
+    GstClockTime ts)
+{
+  GstProcTimePending pending;
+
+  pending.key = key;
+  pending.start_time = ts;
+
+  g_mutex_lock (&element->mutex);
+  if (element->pending->len >= PROCTIME_MAX_PENDING) {
+    GST_WARNING_OBJECT (element->src_pad, "Too many buffers without a "
+        "matching output, the element may modify their timestamps. Not "
+        "correlating its buffers anymore");
+    g_array_set_size (element->pending, 0);
+    g_atomic_int_set (&element->mismatch, TRUE);
+  } else {
+    g_array_append_val (element->pending, pending);
+  }
+  g_mutex_unlock (&element->mutex);
+}
+
+static inline gboolean
+gst_proctime_correlates (GstProcTimeElement * element)
+{
+  return NULL != element->pending && !g_atomic_int_get (&element->mismatch);
+}
+
+/* Find and remove the oldest input with the given key */
+static gboolean
+gst_proctime_pending_pop (GstProcTimeElement * element, guint64 key,
+    GstClockTime * start_time)
+{
+  GstProcTimePending *pending;
+  gboolean found = FALSE;
+  guint i;
+
+  g_mutex_lock (&element->mutex);
+  for (i = 0; i < element->pending->len; ++i) {
+    pending = &g_array_index (element->pending, GstProcTimePending, i);
+    if (pending->key == key) {
+      *start_time = pending->start_time;
+      g_array_remove_index (element->pending, i);
+      found = TRUE;
+      break;
+    }
+  }
+  g_mutex_unlock (&element->mutex);
+
+  return found;
+}
+
 void
 gst_proctime_free (GstProcTime * self)
 {
+  GList *node;
+
   g_return_if_fail (self);
 
-  g_list_free_full (self->elements, free_element);
+  for (node = self->elements; NULL != node; node = g_list_next (node)) {
+    gst_proctime_detach_element (self, (GstProcTimeElement *) node->data);
+  }
+  g_list_free (self->elements);
+  g_mutex_clear (&self->mutex);
   g_free (self);
 }
 
@@ -90,13 +321,34 @@ gst_proctime_add_in_list (GstProcTime * proc_time, GstPad * sink_pad,
   g_return_if_fail (sink_pad);
   g_return_if_fail (src_pad);
 
+  g_mutex_lock (&proc_time->mutex);
+
+  /* Elements are evaluated again when their pads change */
+  if (NULL != gst_proctime_get_element (proc_time, sink_pad) ||
+      NULL != gst_proctime_get_element (proc_time, src_pad)) {
+    goto out;
+  }
+
   new_element = g_malloc0 (sizeof (GstProcTimeElement));
+  new_element->ref_count = 1;
   new_element->start_time = GST_CLOCK_TIME_NONE;
 
   new_element->sink_pad = gst_object_ref (sink_pad);
   new_element->src_pad = gst_object_ref (src_pad);
 
-  proc_time->elements = g_list_append (proc_time->elements, new_element);
+  if (proc_time->correlate) {
+    new_element->pending =
+        g_array_new (FALSE, FALSE, sizeof (GstProcTimePending));
+    g_mutex_init (&new_element->mutex);
+  }
+
+  proc_time->elements = g_list_prepend (proc_time->elements, new_element);
+
+  gst_proctime_attach_element (proc_time, new_element, sink_pad);
+  gst_proctime_attach_element (proc_time, new_element, src_pad);
+
+out:
+  g_mutex_unlock (&proc_time->mutex);
 }
 
 void
@@ -120,7 +372,7 @@ gst_proctime_add_new_element (GstProcTime * proc_time, GstElement * element)
     num_src_pads++;
 
     if (num_src_pads > 1) {
-      goto out;
+      break;
     }
   }
 
@@ -131,85 +383,214 @@ gst_proctime_add_new_element (GstProcTime * proc_time, GstElement * element)
     num_sink_pads++;
 
     if (num_sink_pads > 1) {
-      goto out;
+      break;
     }
   }
 
   /* We are only interested in elements with one sink and src pad */
   if (num_src_pads == 1 && num_sink_pads == 1) {
     gst_proctime_add_in_list (proc_time, sink_pad, src_pad);
+  } else if (num_sink_pads == 1) {
+    /* Stop tracking elements that got a second pad */
+    gst_proctime_remove_pad (proc_time, sink_pad);
+  } else if (num_src_pads == 1) {
+    gst_proctime_remove_pad (proc_time, src_pad);
   }
 
-out:
-  {
-    g_value_unset (&vpad);
+  g_value_unset (&vpad);
 
-    if (NULL != src_iterator) {
-      gst_iterator_free (src_iterator);
-    }
+  if (NULL != src_iterator) {
+    gst_iterator_free (src_iterator);
+  }
 
-    if (NULL != sink_iterator) {
-      gst_iterator_free (sink_iterator);
-    }
+  if (NULL != sink_iterator) {
+    gst_iterator_free (sink_iterator);
+  }
+}
+
+void
+gst_proctime_remove_pad (GstProcTime * proc_time, GstPad * pad)
+{
+  GstProcTimeElement *element;
+
+  g_return_if_fail (proc_time);
+  g_return_if_fail (pad);
+
+  g_mutex_lock (&proc_time->mutex);
+
+  element = gst_proctime_get_element (proc_time, pad);
+  if (NULL != element) {
+    proc_time->elements = g_list_remove (proc_time->elements, element);
+    gst_proctime_detach_element (proc_time, element);
   }
+
+  g_mutex_unlock (&proc_time->mutex);
 }
 
 gboolean
 gst_proctime_proc_time (GstProcTime * proc_time, GstClockTime * time,
-    GstPad * peer_pad, GstPad * src_pad, GstClockTime ts,
+    GstPad * peer_pad, GstPad * src_pad, GstBuffer * buffer, GstClockTime ts,
     gboolean do_calculation)
 {
   GstProcTimeElement *element;
+  GstClockTime start_time;
   GstClockTime stop_time;
-  guint elem_num;
-  gint elem_idx;
-  gboolean found = FALSE;
+  gboolean res;
+  guint64 key;
+  gboolean has_key;
 
   g_return_val_if_fail (proc_time, FALSE);
   g_return_val_if_fail (time, FALSE);
   g_return_val_if_fail (src_pad, FALSE);
   g_return_val_if_fail (peer_pad, FALSE);
 
-  elem_num = g_list_length (proc_time->elements);
-  /* Search the peer pad in the list 
-   * The peer pad is used to identify which is the element where the 
+  /* The peer pad is used to identify which is the element where the 
    * buffer is received.
    */
-  for (elem_idx = 0; elem_idx < elem_num; ++elem_idx) {
-    element = g_list_nth_data (proc_time->elements, elem_idx);
+  has_key = gst_proctime_buffer_key (buffer, &key);
+
+  element = gst_proctime_ref_element (proc_time, peer_pad);
+  if (NULL != element) {
     if (element->sink_pad == peer_pad) {
+      if (gst_proctime_correlates (element) && has_key) {
+        gst_proctime_pending_push (element, key, ts);
+      }
+      /* Kept in any case, in case the element stops being correlated */
       element->start_time = ts;
     }
+    gst_proctime_element_unref (element);
   }
 
-  if (!do_calculation)
-    goto exit;
-
-  /* Search the src pad in the list 
-   * The peer pad is used to identify which is the element where the 
+  /* The src pad is used to identify which is the element where the 
    * buffer was processed.
-   * If the src pad is not in the list, then it is a src element and the
+   * If the src pad is not tracked, then it is a src element and the
    * precessing time is not computed
    */
-  for (elem_idx = 0; elem_idx < elem_num; ++elem_idx) {
-    element = g_list_nth_data (proc_time->elements, elem_idx);
-    if (element->src_pad == src_pad) {
-      stop_time = ts;
-      if (stop_time > element->start_time) {
-        *time = stop_time - element->start_time;
-      } else {
-        /* FIXME: For elements storing buffers (e.g queues) there are
-           timestamps mismatches sometimes, because more than 1 buffer
-           is pushed before getting 1 at the output */
-        GST_WARNING_OBJECT (element->src_pad,
-            "Timestamps mismatch, this should not happen");
-        found = FALSE;
-        goto exit;
-      }
-      found = TRUE;
+  element = gst_proctime_ref_element (proc_time, src_pad);
+  if (NULL == element) {
+    return FALSE;
+  }
+
+  res = FALSE;
+  if (element->src_pad != src_pad) {
+    goto out;
+  }
+
+  /* Elements holding several buffers are measured per buffer, the input
+     is released even if the time is not computed */
+  if (gst_proctime_correlates (element) && has_key) {
+    if (gst_proctime_pending_pop (element, key, &start_time) &&
+        do_calculation && ts >= start_time) {
+      *time = ts - start_time;
+      res = TRUE;
     }
+    goto out;
   }
 
-exit:
-  return found;
+  if (!do_calculation)
+    goto out;
+
+  stop_time = ts;
+  if (stop_time > element->start_time) {
+    *time = stop_time - element->start_time;
+    res = TRUE;
+  } else if (!g_atomic_int_get (&element->mismatch)) {
+    /* For elements storing buffers (e.g queues) there are timestamps
+       mismatches sometimes, because more than 1 buffer is pushed before
+       getting 1 at the output. The correlation mode handles them. */
+    GST_WARNING_OBJECT (element->src_pad,
+        "Timestamps mismatch, this should not happen");
+  }
+
+out:
+  gst_proctime_element_unref (element);
+
+  return res;
+}
+
+void
+gst_proctime_push_input (GstProcTime * proc_time, GstPad * peer_pad,
+    GstPad * src_pad, GstClockTime ts)
+{
+  GstProcTimeInput input;
+
+  g_return_if_fail (proc_time);
+  g_return_if_fail (peer_pad);
+  g_return_if_fail (src_pad);
+
+  input.src_pad = src_pad;
+  input.sink_pad = peer_pad;
+  input.start_time = ts;
+  input.children_time = 0;
+
+  g_array_append_val (gst_proctime_get_inputs (), input);
+}
+
+void
+gst_proctime_pop_input (GstProcTime * proc_time, GstPad * src_pad,
+    GstClockTime ts)
+{
+  GstProcTimeInput *input;
+  GstProcTimeInput *parent;
+  GArray *inputs;
+
+  g_return_if_fail (proc_time);
+  g_return_if_fail (src_pad);
+
+  inputs = gst_proctime_get_inputs ();
+  if (0 == inputs->len) {
+    return;
+  }
+
+  input = &g_array_index (inputs, GstProcTimeInput, inputs->len - 1);
+  if (input->src_pad != src_pad) {
+    return;
+  }
+
+  /* The push belongs to the processing of the enclosing input */
+  if (inputs->len > 1 && ts > input->start_time) {
+    parent = &g_array_index (inputs, GstProcTimeInput, inputs->len - 2);
+    parent->children_time += ts - input->start_time;
+  }
+  g_array_set_size (inputs, inputs->len - 1);
+}
+
+gboolean
+gst_proctime_pad_proc_time (GstProcTime * proc_time, GstClockTime * time,
+    GstPad ** sink_pad, GstPad * src_pad, GstClockTime ts)
+{
+  GstProcTimeElement *element;
+  GstProcTimeInput *input;
+  GArray *inputs;
+
+  g_return_val_if_fail (proc_time, FALSE);
+  g_return_val_if_fail (time, FALSE);
+  g_return_val_if_fail (sink_pad, FALSE);
+  g_return_val_if_fail (src_pad, FALSE);
+
+  /* Elements with one sink and src pad are handled by
+     gst_proctime_proc_time */
+  element = gst_proctime_ref_element (proc_time, src_pad);
+  if (NULL != element) {
+    gst_proctime_element_unref (element);
+    return FALSE;
+  }
+
+  inputs = gst_proctime_get_inputs ();
+  if (0 == inputs->len) {
+    return FALSE;
+  }
+
+  /* The element pushes while processing the last buffer it received in
+     this thread, otherwise the output can not be related to an input */
+  input = &g_array_index (inputs, GstProcTimeInput, inputs->len - 1);
+  if (GST_OBJECT_PARENT (input->sink_pad) != GST_OBJECT_PARENT (src_pad) ||
+      ts < input->start_time + input->children_time) {
+    return FALSE;
+  }
+
+  *sink_pad = input->sink_pad;
+  *time = ts - input->start_time - input->children_time;
+
+  return TRUE;
 }
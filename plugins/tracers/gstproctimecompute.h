@@ -29,12 +29,27 @@ typedef struct _GstProcTime GstProcTime;
 
 GstProcTime *gst_proctime_new (void);
 
+void gst_proctime_set_correlate (GstProcTime * proc_time,
+    gboolean correlate);
+
 void gst_proctime_add_new_element (GstProcTime * proc_time,
     GstElement * element);
 
+void gst_proctime_remove_pad (GstProcTime * proc_time, GstPad * pad);
+
 gboolean gst_proctime_proc_time (GstProcTime * proc_time,
     GstClockTime * time, GstPad * peer_pad, GstPad * src_pad,
-    GstClockTime ts, gboolean do_calculation);
+    GstBuffer * buffer, GstClockTime ts, gboolean do_calculation);
+
+void gst_proctime_push_input (GstProcTime * proc_time, GstPad * peer_pad,
+    GstPad * src_pad, GstClockTime ts);
+
+void gst_proctime_pop_input (GstProcTime * proc_time, GstPad * src_pad,
+    GstClockTime ts);
+
+gboolean gst_proctime_pad_proc_time (GstProcTime * proc_time,
+    GstClockTime * time, GstPad ** sink_pad, GstPad * src_pad,
+    GstClockTime ts);
 
 void gst_proctime_free (GstProcTime * proc_time);
 
@@ -22,9 +22,14 @@
  * @short_description: log current queue level
  *
  * A tracing module that takes queue's current level
+ *
+ * With aggregate=<window> the levels in bytes, buffers and time of every
+ * queue are logged once per window as their count, min, max, mean and
+ * percentiles.
  */
 
 #include "gstqueuelevel.h"
+#include "gstaggregate.h"
 #include "gstctf.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_queue_level_debug);
@@ -33,6 +38,10 @@ GST_DEBUG_CATEGORY_STATIC (gst_queue_level_debug);
 struct _GstQueueLevelTracer
 {
   GstSharkTracer parent;
+
+  GstSharkAggregate *bytes_aggregate;
+  GstSharkAggregate *buffers_aggregate;
+  GstSharkAggregate *time_aggregate;
 };
 
 #define _do_init \
@@ -48,22 +57,6 @@ static gboolean is_queue (GstElement * element);
 
 static GstTracerRecord *tr_qlevel;
 
-static const gchar queue_level_metadata_event[] = "event {\n\
-    name = queuelevel;\n\
-    id = %d;\n\
-    stream_id = %d;\n\
-    fields := struct {\n\
-        string queue;\n\
-        integer { size = 32; align = 8; signed = 0; encoding = none; base = 10; } size_bytes;\n\
-        integer { size = 32; align = 8; signed = 0; encoding = none; base = 10; } max_size_bytes;\n \
-        integer { size = 32; align = 8; signed = 0; encoding = none; base = 10; } size_buffers;\n\
-        integer { size = 32; align = 8; signed = 0; encoding = none; base = 10; } max_size_buffers;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } size_time;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } max_size_time;\n\
-    };\n\
-};\n\
-\n";
-
 static GstElement *
 get_parent_element (GstPad * pad)
 {
@@ -89,15 +82,17 @@ get_parent_element (GstPad * pad)
 static void
 do_queue_level (GstTracer * self, guint64 ts, GstPad * pad)
 {
+  GstQueueLevelTracer *queue_level_tracer;
   GstElement *element;
+  guint32 element_id;
   guint32 size_bytes;
   guint32 max_size_bytes;
   guint32 size_buffers;
   guint32 max_size_buffers;
   guint64 size_time;
   guint64 max_size_time;
-  gchar *size_time_string;
-  gchar *max_size_time_string;
+  gchar size_time_string[GST_SHARK_TIME_STRING_SIZE];
+  gchar max_size_time_string[GST_SHARK_TIME_STRING_SIZE];
   const gchar *element_name;
 
   element = get_parent_element (pad);
@@ -115,19 +110,31 @@ do_queue_level (GstTracer * self, guint64 ts, GstPad * pad)
       "max-size-buffers", &max_size_buffers,
       "max-size-time", &max_size_time, NULL);
 
-  size_time_string =
-      g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (size_time));
+  queue_level_tracer = GST_QUEUE_LEVEL_TRACER (self);
+  element_id = gst_ctf_element_name_id (element);
 
-  max_size_time_string =
-      g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (max_size_time));
+  if (NULL != queue_level_tracer->bytes_aggregate) {
+    gst_shark_aggregate_add (queue_level_tracer->bytes_aggregate, ts,
+        element_id, element_name, 0, NULL, size_bytes);
+    gst_shark_aggregate_add (queue_level_tracer->buffers_aggregate, ts,
+        element_id, element_name, 0, NULL, size_buffers);
+    gst_shark_aggregate_add (queue_level_tracer->time_aggregate, ts,
+        element_id, element_name, 0, NULL, size_time);
+    goto out;
+  }
 
-  gst_tracer_record_log (tr_qlevel, element_name, size_bytes, max_size_bytes,
-      size_buffers, max_size_buffers, size_time_string, max_size_time_string);
+  if (gst_shark_tracer_log_enabled ()) {
+    g_snprintf (size_time_string, sizeof (size_time_string),
+        "%" GST_TIME_FORMAT, GST_TIME_ARGS (size_time));
+    g_snprintf (max_size_time_string, sizeof (max_size_time_string),
+        "%" GST_TIME_FORMAT, GST_TIME_ARGS (max_size_time));
 
-  g_free (size_time_string);
-  g_free (max_size_time_string);
+    gst_tracer_record_log (tr_qlevel, element_name, size_bytes,
+        max_size_bytes, size_buffers, max_size_buffers, size_time_string,
+        max_size_time_string);
+  }
 
-  do_print_queue_level_event (QUEUE_LEVEL_EVENT_ID, element_name, size_bytes,
+  do_print_queuelevel_event (element_id, size_bytes,
       max_size_bytes, size_buffers, max_size_buffers, size_time, max_size_time);
 
 out:
@@ -167,9 +174,49 @@ is_queue (GstElement * element)
 }
 
 /* tracer class */
+
+static void
+gst_queue_level_tracer_constructed (GObject * obj)
+{
+  GstQueueLevelTracer *self;
+  GstClockTime window;
+
+  /* Let the parent parse the params */
+  G_OBJECT_CLASS (gst_queue_level_tracer_parent_class)->constructed (obj);
+
+  self = GST_QUEUE_LEVEL_TRACER (obj);
+
+  window = gst_shark_aggregate_get_window (GST_SHARK_TRACER (self));
+  if (GST_CLOCK_TIME_IS_VALID (window)) {
+    self->bytes_aggregate = gst_shark_aggregate_new ("queuelevel_bytes",
+        window);
+    self->buffers_aggregate = gst_shark_aggregate_new ("queuelevel_buffers",
+        window);
+    self->time_aggregate = gst_shark_aggregate_new ("queuelevel_time",
+        window);
+  }
+}
+
+static void
+gst_queue_level_tracer_finalize (GObject * obj)
+{
+  GstQueueLevelTracer *self = GST_QUEUE_LEVEL_TRACER (obj);
+
+  gst_shark_aggregate_free (self->bytes_aggregate);
+  gst_shark_aggregate_free (self->buffers_aggregate);
+  gst_shark_aggregate_free (self->time_aggregate);
+
+  G_OBJECT_CLASS (gst_queue_level_tracer_parent_class)->finalize (obj);
+}
+
 static void
 gst_queue_level_tracer_class_init (GstQueueLevelTracerClass * klass)
 {
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->constructed = gst_queue_level_tracer_constructed;
+  gobject_class->finalize = gst_queue_level_tracer_finalize;
+
   tr_qlevel = gst_tracer_record_new ("queuelevel.class", "queue",
       GST_TYPE_STRUCTURE, gst_structure_new ("scope",
           "type", G_TYPE_GTYPE, G_TYPE_STRING,
@@ -205,7 +252,6 @@ static void
 gst_queue_level_tracer_init (GstQueueLevelTracer * self)
 {
   GstSharkTracer *tracer = GST_SHARK_TRACER (self);
-  gchar *metadata_event = NULL;
 
   gst_shark_tracer_register_hook (tracer, "pad-push-pre",
       G_CALLBACK (do_queue_level));
@@ -216,8 +262,5 @@ gst_queue_level_tracer_init (GstQueueLevelTracer * self)
   gst_shark_tracer_register_hook (tracer, "pad-pull-range-pre",
       G_CALLBACK (do_queue_level));
 
-  metadata_event =
-      g_strdup_printf (queue_level_metadata_event, QUEUE_LEVEL_EVENT_ID, 0);
-  add_metadata_event_struct (metadata_event);
-  g_free (metadata_event);
+  gst_ctf_add_event_metadata (QUEUE_LEVEL_EVENT_ID);
 }
@@ -22,9 +22,13 @@
  * @short_description: log scheduling time, which is the time between one incoming buffer and the next incoming buffer in a sinkpad
  *
  * A tracing module that take scheduletime() snapshots and logs them.
+ *
+ * With aggregate=<window> the times of every pad are logged once per
+ * window as their count, min, max, mean and percentiles.
  */
 
 #include "gstscheduletime.h"
+#include "gstaggregate.h"
 #include "gstctf.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_scheduletime_debug);
@@ -42,6 +46,7 @@ struct _GstScheduletimeTracer
 {
   GstSharkTracer parent;
   GHashTable *schedule_pads;
+  GstSharkAggregate *aggregate;
 };
 
 #define _do_init \
@@ -50,24 +55,12 @@ struct _GstScheduletimeTracer
 G_DEFINE_TYPE_WITH_CODE (GstScheduletimeTracer, gst_scheduletime_tracer,
     GST_SHARK_TYPE_TRACER, _do_init);
 
-#define PAD_NAME_SIZE  (64)
-
 static GstTracerRecord *tr_schedule;
 
-static const gchar scheduling_metadata_event[] = "event {\n\
-    name = scheduling;\n\
-    id = %d;\n\
-    stream_id = %d;\n\
-    fields := struct {\n\
-        string pad;\n\
-        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _time;\n\
-    };\n\
-};\n\
-\n";
-
 static void sched_time_compute (GstTracer * tracer, guint64 ts, GstPad * pad);
 static void do_push_buffer_list_pre (GstTracer * tracer, GstClockTime ts,
     GstPad * pad, GstBufferList * list);
+static void gst_scheduletime_tracer_constructed (GObject * obj);
 static void gst_scheduletime_tracer_finalize (GObject * obj);
 
 static void
@@ -89,8 +82,6 @@ sched_time_compute (GstTracer * tracer, guint64 ts, GstPad * pad)
   GHashTable *schedule_pads;
   GstSchedulePad *schedule_pad;
   GstSchedulePad *schedule_pad_new;
-  GString *time_string = NULL;
-  gchar pad_name[PAD_NAME_SIZE];
   guint64 time_diff;
 
   g_return_if_fail (tracer);
@@ -99,7 +90,6 @@ sched_time_compute (GstTracer * tracer, guint64 ts, GstPad * pad)
   self = GST_SCHEDULETIME_TRACER (tracer);
   schedule_pads = self->schedule_pads;
 
-  g_snprintf (pad_name, PAD_NAME_SIZE, "%s_%s", GST_DEBUG_PAD_NAME (pad));
   schedule_pad = (GstSchedulePad *) g_hash_table_lookup (schedule_pads, pad);
 
   if (NULL == schedule_pad) {
@@ -115,15 +105,23 @@ sched_time_compute (GstTracer * tracer, guint64 ts, GstPad * pad)
   }
 
   if (schedule_pad->previous_time != 0) {
-    time_string = g_string_new ("");
     time_diff = GST_CLOCK_DIFF (schedule_pad->previous_time, ts);
-    g_string_printf (time_string, "%" GST_TIME_FORMAT,
-        GST_TIME_ARGS (time_diff));
 
-    gst_tracer_record_log (tr_schedule, pad_name, time_string->str);
+    if (NULL != self->aggregate) {
+      gst_shark_aggregate_add (self->aggregate, ts, gst_ctf_pad_name_id (pad),
+          gst_shark_tracer_pad_name (pad), 0, NULL, time_diff);
+    } else {
+      if (gst_shark_tracer_log_enabled ()) {
+        gchar time_string[GST_SHARK_TIME_STRING_SIZE];
+
+        g_snprintf (time_string, sizeof (time_string), "%" GST_TIME_FORMAT,
+            GST_TIME_ARGS (time_diff));
+        gst_tracer_record_log (tr_schedule, gst_shark_tracer_pad_name (pad),
+            time_string);
+      }
 
-    do_print_scheduling_event (SCHED_TIME_EVENT_ID, pad_name, time_diff);
-    g_string_free (time_string, TRUE);
+      do_print_scheduling_event (gst_ctf_pad_name_id (pad), time_diff);
+    }
   }
   schedule_pad->previous_time = ts;
 }
@@ -141,12 +139,30 @@ do_push_buffer_list_pre (GstTracer * tracer, GstClockTime ts, GstPad * pad,
 
 /* tracer class */
 
+static void
+gst_scheduletime_tracer_constructed (GObject * obj)
+{
+  GstScheduletimeTracer *self;
+  GstClockTime window;
+
+  /* Let the parent parse the params */
+  G_OBJECT_CLASS (gst_scheduletime_tracer_parent_class)->constructed (obj);
+
+  self = GST_SCHEDULETIME_TRACER (obj);
+
+  window = gst_shark_aggregate_get_window (GST_SHARK_TRACER (self));
+  if (GST_CLOCK_TIME_IS_VALID (window)) {
+    self->aggregate = gst_shark_aggregate_new ("scheduletime", window);
+  }
+}
+
 static void
 gst_scheduletime_tracer_finalize (GObject * obj)
 {
   GstScheduletimeTracer *self = GST_SCHEDULETIME_TRACER (obj);
 
   g_hash_table_destroy (self->schedule_pads);
+  gst_shark_aggregate_free (self->aggregate);
 
   G_OBJECT_CLASS (gst_scheduletime_tracer_parent_class)->finalize (obj);
 }
@@ -156,6 +172,7 @@ gst_scheduletime_tracer_class_init (GstScheduletimeTracerClass * klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
 
+  gobject_class->constructed = gst_scheduletime_tracer_constructed;
   gobject_class->finalize = gst_scheduletime_tracer_finalize;
 
   tr_schedule = gst_tracer_record_new ("scheduletime.class",
@@ -173,7 +190,6 @@ static void
 gst_scheduletime_tracer_init (GstScheduletimeTracer * self)
 {
   GstSharkTracer *tracer = GST_SHARK_TRACER (self);
-  gchar *metadata_event = NULL;
 
   self->schedule_pads =
       g_hash_table_new_full (g_direct_hash, g_direct_equal, key_destroy,
@@ -188,8 +204,5 @@ gst_scheduletime_tracer_init (GstScheduletimeTracer * self)
   gst_shark_tracer_register_hook (tracer, "pad-pull-range-pre",
       G_CALLBACK (sched_time_compute));
 
-  metadata_event =
-      g_strdup_printf (scheduling_metadata_event, SCHED_TIME_EVENT_ID, 0);
-  add_metadata_event_struct (metadata_event);
-  g_free (metadata_event);
+  gst_ctf_add_event_metadata (SCHED_TIME_EVENT_ID);
 }
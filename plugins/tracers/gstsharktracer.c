@@ -18,6 +18,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <string.h>
+
 #include "gstsharktracer.h"
 #include "gstctf.h"
 
@@ -27,22 +29,83 @@ GST_DEBUG_CATEGORY_STATIC (gst_shark_debug);
 #define GST_SHARK_TRACER_PRIVATE(o) \
   gst_shark_tracer_get_instance_private(GST_SHARK_TRACER(o))
 
+/* Hooks a child tracer can register, in the order of hook_descs */
+typedef enum
+{
+  GST_SHARK_HOOK_PAD_PUSH_PRE,
+  GST_SHARK_HOOK_PAD_PUSH_POST,
+  GST_SHARK_HOOK_PAD_PUSH_LIST_PRE,
+  GST_SHARK_HOOK_PAD_PUSH_LIST_POST,
+  GST_SHARK_HOOK_PAD_PULL_RANGE_PRE,
+  GST_SHARK_HOOK_PAD_PULL_RANGE_POST,
+  GST_SHARK_HOOK_PAD_PUSH_EVENT_PRE,
+  GST_SHARK_HOOK_PAD_PUSH_EVENT_POST,
+  GST_SHARK_HOOK_PAD_QUERY_PRE,
+  GST_SHARK_HOOK_PAD_QUERY_POST,
+  GST_SHARK_HOOK_ELEMENT_POST_MESSAGE_PRE,
+  GST_SHARK_HOOK_ELEMENT_POST_MESSAGE_POST,
+  GST_SHARK_HOOK_ELEMENT_QUERY_PRE,
+  GST_SHARK_HOOK_ELEMENT_QUERY_POST,
+  GST_SHARK_HOOK_ELEMENT_NEW,
+  GST_SHARK_HOOK_ELEMENT_ADD_PAD,
+  GST_SHARK_HOOK_ELEMENT_REMOVE_PAD,
+  GST_SHARK_HOOK_BIN_ADD_PRE,
+  GST_SHARK_HOOK_BIN_ADD_POST,
+  GST_SHARK_HOOK_BIN_REMOVE_PRE,
+  GST_SHARK_HOOK_BIN_REMOVE_POST,
+  GST_SHARK_HOOK_PAD_LINK_PRE,
+  GST_SHARK_HOOK_PAD_LINK_POST,
+  GST_SHARK_HOOK_PAD_UNLINK_PRE,
+  GST_SHARK_HOOK_PAD_UNLINK_POST,
+  GST_SHARK_HOOK_ELEMENT_CHANGE_STATE_PRE,
+  GST_SHARK_HOOK_ELEMENT_CHANGE_STATE_POST,
+  GST_SHARK_HOOK_MINI_OBJECT_CREATED,
+  GST_SHARK_HOOK_MINI_OBJECT_DESTROYED,
+  GST_SHARK_HOOK_OBJECT_CREATED,
+  GST_SHARK_HOOK_OBJECT_DESTROYED,
+  GST_SHARK_HOOK_MINI_OBJECT_REFFED,
+  GST_SHARK_HOOK_MINI_OBJECT_UNREFFED,
+  GST_SHARK_HOOK_OBJECT_REFFED,
+  GST_SHARK_HOOK_OBJECT_UNREFFED,
+  GST_SHARK_HOOK_COUNT
+} GstSharkTracerHook;
+
 typedef struct _GstSharkTracerPrivate GstSharkTracerPrivate;
 struct _GstSharkTracerPrivate
 {
   GHashTable *params;
-  GHashTable *hooks;
-  GHashTable *myhooks;
+  /* Child hooks, attached once the filters are known */
+  GCallback hooks[GST_SHARK_HOOK_COUNT];
+  gboolean constructed;
+
+  /* Compiled "filter" params and the per object results cached in qdata.
+     Results of an older generation of the filters are recomputed. */
+  GPtrArray *filters;
+  GQuark filter_quark;
+  guint filter_generation;
 };
 
+/* Cached filter result: generation, valid flag and result */
+#define FILTER_CACHE_VALID       (1 << 1)
+#define FILTER_CACHE_MATCH       (1 << 0)
+#define FILTER_CACHE_GENERATION_SHIFT (2)
+
 static volatile gint g_shark_tracer_refcount = 0;
+static GQuark g_shark_tracer_pad_name_quark = 0;
+/* Whether GstTracerRecord logs are consumed, checked once */
+static gboolean g_shark_tracer_log = FALSE;
+static volatile gint g_shark_tracer_filter_count = 0;
 
 static void gst_shark_tracer_constructed (GObject * object);
 static void gst_shark_tracer_finalize (GObject * object);
 static void gst_shark_tracer_save_params (GstSharkTracer * self);
 static void gst_shark_tracer_dump_params (GstSharkTracer * self);
 static void gst_shark_tracer_free_params (GstSharkTracerPrivate * priv);
-static void gst_shark_tracer_fill_hooks (GstSharkTracerPrivate * priv);
+static void gst_shark_tracer_attach_hook (GstSharkTracer * self,
+    GstSharkTracerHook hook);
+static void gst_shark_tracer_compile_filters (GstSharkTracer * self);
+static void gst_shark_tracer_snapshot_message (GObject * self,
+    GstClockTime ts, GstElement * element, GstMessage * message);
 
 /* Our hooks */
 static void gst_shark_tracer_hook_pad_push_pre (GObject * self, GstClockTime ts,
@@ -119,6 +182,52 @@ static void gst_shark_tracer_hook_object_destroyed (GObject * self,
     GstClockTime ts, GstObject * object);
 
 
+typedef struct _GstSharkTracerHookDesc GstSharkTracerHookDesc;
+struct _GstSharkTracerHookDesc
+{
+  const gchar *detail;
+  GCallback trampoline;
+};
+
+/* Our hooks, indexed by GstSharkTracerHook */
+static const GstSharkTracerHookDesc hook_descs[GST_SHARK_HOOK_COUNT] = {
+  {"pad-push-pre", G_CALLBACK (gst_shark_tracer_hook_pad_push_pre)},
+  {"pad-push-post", G_CALLBACK (gst_shark_tracer_hook_pad_push_post)},
+  {"pad-push-list-pre", G_CALLBACK (gst_shark_tracer_hook_pad_push_list_pre)},
+  {"pad-push-list-post", G_CALLBACK (gst_shark_tracer_hook_pad_push_list_post)},
+  {"pad-pull-range-pre", G_CALLBACK (gst_shark_tracer_hook_pad_pull_range_pre)},
+  {"pad-pull-range-post", G_CALLBACK (gst_shark_tracer_hook_pad_pull_range_post)},
+  {"pad-push-event-pre", G_CALLBACK (gst_shark_tracer_hook_pad_push_event_pre)},
+  {"pad-push-event-post", G_CALLBACK (gst_shark_tracer_hook_pad_push_event_post)},
+  {"pad-query-pre", G_CALLBACK (gst_shark_tracer_hook_pad_query_pre)},
+  {"pad-query-post", G_CALLBACK (gst_shark_tracer_hook_pad_query_post)},
+  {"element-post-message-pre", G_CALLBACK (gst_shark_tracer_hook_element_post_message_pre)},
+  {"element-post-message-post", G_CALLBACK (gst_shark_tracer_hook_element_post_message_post)},
+  {"element-query-pre", G_CALLBACK (gst_shark_tracer_hook_element_query_pre)},
+  {"element-query-post", G_CALLBACK (gst_shark_tracer_hook_element_query_post)},
+  {"element-new", G_CALLBACK (gst_shark_tracer_hook_element_new)},
+  {"element-add-pad", G_CALLBACK (gst_shark_tracer_hook_element_add_pad)},
+  {"element-remove-pad", G_CALLBACK (gst_shark_tracer_hook_element_remove_pad)},
+  {"bin-add-pre", G_CALLBACK (gst_shark_tracer_hook_bin_add_pre)},
+  {"bin-add-post", G_CALLBACK (gst_shark_tracer_hook_bin_add_post)},
+  {"bin-remove-pre", G_CALLBACK (gst_shark_tracer_hook_bin_remove_pre)},
+  {"bin-remove-post", G_CALLBACK (gst_shark_tracer_hook_bin_remove_post)},
+  {"pad-link-pre", G_CALLBACK (gst_shark_tracer_hook_pad_link_pre)},
+  {"pad-link-post", G_CALLBACK (gst_shark_tracer_hook_pad_link_post)},
+  {"pad-unlink-pre", G_CALLBACK (gst_shark_tracer_hook_pad_unlink_pre)},
+  {"pad-unlink-post", G_CALLBACK (gst_shark_tracer_hook_pad_unlink_post)},
+  {"element-change-state-pre", G_CALLBACK (gst_shark_tracer_hook_element_change_state_pre)},
+  {"element-change-state-post", G_CALLBACK (gst_shark_tracer_hook_element_change_state_post)},
+  {"mini-object-created", G_CALLBACK (gst_shark_tracer_hook_mini_object_created)},
+  {"mini-object-destroyed", G_CALLBACK (gst_shark_tracer_hook_mini_object_destroyed)},
+  {"object-created", G_CALLBACK (gst_shark_tracer_hook_object_created)},
+  {"object-destroyed", G_CALLBACK (gst_shark_tracer_hook_object_destroyed)},
+  {"mini-object-reffed", G_CALLBACK (gst_shark_tracer_hook_mini_object_reffed)},
+  {"mini-object-unreffed", G_CALLBACK (gst_shark_tracer_hook_mini_object_unreffed)},
+  {"object-reffed", G_CALLBACK (gst_shark_tracer_hook_object_reffed)},
+  {"object-unreffed", G_CALLBACK (gst_shark_tracer_hook_object_unreffed)},
+};
+
 G_DEFINE_TYPE_WITH_PRIVATE (GstSharkTracer, gst_shark_tracer, GST_TYPE_TRACER);
 
 static void
@@ -129,6 +238,20 @@ gst_shark_tracer_class_init (GstSharkTracerClass * klass)
   GST_DEBUG_CATEGORY_INIT (gst_shark_debug, "sharktracer", 0,
       "base shark tracer");
 
+#ifndef GST_DISABLE_GST_DEBUG
+  {
+    GstDebugCategory *log_category;
+
+    /* Debug thresholds are set before the tracers are created */
+    GST_DEBUG_CATEGORY_GET (log_category, "GST_TRACER");
+    g_shark_tracer_log = NULL != log_category &&
+        gst_debug_category_get_threshold (log_category) >= GST_LEVEL_TRACE;
+  }
+#endif
+
+  g_shark_tracer_pad_name_quark =
+      g_quark_from_static_string ("GstSharkPadName");
+
   oclass->constructed = gst_shark_tracer_constructed;
   oclass->finalize = gst_shark_tracer_finalize;
 }
@@ -138,101 +261,59 @@ gst_shark_tracer_init (GstSharkTracer * self)
 {
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   gint prev_count = 0;
+  gchar *quark_name;
 
   priv->params = g_hash_table_new (g_str_hash, g_str_equal);
-  priv->hooks = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-  priv->myhooks = g_hash_table_new (g_str_hash, g_str_equal);
+  priv->constructed = FALSE;
 
-  gst_shark_tracer_fill_hooks (priv);
+  /* Every tracer instance may have its own filters */
+  priv->filters = g_ptr_array_new_with_free_func ((GDestroyNotify)
+      g_regex_unref);
+  quark_name = g_strdup_printf ("GstSharkFilter%d",
+      g_atomic_int_add (&g_shark_tracer_filter_count, 1));
+  priv->filter_quark = g_quark_from_string (quark_name);
+  g_free (quark_name);
+  priv->filter_generation = 0;
 
   prev_count = g_atomic_int_add (&g_shark_tracer_refcount, 1);
   if (prev_count == 0) {
     gst_ctf_init ();
-  }
-}
 
-static void
-gst_shark_tracer_fill_hooks (GstSharkTracerPrivate * priv)
-{
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-push-pre",
-      gst_shark_tracer_hook_pad_push_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-push-post",
-      gst_shark_tracer_hook_pad_push_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-push-list-pre",
-      gst_shark_tracer_hook_pad_push_list_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-push-list-post",
-      gst_shark_tracer_hook_pad_push_list_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-pull-range-pre",
-      gst_shark_tracer_hook_pad_pull_range_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-pull-range-post",
-      gst_shark_tracer_hook_pad_pull_range_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-push-event-pre",
-      gst_shark_tracer_hook_pad_push_event_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-push-event-post",
-      gst_shark_tracer_hook_pad_push_event_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-query-pre",
-      gst_shark_tracer_hook_pad_query_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-query-post",
-      gst_shark_tracer_hook_pad_query_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "element-post-message-pre",
-      gst_shark_tracer_hook_element_post_message_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "element-post-message-post",
-      gst_shark_tracer_hook_element_post_message_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "element-query-pre",
-      gst_shark_tracer_hook_element_query_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "element-query-post",
-      gst_shark_tracer_hook_element_query_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "element-new",
-      gst_shark_tracer_hook_element_new);
-  g_hash_table_insert (priv->myhooks, (gpointer) "element-add-pad",
-      gst_shark_tracer_hook_element_add_pad);
-  g_hash_table_insert (priv->myhooks, (gpointer) "element-remove-pad",
-      gst_shark_tracer_hook_element_remove_pad);
-  g_hash_table_insert (priv->myhooks, (gpointer) "bin-add-pre",
-      gst_shark_tracer_hook_bin_add_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "bin-add-post",
-      gst_shark_tracer_hook_bin_add_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "bin-remove-pre",
-      gst_shark_tracer_hook_bin_remove_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "bin-remove-post",
-      gst_shark_tracer_hook_bin_remove_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-link-pre",
-      gst_shark_tracer_hook_pad_link_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-link-post",
-      gst_shark_tracer_hook_pad_link_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-unlink-pre",
-      gst_shark_tracer_hook_pad_unlink_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "pad-unlink-post",
-      gst_shark_tracer_hook_pad_unlink_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "element-change-state-pre",
-      gst_shark_tracer_hook_element_change_state_pre);
-  g_hash_table_insert (priv->myhooks, (gpointer) "element-change-state-post",
-      gst_shark_tracer_hook_element_change_state_post);
-  g_hash_table_insert (priv->myhooks, (gpointer) "mini-object-created",
-      gst_shark_tracer_hook_mini_object_created);
-  g_hash_table_insert (priv->myhooks, (gpointer) "mini-object-destroyed",
-      gst_shark_tracer_hook_mini_object_destroyed);
-  g_hash_table_insert (priv->myhooks, (gpointer) "object-created",
-      gst_shark_tracer_hook_object_created);
-  g_hash_table_insert (priv->myhooks, (gpointer) "object-destroyed",
-      gst_shark_tracer_hook_object_destroyed);
-  g_hash_table_insert (priv->myhooks, (gpointer) "mini-object-reffed",
-      gst_shark_tracer_hook_mini_object_reffed);
-  g_hash_table_insert (priv->myhooks, (gpointer) "mini-object-unreffed",
-      gst_shark_tracer_hook_mini_object_unreffed);
-  g_hash_table_insert (priv->myhooks, (gpointer) "object-reffed",
-      gst_shark_tracer_hook_object_reffed);
-  g_hash_table_insert (priv->myhooks, (gpointer) "object-unreffed",
-      gst_shark_tracer_hook_object_unreffed);
+    /* The application can request a snapshot of the flight recorder */
+    if (gst_ctf_flight_recorder_enabled ()) {
+      gst_tracing_register_hook (GST_TRACER (self), "element-post-message-pre",
+          G_CALLBACK (gst_shark_tracer_snapshot_message));
+    }
+  }
 }
 
 static void
 gst_shark_tracer_constructed (GObject * object)
 {
-
   GstSharkTracer *self = GST_SHARK_TRACER (object);
+  GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
+  GstSharkTracerHook hook;
 
   gst_shark_tracer_save_params (self);
+
+  /* Hooks are registered by the children before the params are set */
+  priv->constructed = TRUE;
+  for (hook = 0; hook < GST_SHARK_HOOK_COUNT; ++hook) {
+    if (NULL != priv->hooks[hook]) {
+      gst_shark_tracer_attach_hook (self, hook);
+    }
+  }
+}
+
+static void
+gst_shark_tracer_snapshot_message (GObject * self, GstClockTime ts,
+    GstElement * element, GstMessage * message)
+{
+  if (gst_message_has_name (message, "GstSharkSnapshot")) {
+    GST_INFO_OBJECT (self, "Snapshot requested by %s",
+        GST_OBJECT_NAME (element));
+    gst_ctf_snapshot ();
+  }
 }
 
 static void
@@ -255,8 +336,7 @@ gst_shark_tracer_finalize (GObject * object)
 
   gst_shark_tracer_free_params (priv);
   g_hash_table_unref (priv->params);
-  g_hash_table_unref (priv->hooks);
-  g_hash_table_unref (priv->myhooks);
+  g_ptr_array_unref (priv->filters);
 
   G_OBJECT_CLASS (gst_shark_tracer_parent_class)->finalize (object);
 
@@ -312,6 +392,56 @@ gst_shark_tracer_save_params (GstSharkTracer * self)
   if (i > 0) {
     gst_shark_tracer_dump_params (self);
   }
+
+  gst_shark_tracer_compile_filters (self);
+}
+
+/* Compile the "filter" params once, results cached with a previous set of
+ * filters are invalidated.
+ */
+static void
+gst_shark_tracer_compile_filters (GstSharkTracer * self)
+{
+  GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
+  GList *filter;
+  GRegex *regex;
+  GError *error = NULL;
+
+  g_ptr_array_set_size (priv->filters, 0);
+
+  for (filter = g_hash_table_lookup (priv->params, "filter"); NULL != filter;
+      filter = g_list_next (filter)) {
+    const gchar *pattern = (const gchar *) filter->data;
+
+    regex = g_regex_new (pattern, G_REGEX_OPTIMIZE, 0, &error);
+    if (NULL == regex) {
+      GST_ERROR_OBJECT (self, "Invalid filter %s: %s", pattern,
+          error->message);
+      g_clear_error (&error);
+      continue;
+    }
+    g_ptr_array_add (priv->filters, regex);
+  }
+
+  priv->filter_generation++;
+}
+
+static gboolean
+gst_shark_tracer_match_filters (GstSharkTracer * self, const gchar * element)
+{
+  GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
+  gboolean is_filtered = FALSE;
+  guint i;
+
+  for (i = 0; i < priv->filters->len; ++i) {
+    is_filtered =
+        g_regex_match (g_ptr_array_index (priv->filters, i), element, 0, NULL);
+    if (is_filtered) {
+      break;
+    }
+  }
+
+  return is_filtered;
 }
 
 static void
@@ -345,10 +475,7 @@ gst_shark_tracer_element_is_filtered (GstSharkTracer * self,
     const gchar * element)
 {
   GstSharkTracerPrivate *priv;
-  GList *filters;
-  GList *filter;
-  const gchar *filter_tag = "filter";
-  gboolean is_filtered = FALSE;
+  gboolean is_filtered;
 
   g_return_val_if_fail (self, FALSE);
   g_return_val_if_fail (element, FALSE);
@@ -357,25 +484,54 @@ gst_shark_tracer_element_is_filtered (GstSharkTracer * self,
 
   GST_LOG_OBJECT (self, "Looking if user has filtered %s", element);
 
-  filters = g_hash_table_lookup (priv->params, filter_tag);
-  if (NULL == filters) {
+  if (0 == priv->filters->len) {
     GST_LOG_OBJECT (self, "There are no filters specified");
     return TRUE;
   }
 
-  /* TODO: Cache this results to avoid compiling the regex every evaluation */
-  for (filter = filters; NULL != filter; filter = g_list_next (filters)) {
-    const gchar *pattern = (const gchar *) filter->data;
+  is_filtered = gst_shark_tracer_match_filters (self, element);
 
-    is_filtered = g_regex_match_simple (pattern, element, 0, 0);
-    if (is_filtered) {
-      break;
-    }
+  GST_LOG_OBJECT (self, "Element %s was filtered: %s", element,
+      is_filtered ? "true" : "false");
+
+  return is_filtered;
+}
+
+gboolean
+gst_shark_tracer_object_is_filtered (GstSharkTracer * self, GstObject * object)
+{
+  GstSharkTracerPrivate *priv;
+  guintptr cached;
+  guintptr generation;
+  gboolean is_filtered;
+
+  g_return_val_if_fail (self, FALSE);
+  g_return_val_if_fail (object, FALSE);
+
+  priv = GST_SHARK_TRACER_PRIVATE (self);
+
+  if (0 == priv->filters->len) {
+    return TRUE;
   }
 
-  GST_LOG_OBJECT (self, "Element %s was filtered: %s", element,
+  generation = priv->filter_generation;
+  cached = GPOINTER_TO_SIZE (g_object_get_qdata (G_OBJECT (object),
+          priv->filter_quark));
+  if (G_LIKELY ((cached & FILTER_CACHE_VALID) &&
+          (cached >> FILTER_CACHE_GENERATION_SHIFT) == generation)) {
+    return cached & FILTER_CACHE_MATCH;
+  }
+
+  is_filtered = gst_shark_tracer_match_filters (self, GST_OBJECT_NAME (object));
+
+  GST_LOG_OBJECT (self, "Object %s was filtered: %s", GST_OBJECT_NAME (object),
       is_filtered ? "true" : "false");
 
+  cached = (generation << FILTER_CACHE_GENERATION_SHIFT) | FILTER_CACHE_VALID |
+      (is_filtered ? FILTER_CACHE_MATCH : 0);
+  g_object_set_qdata (G_OBJECT (object), priv->filter_quark,
+      GSIZE_TO_POINTER (cached));
+
   return is_filtered;
 }
 
@@ -392,22 +548,221 @@ gst_shark_tracer_get_param (GstSharkTracer * self, const gchar * param)
   return g_hash_table_lookup (priv->params, param);
 }
 
+/* Pads are named as elementName_padName, the name is formatted once and
+ * kept in the pad */
+const gchar *
+gst_shark_tracer_pad_name (GstPad * pad)
+{
+  gchar *name;
+
+  g_return_val_if_fail (pad, NULL);
+
+  name = g_object_get_qdata (G_OBJECT (pad), g_shark_tracer_pad_name_quark);
+  if (G_LIKELY (NULL != name)) {
+    return name;
+  }
+
+  name = g_strdup_printf ("%s_%s", GST_DEBUG_PAD_NAME (pad));
+
+  /* Another thread may have named the pad meanwhile */
+  if (!g_object_replace_qdata (G_OBJECT (pad), g_shark_tracer_pad_name_quark,
+          NULL, name, g_free, NULL)) {
+    g_free (name);
+    name = g_object_get_qdata (G_OBJECT (pad), g_shark_tracer_pad_name_quark);
+  }
+
+  return name;
+}
+
+/* Parse a time such as 100ms, 20us or 1s, in the given unit if there is
+ * none. Returns GST_CLOCK_TIME_NONE on error */
+GstClockTime
+gst_shark_tracer_parse_time (const gchar * str, GstClockTime unit)
+{
+  gchar *suffix = NULL;
+  guint64 value;
+
+  g_return_val_if_fail (str, GST_CLOCK_TIME_NONE);
+
+  value = g_ascii_strtoull (str, &suffix, 10);
+  if (suffix == str) {
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  if (0 == g_strcmp0 (suffix, "s")) {
+    unit = GST_SECOND;
+  } else if (0 == g_strcmp0 (suffix, "ms")) {
+    unit = GST_MSECOND;
+  } else if (0 == g_strcmp0 (suffix, "us")) {
+    unit = GST_USECOND;
+  } else if (0 == g_strcmp0 (suffix, "ns")) {
+    unit = 1;
+  } else if (0 != g_strcmp0 (suffix, "")) {
+    return GST_CLOCK_TIME_NONE;
+  }
+
+  return value * unit;
+}
+
+/* Stack of the frames of the current thread kept in the given private,
+ * which has to be declared as G_PRIVATE_INIT ((GDestroyNotify)
+ * g_array_unref) */
+GArray *
+gst_shark_tracer_get_frames (GPrivate * frames)
+{
+  GArray *array;
+
+  g_return_val_if_fail (frames, NULL);
+
+  array = g_private_get (frames);
+  if (G_UNLIKELY (NULL == array)) {
+    array = g_array_sized_new (FALSE, FALSE, sizeof (GstSharkFrame), 16);
+    g_private_set (frames, array);
+  }
+
+  return array;
+}
+
+/* Start a frame for a push or pull on the pad, with the values at its
+ * start, or zeros if start is NULL. Frames nest in the order of the
+ * hooks of a thread. */
+void
+gst_shark_tracer_push_frame (GArray * frames, GstPad * pad, gpointer data,
+    const guint64 * start)
+{
+  GstSharkFrame frame;
+
+  g_return_if_fail (frames);
+
+  memset (&frame, 0, sizeof (frame));
+  frame.pad = pad;
+  frame.data = data;
+  if (NULL != start) {
+    memcpy (frame.start, start, sizeof (frame.start));
+  }
+
+  g_array_append_val (frames, frame);
+}
+
+/* End the last frame if it belongs to the pad, with the values at its end.
+ * Its totals are charged to the enclosing frame, and its totals without
+ * the ones of its nested frames are returned in exclusive. Returns FALSE
+ * if the last frame is not the one of the pad. */
+gboolean
+gst_shark_tracer_pop_frame (GArray * frames, GstPad * pad,
+    const guint64 * end, GstSharkFrame * frame, guint64 * exclusive)
+{
+  GstSharkFrame *last;
+  GstSharkFrame *parent;
+  guint64 total;
+  guint i;
+
+  g_return_val_if_fail (frames, FALSE);
+
+  if (0 == frames->len) {
+    return FALSE;
+  }
+
+  last = &g_array_index (frames, GstSharkFrame, frames->len - 1);
+  if (last->pad != pad) {
+    return FALSE;
+  }
+
+  parent = NULL;
+  if (frames->len > 1) {
+    parent = &g_array_index (frames, GstSharkFrame, frames->len - 2);
+  }
+
+  for (i = 0; i < GST_SHARK_FRAME_VALUES; i++) {
+    total = 0;
+    if (NULL != end && end[i] > last->start[i]) {
+      total = end[i] - last->start[i];
+    }
+
+    if (NULL != parent) {
+      parent->children[i] += total;
+    }
+    if (NULL != exclusive) {
+      exclusive[i] = total > last->children[i] ? total - last->children[i] : 0;
+    }
+  }
+
+  if (NULL != frame) {
+    *frame = *last;
+  }
+  g_array_set_size (frames, frames->len - 1);
+
+  return TRUE;
+}
+
+/* Innermost frame of the stack, NULL if there is none */
+GstSharkFrame *
+gst_shark_tracer_peek_frame (GArray * frames)
+{
+  g_return_val_if_fail (frames, NULL);
+
+  if (0 == frames->len) {
+    return NULL;
+  }
+
+  return &g_array_index (frames, GstSharkFrame, frames->len - 1);
+}
+
+/* Whether the GstTracerRecord logs are consumed, so the tracers only
+ * format their human readable fields if they are */
+gboolean
+gst_shark_tracer_log_enabled (void)
+{
+  return g_shark_tracer_log;
+}
+
+/* Without filters there is nothing to check and the child's hook is
+ * called directly, otherwise through our hook.
+ */
+static void
+gst_shark_tracer_attach_hook (GstSharkTracer * self, GstSharkTracerHook hook)
+{
+  GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
+  const GstSharkTracerHookDesc *desc = &hook_descs[hook];
+
+  if (0 == priv->filters->len) {
+    GST_INFO_OBJECT (self, "Registering %s directly", desc->detail);
+    gst_tracing_register_hook (GST_TRACER (self), desc->detail,
+        priv->hooks[hook]);
+  } else {
+    GST_INFO_OBJECT (self, "Registering new shark hook for %s", desc->detail);
+    gst_tracing_register_hook (GST_TRACER (self), desc->detail,
+        desc->trampoline);
+  }
+}
+
 void
 gst_shark_tracer_register_hook (GstSharkTracer * self, const gchar * detail,
     GCallback func)
 {
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
+  GstSharkTracerHook hook;
+
+  for (hook = 0; hook < GST_SHARK_HOOK_COUNT; ++hook) {
+    if (0 == g_strcmp0 (hook_descs[hook].detail, detail)) {
+      break;
+    }
+  }
 
-  if (!g_hash_table_contains (priv->hooks, detail)) {
-    GCallback myhook = g_hash_table_lookup (priv->myhooks, detail);
+  if (GST_SHARK_HOOK_COUNT == hook) {
+    GST_ERROR_OBJECT (self, "Unknown hook %s", detail);
+    return;
+  }
 
-    GST_INFO_OBJECT (self, "Registering new shark hook for %s", detail);
+  if (NULL != priv->hooks[hook]) {
+    return;
+  }
 
-    /* Save child's hook */
-    g_hash_table_insert (priv->hooks, g_strdup (detail), func);
+  /* Save child's hook */
+  priv->hooks[hook] = func;
 
-    /* Register our hook */
-    gst_tracing_register_hook (GST_TRACER (self), detail, myhook);
+  if (priv->constructed) {
+    gst_shark_tracer_attach_hook (self, hook);
   }
 }
 
@@ -419,14 +774,12 @@ gst_shark_tracer_hook_pad_push_pre (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (pad));
-  if (FALSE == gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (pad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-push-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_PUSH_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstPad *, GstBuffer *)) hook) (object, ts,
@@ -440,14 +793,12 @@ gst_shark_tracer_hook_pad_push_post (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (pad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (pad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-push-post");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_PUSH_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstPad *, GstFlowReturn)) hook) (object,
@@ -461,14 +812,12 @@ gst_shark_tracer_hook_pad_push_list_pre (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (pad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (pad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-push-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_PUSH_LIST_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstPad *, GstBufferList *)) hook) (object,
@@ -482,14 +831,12 @@ gst_shark_tracer_hook_pad_push_list_post (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (pad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (pad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-push-list-post");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_PUSH_LIST_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstPad *, GstFlowReturn)) hook) (object,
@@ -503,14 +850,12 @@ gst_shark_tracer_hook_pad_pull_range_pre (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (pad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (pad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-pull-range-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_PULL_RANGE_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstPad *, guint64, guint)) hook) (object,
@@ -524,14 +869,12 @@ gst_shark_tracer_hook_pad_pull_range_post (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (pad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (pad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-pull-range-post");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_PULL_RANGE_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstPad *, GstBuffer *,
@@ -545,14 +888,12 @@ gst_shark_tracer_hook_pad_push_event_pre (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (pad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (pad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-push-event-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_PUSH_EVENT_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstPad *, GstEvent *)) hook) (object, ts,
@@ -566,14 +907,12 @@ gst_shark_tracer_hook_pad_push_event_post (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (pad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (pad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-push-event-post");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_PUSH_EVENT_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstPad *, gboolean)) hook) (object, ts,
@@ -587,14 +926,12 @@ gst_shark_tracer_hook_pad_query_pre (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (pad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (pad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-query-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_QUERY_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstPad *, GstQuery *)) hook) (object, ts,
@@ -608,14 +945,12 @@ gst_shark_tracer_hook_pad_query_post (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (pad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (pad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-query-post");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_QUERY_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstPad *, GstQuery *,
@@ -629,14 +964,12 @@ gst_shark_tracer_hook_element_post_message_pre (GObject * object,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "element-post-message-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_ELEMENT_POST_MESSAGE_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *,
@@ -651,14 +984,12 @@ gst_shark_tracer_hook_element_post_message_post (GObject * object,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "element-post-message-post");
+  hook = priv->hooks[GST_SHARK_HOOK_ELEMENT_POST_MESSAGE_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *,
@@ -673,14 +1004,12 @@ gst_shark_tracer_hook_element_query_pre (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "element-query-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_ELEMENT_QUERY_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -694,14 +1023,12 @@ gst_shark_tracer_hook_element_query_post (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "element-query-post");
+  hook = priv->hooks[GST_SHARK_HOOK_ELEMENT_QUERY_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -716,14 +1043,12 @@ gst_shark_tracer_hook_element_new (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "element-new");
+  hook = priv->hooks[GST_SHARK_HOOK_ELEMENT_NEW];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -737,14 +1062,12 @@ gst_shark_tracer_hook_element_add_pad (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "element-add-pad");
+  hook = priv->hooks[GST_SHARK_HOOK_ELEMENT_ADD_PAD];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -758,14 +1081,12 @@ gst_shark_tracer_hook_element_remove_pad (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "element-remove-pad");
+  hook = priv->hooks[GST_SHARK_HOOK_ELEMENT_REMOVE_PAD];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -779,14 +1100,12 @@ gst_shark_tracer_hook_element_change_state_pre (GObject * object,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "element-change-state-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_ELEMENT_CHANGE_STATE_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *,
@@ -802,14 +1121,12 @@ gst_shark_tracer_hook_element_change_state_post (GObject * object,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "element-change-state-post");
+  hook = priv->hooks[GST_SHARK_HOOK_ELEMENT_CHANGE_STATE_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *,
@@ -825,14 +1142,12 @@ gst_shark_tracer_hook_bin_add_pre (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "bin-add-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_BIN_ADD_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -846,14 +1161,12 @@ gst_shark_tracer_hook_bin_add_post (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "bin-add-post");
+  hook = priv->hooks[GST_SHARK_HOOK_BIN_ADD_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -868,14 +1181,12 @@ gst_shark_tracer_hook_bin_remove_pre (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (element);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (element))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "bin-remove-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_BIN_REMOVE_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -889,14 +1200,12 @@ gst_shark_tracer_hook_bin_remove_post (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (bin);
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT (bin))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "bin-remove-post");
+  hook = priv->hooks[GST_SHARK_HOOK_BIN_REMOVE_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -910,14 +1219,12 @@ gst_shark_tracer_hook_pad_link_pre (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (srcpad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (srcpad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-link-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_LINK_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -931,14 +1238,12 @@ gst_shark_tracer_hook_pad_link_post (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (srcpad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (srcpad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-link-post");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_LINK_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -953,14 +1258,12 @@ gst_shark_tracer_hook_pad_unlink_pre (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (srcpad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (srcpad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-unlink-pre");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_UNLINK_PRE];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -974,14 +1277,12 @@ gst_shark_tracer_hook_pad_unlink_post (GObject * object, GstClockTime ts,
   GstSharkTracer *self = GST_SHARK_TRACER (object);
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
-  const gchar *elname;
 
-  elname = GST_OBJECT_NAME (GST_OBJECT_PARENT (srcpad));
-  if (!gst_shark_tracer_element_is_filtered (self, elname)) {
+  if (!gst_shark_tracer_object_is_filtered (self, GST_OBJECT_PARENT (srcpad))) {
     return;
   }
 
-  hook = g_hash_table_lookup (priv->hooks, "pad-unlink-post");
+  hook = priv->hooks[GST_SHARK_HOOK_PAD_UNLINK_POST];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -997,7 +1298,7 @@ gst_shark_tracer_hook_mini_object_created (GObject * object, GstClockTime ts,
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
 
-  hook = g_hash_table_lookup (priv->hooks, "mini-object-created");
+  hook = priv->hooks[GST_SHARK_HOOK_MINI_OBJECT_CREATED];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -1012,7 +1313,7 @@ gst_shark_tracer_hook_mini_object_destroyed (GObject * object, GstClockTime ts,
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
 
-  hook = g_hash_table_lookup (priv->hooks, "mini-object-destroyed");
+  hook = priv->hooks[GST_SHARK_HOOK_MINI_OBJECT_DESTROYED];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -1027,7 +1328,7 @@ gst_shark_tracer_hook_object_unreffed (GObject * object, GstClockTime ts,
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
 
-  hook = g_hash_table_lookup (priv->hooks, "object-unreffed");
+  hook = priv->hooks[GST_SHARK_HOOK_OBJECT_UNREFFED];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -1042,7 +1343,7 @@ gst_shark_tracer_hook_object_reffed (GObject * object, GstClockTime ts,
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
 
-  hook = g_hash_table_lookup (priv->hooks, "object-reffed");
+  hook = priv->hooks[GST_SHARK_HOOK_OBJECT_REFFED];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -1057,7 +1358,7 @@ gst_shark_tracer_hook_mini_object_unreffed (GObject * object, GstClockTime ts,
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
 
-  hook = g_hash_table_lookup (priv->hooks, "mini-object-unreffed");
+  hook = priv->hooks[GST_SHARK_HOOK_MINI_OBJECT_UNREFFED];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -1072,7 +1373,7 @@ gst_shark_tracer_hook_mini_object_reffed (GObject * object, GstClockTime ts,
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
 
-  hook = g_hash_table_lookup (priv->hooks, "mini-object-reffed");
+  hook = priv->hooks[GST_SHARK_HOOK_MINI_OBJECT_REFFED];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime,
@@ -1087,7 +1388,7 @@ gst_shark_tracer_hook_object_created (GObject * object, GstClockTime ts,
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
 
-  hook = g_hash_table_lookup (priv->hooks, "object-created");
+  hook = priv->hooks[GST_SHARK_HOOK_OBJECT_CREATED];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstObject *)) hook) (object, ts, obj);
@@ -1101,7 +1402,7 @@ gst_shark_tracer_hook_object_destroyed (GObject * object, GstClockTime ts,
   GstSharkTracerPrivate *priv = GST_SHARK_TRACER_PRIVATE (self);
   GCallback hook;
 
-  hook = g_hash_table_lookup (priv->hooks, "object-destroyed");
+  hook = priv->hooks[GST_SHARK_HOOK_OBJECT_DESTROYED];
   g_return_if_fail (hook);
 
   ((void (*)(GObject *, GstClockTime, GstObject *)) hook) (object, ts, obj);
@@ -26,6 +26,24 @@
 
 G_BEGIN_DECLS
 
+/* Enough for a GST_TIME_FORMAT string */
+#define GST_SHARK_TIME_STRING_SIZE (32)
+
+/* Values a frame accounts for, such as wall time, CPU time or context
+ * switches */
+#define GST_SHARK_FRAME_VALUES (3)
+
+/* Push or pull in progress in a thread, see gst_shark_tracer_push_frame */
+typedef struct _GstSharkFrame GstSharkFrame;
+struct _GstSharkFrame
+{
+  GstPad *pad;
+  gpointer data;
+  guint64 start[GST_SHARK_FRAME_VALUES];
+  /* Totals of the frames nested in this one */
+  guint64 children[GST_SHARK_FRAME_VALUES];
+};
+
 #define GST_SHARK_TYPE_TRACER (gst_shark_tracer_get_type())
 G_DECLARE_DERIVABLE_TYPE (GstSharkTracer, gst_shark_tracer, GST_SHARK, TRACER, GstTracer)
 
@@ -35,7 +53,18 @@ struct _GstSharkTracerClass
 };
 
 gboolean gst_shark_tracer_element_is_filtered (GstSharkTracer *self, const gchar *regex);
+gboolean gst_shark_tracer_object_is_filtered (GstSharkTracer *self, GstObject *object);
 GList * gst_shark_tracer_get_param (GstSharkTracer *self, const gchar *param);
+const gchar * gst_shark_tracer_pad_name (GstPad *pad);
+gboolean gst_shark_tracer_log_enabled (void);
+GstClockTime gst_shark_tracer_parse_time (const gchar *str, GstClockTime unit);
+
+GArray * gst_shark_tracer_get_frames (GPrivate *frames);
+void gst_shark_tracer_push_frame (GArray *frames, GstPad *pad, gpointer data,
+    const guint64 *start);
+gboolean gst_shark_tracer_pop_frame (GArray *frames, GstPad *pad,
+    const guint64 *end, GstSharkFrame *frame, guint64 *exclusive);
+GstSharkFrame * gst_shark_tracer_peek_frame (GArray *frames);
 
 void gst_shark_tracer_register_hook (GstSharkTracer *self, const gchar *detail,
     GCallback func);
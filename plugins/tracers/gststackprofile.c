@@ -0,0 +1,671 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+/**
+ * SECTION:gststackprofile
+ * @short_description: sample the call stacks of the streaming threads
+ *
+ * A tracing module that interrupts every streaming thread with SIGPROF at
+ * a fixed rate of its CPU time and captures its call stack. Each sample is
+ * tagged with the element the thread was running, tracked from the pad
+ * push and pull hooks, and written to the CTF stream as a folded stack,
+ * root first with the frames separated by ';'.
+ *
+ * The rate param sets the samples per second of CPU time (99 by default)
+ * and depth the frames kept per sample (32 by default, 64 at most). The
+ * samples are collected every period, see #GstPeriodicTracer.
+ *
+ * Only one stackprofile tracer can be active per process, since it owns
+ * the SIGPROF handler. The handler stays installed once the tracer is
+ * gone, a timer signal may still be pending by then.
+ *
+ * Frames are named with dladdr(), so functions not exported are shown as
+ * an offset in their module.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* dladdr */
+#endif
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifdef HAVE_EXECINFO_H
+#include <execinfo.h>
+#endif
+
+#ifdef HAVE_DLADDR
+#include <dlfcn.h>
+#endif
+
+#include "gststackprofile.h"
+#include "gstctf.h"
+
+#if defined (HAVE_TIMER_CREATE) && defined (SIGEV_THREAD_ID) \
+    && defined (CLOCK_THREAD_CPUTIME_ID)
+#define STACKPROFILE_ENABLE
+
+/* Older C libraries don't name the target thread of SIGEV_THREAD_ID */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_stack_profile_debug);
+#define GST_CAT_DEFAULT gst_stack_profile_debug
+
+#define DEFAULT_RATE (99)
+#define MAX_RATE (10000)
+#define DEFAULT_DEPTH (32)
+#define MAX_DEPTH (64)
+/* Frames of the signal handler and of the signal trampoline */
+#define SKIP_FRAMES (2)
+/* Must be a power of two, the ring index is allowed to wrap around */
+#define SAMPLES_SIZE (4096)
+
+typedef enum
+{
+  SAMPLE_FREE,
+  SAMPLE_WRITING,
+  SAMPLE_READY
+} GstStackProfileSampleState;
+
+typedef struct _GstStackProfileSample GstStackProfileSample;
+struct _GstStackProfileSample
+{
+  volatile gint state;
+  guint32 element;
+  guint32 tid;
+  GstClockTime ts;
+  gint depth;
+  gpointer frames[MAX_DEPTH];
+};
+
+/* Sampling state of a streaming thread. The element is only written by
+ * the thread itself and read from its signal handler. The data of its
+ * frames is the element to return to once they end.
+ */
+typedef struct _GstStackProfileThread GstStackProfileThread;
+struct _GstStackProfileThread
+{
+  guint32 tid;
+  volatile guint32 element;
+  GArray *frames;
+  gboolean armed;
+#ifdef STACKPROFILE_ENABLE
+  timer_t timer;
+#endif
+};
+
+/**
+ * GstStackProfileTracer:
+ *
+ * Opaque #GstStackProfileTracer data structure
+ */
+struct _GstStackProfileTracer
+{
+  GstPeriodicTracer parent;
+
+  gboolean active;
+  GstClockTime interval;
+  gint depth;
+
+  /* Only used from the timer thread */
+  GHashTable *symbols;
+  GString *stack;
+};
+
+#define _do_init \
+    GST_DEBUG_CATEGORY_INIT (gst_stack_profile_debug, "stackprofile", 0, "stackprofile tracer");
+
+G_DEFINE_TYPE_WITH_CODE (GstStackProfileTracer, gst_stack_profile_tracer,
+    GST_TYPE_PERIODIC_TRACER, _do_init);
+
+/* Shared with the signal handler, which can neither lock nor allocate */
+static GstStackProfileSample *stackprofile_samples = NULL;
+static volatile gint stackprofile_head = 0;
+static volatile gint stackprofile_dropped = 0;
+static volatile gint stackprofile_depth = DEFAULT_DEPTH;
+
+/* Threads with a sampling timer and the tracer arming them */
+static GMutex stackprofile_mutex;
+static GList *stackprofile_threads = NULL;
+static GstStackProfileTracer *stackprofile_owner = NULL;
+
+static void free_thread (gpointer data);
+static GPrivate stackprofile_thread = G_PRIVATE_INIT (free_thread);
+
+static GstClockTime
+monotonic_now (void)
+{
+  struct timespec now;
+
+  clock_gettime (CLOCK_MONOTONIC, &now);
+
+  return GST_TIMESPEC_TO_TIME (now);
+}
+
+#ifdef STACKPROFILE_ENABLE
+static void
+stackprofile_signal_handler (gint signum, siginfo_t * info, gpointer context)
+{
+  GstStackProfileThread *thread;
+  GstStackProfileSample *samples;
+  GstStackProfileSample *sample;
+  gpointer frames[MAX_DEPTH + SKIP_FRAMES];
+  gint saved_errno;
+  gint depth;
+  guint index;
+
+  samples = g_atomic_pointer_get (&stackprofile_samples);
+  thread = info->si_value.sival_ptr;
+  if (SI_TIMER != info->si_code || NULL == samples || NULL == thread) {
+    return;
+  }
+
+  saved_errno = errno;
+
+  index = (guint) g_atomic_int_add (&stackprofile_head, 1) & (SAMPLES_SIZE - 1);
+  sample = &samples[index];
+  /* The timer thread has not collected this slot yet */
+  if (!g_atomic_int_compare_and_exchange (&sample->state, SAMPLE_FREE,
+          SAMPLE_WRITING)) {
+    g_atomic_int_inc (&stackprofile_dropped);
+    errno = saved_errno;
+    return;
+  }
+
+  sample->ts = monotonic_now ();
+  sample->tid = thread->tid;
+  sample->element = thread->element;
+
+  depth = 0;
+#ifdef HAVE_EXECINFO_H
+  depth = backtrace (frames, g_atomic_int_get (&stackprofile_depth)
+      + SKIP_FRAMES) - SKIP_FRAMES;
+  if (depth > 0) {
+    memcpy (sample->frames, frames + SKIP_FRAMES, depth * sizeof (gpointer));
+  }
+#endif
+  sample->depth = MAX (depth, 0);
+
+  g_atomic_int_set (&sample->state, SAMPLE_READY);
+
+  errno = saved_errno;
+}
+
+static void
+arm_thread (GstStackProfileTracer * self, GstStackProfileThread * thread)
+{
+  struct sigevent event;
+  struct itimerspec spec;
+
+  memset (&event, 0, sizeof (event));
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = SIGPROF;
+  event.sigev_value.sival_ptr = thread;
+  event.sigev_notify_thread_id = thread->tid;
+
+  /* Thread CPU time, so blocked threads are not sampled */
+  if (0 != timer_create (CLOCK_THREAD_CPUTIME_ID, &event, &thread->timer)) {
+    GST_WARNING_OBJECT (self, "Unable to create the timer of thread %u: %s",
+        thread->tid, g_strerror (errno));
+    return;
+  }
+
+  GST_TIME_TO_TIMESPEC (self->interval, spec.it_interval);
+  spec.it_value = spec.it_interval;
+  if (0 != timer_settime (thread->timer, 0, &spec, NULL)) {
+    GST_WARNING_OBJECT (self, "Unable to start the timer of thread %u: %s",
+        thread->tid, g_strerror (errno));
+    timer_delete (thread->timer);
+    return;
+  }
+
+  thread->armed = TRUE;
+}
+
+static void
+disarm_thread (GstStackProfileThread * thread)
+{
+  if (thread->armed) {
+    timer_delete (thread->timer);
+    thread->armed = FALSE;
+  }
+}
+#endif
+
+static void
+free_thread (gpointer data)
+{
+  GstStackProfileThread *thread;
+#ifdef STACKPROFILE_ENABLE
+  sigset_t mask;
+#endif
+
+  thread = (GstStackProfileThread *) data;
+#ifdef STACKPROFILE_ENABLE
+  /* The exiting thread may still get a signal already sent by its timer */
+  sigemptyset (&mask);
+  sigaddset (&mask, SIGPROF);
+  pthread_sigmask (SIG_BLOCK, &mask, NULL);
+#endif
+
+  g_mutex_lock (&stackprofile_mutex);
+#ifdef STACKPROFILE_ENABLE
+  disarm_thread (thread);
+#endif
+  stackprofile_threads = g_list_remove (stackprofile_threads, thread);
+  g_mutex_unlock (&stackprofile_mutex);
+
+  g_array_unref (thread->frames);
+  g_free (thread);
+}
+
+/* Sampling state of the current thread, its timer is started the first
+ * time it goes through a pad.
+ */
+static GstStackProfileThread *
+get_thread (void)
+{
+  GstStackProfileThread *thread;
+
+  thread = g_private_get (&stackprofile_thread);
+  if (G_LIKELY (NULL != thread)) {
+    return thread;
+  }
+
+  thread = g_new0 (GstStackProfileThread, 1);
+  thread->tid = (guint32) syscall (SYS_gettid);
+  thread->frames = g_array_sized_new (FALSE, FALSE, sizeof (GstSharkFrame),
+      16);
+  g_private_set (&stackprofile_thread, thread);
+
+  g_mutex_lock (&stackprofile_mutex);
+  if (NULL != stackprofile_owner) {
+#ifdef STACKPROFILE_ENABLE
+    arm_thread (stackprofile_owner, thread);
+#endif
+    stackprofile_threads = g_list_prepend (stackprofile_threads, thread);
+  }
+  g_mutex_unlock (&stackprofile_mutex);
+
+  return thread;
+}
+
+static guint32
+element_id (GstStackProfileTracer * self, GstObject * object, guint32 current)
+{
+  if (NULL == object || !GST_IS_ELEMENT (object)
+      || !gst_shark_tracer_object_is_filtered (GST_SHARK_TRACER (self),
+          object)) {
+    return current;
+  }
+
+  return gst_ctf_element_name_id (GST_ELEMENT (object));
+}
+
+static void
+enter_element (GstStackProfileTracer * self, GstPad * pad)
+{
+  GstStackProfileThread *thread;
+  GstElement *element;
+  GstPad *peer;
+  guint32 current;
+
+  thread = get_thread ();
+
+  /* Outside any push the thread runs the task of the pushing element */
+  current = thread->element;
+  if (0 == thread->frames->len) {
+    current = element_id (self, GST_OBJECT_PARENT (pad), current);
+  }
+  gst_shark_tracer_push_frame (thread->frames, pad,
+      GUINT_TO_POINTER (current), NULL);
+
+  peer = gst_pad_get_peer (pad);
+  if (NULL != peer) {
+    element = gst_pad_get_parent_element (peer);
+    gst_object_unref (peer);
+    if (NULL != element) {
+      current = element_id (self, GST_OBJECT (element), current);
+      gst_object_unref (element);
+    }
+  }
+
+  thread->element = current;
+}
+
+static void
+leave_element (GstStackProfileTracer * self, GstPad * pad)
+{
+  GstStackProfileThread *thread;
+  GstSharkFrame frame;
+
+  thread = get_thread ();
+
+  if (gst_shark_tracer_pop_frame (thread->frames, pad, NULL, &frame, NULL)) {
+    thread->element = GPOINTER_TO_UINT (frame.data);
+  }
+}
+
+static void
+do_push_buffer_pre (GstStackProfileTracer * self, guint64 ts, GstPad * pad,
+    GstBuffer * buffer)
+{
+  enter_element (self, pad);
+}
+
+static void
+do_push_list_pre (GstStackProfileTracer * self, guint64 ts, GstPad * pad,
+    GstBufferList * list)
+{
+  enter_element (self, pad);
+}
+
+static void
+do_pull_range_pre (GstStackProfileTracer * self, guint64 ts, GstPad * pad,
+    guint64 offset, guint size)
+{
+  enter_element (self, pad);
+}
+
+static void
+do_push_post (GstStackProfileTracer * self, guint64 ts, GstPad * pad,
+    GstFlowReturn res)
+{
+  leave_element (self, pad);
+}
+
+static void
+do_pull_range_post (GstStackProfileTracer * self, guint64 ts, GstPad * pad,
+    GstBuffer * buffer, GstFlowReturn res)
+{
+  leave_element (self, pad);
+}
+
+static const gchar *
+frame_symbol (GstStackProfileTracer * self, gpointer address)
+{
+  gchar *symbol;
+#ifdef HAVE_DLADDR
+  Dl_info info;
+  const gchar *module;
+#endif
+
+  symbol = g_hash_table_lookup (self->symbols, address);
+  if (NULL != symbol) {
+    return symbol;
+  }
+#ifdef HAVE_DLADDR
+  if (0 != dladdr (address, &info)) {
+    if (NULL != info.dli_sname) {
+      symbol = g_strdup (info.dli_sname);
+    } else if (NULL != info.dli_fname) {
+      module = strrchr (info.dli_fname, '/');
+      symbol = g_strdup_printf ("%s+0x%" G_GSIZE_MODIFIER "x",
+          module ? module + 1 : info.dli_fname,
+          (gsize) ((guint8 *) address - (guint8 *) info.dli_fbase));
+    }
+  }
+#endif
+  if (NULL == symbol) {
+    symbol = g_strdup_printf ("%p", address);
+  }
+
+  g_hash_table_insert (self->symbols, address, symbol);
+
+  return symbol;
+}
+
+static const gchar *
+format_stack (GstStackProfileTracer * self, GstStackProfileSample * sample)
+{
+  gint i;
+
+  g_string_truncate (self->stack, 0);
+  for (i = sample->depth - 1; i >= 0; i--) {
+    g_string_append (self->stack, frame_symbol (self, sample->frames[i]));
+    if (i > 0) {
+      g_string_append_c (self->stack, ';');
+    }
+  }
+
+  return self->stack->str;
+}
+
+static gboolean
+collect_samples (GstPeriodicTracer * tracer)
+{
+  GstStackProfileTracer *self;
+  GstStackProfileSample *samples;
+  GstStackProfileSample *sample;
+  GstClockTime now;
+  gint dropped;
+  guint i;
+
+  self = GST_STACK_PROFILE_TRACER (tracer);
+
+  samples = g_atomic_pointer_get (&stackprofile_samples);
+  if (!self->active || NULL == samples) {
+    return TRUE;
+  }
+
+  now = monotonic_now ();
+  for (i = 0; i < SAMPLES_SIZE; i++) {
+    sample = &samples[i];
+    if (SAMPLE_READY != g_atomic_int_get (&sample->state)) {
+      continue;
+    }
+
+    /* The event is written now, the delay locates the sample in time */
+    do_print_stackprofile_event (sample->element, sample->tid,
+        GST_CLOCK_DIFF (sample->ts, now), format_stack (self, sample));
+
+    g_atomic_int_set (&sample->state, SAMPLE_FREE);
+  }
+
+  dropped = GST_PERIODIC_COUNTER_TAKE (stackprofile_dropped);
+  if (dropped > 0) {
+    GST_WARNING_OBJECT (self, "%d samples dropped, lower the rate or the "
+        "period", dropped);
+  }
+
+  return TRUE;
+}
+
+static void
+create_metadata_event (GstPeriodicTracer * tracer)
+{
+  /* Add event in metadata file */
+  gst_ctf_add_event_metadata (STACKPROFILE_EVENT_ID);
+}
+
+static guint64
+get_uint_param (GstStackProfileTracer * self, const gchar * name,
+    guint64 default_value, guint64 max)
+{
+  GList *param;
+  guint64 value;
+  gchar *end;
+
+  param = gst_shark_tracer_get_param (GST_SHARK_TRACER (self), name);
+  if (NULL == param) {
+    return default_value;
+  }
+
+  value = g_ascii_strtoull (param->data, &end, 10);
+  if ('\0' != *end || 0 == value || value > max) {
+    GST_ERROR_OBJECT (self, "Invalid %s \"%s\", it must be between 1 and %"
+        G_GUINT64_FORMAT, name, (gchar *) param->data, max);
+    return default_value;
+  }
+
+  return value;
+}
+
+/* tracer class */
+
+static void
+gst_stack_profile_tracer_constructed (GObject * object)
+{
+  GstStackProfileTracer *self;
+#ifdef STACKPROFILE_ENABLE
+  GstTracer *tracer;
+  struct sigaction action;
+  struct sigaction old_action;
+#ifdef HAVE_EXECINFO_H
+  gpointer frame;
+#endif
+#endif
+
+  /* Let the parent parse the params */
+  G_OBJECT_CLASS (gst_stack_profile_tracer_parent_class)->constructed (object);
+
+  self = GST_STACK_PROFILE_TRACER (object);
+
+  self->interval = GST_SECOND / get_uint_param (self, "rate", DEFAULT_RATE,
+      MAX_RATE);
+  self->depth = get_uint_param (self, "depth", DEFAULT_DEPTH, MAX_DEPTH);
+
+#ifdef STACKPROFILE_ENABLE
+  g_mutex_lock (&stackprofile_mutex);
+  if (NULL != stackprofile_owner) {
+    g_mutex_unlock (&stackprofile_mutex);
+    GST_ERROR_OBJECT (self, "Another stackprofile tracer is already active");
+    return;
+  }
+
+#ifdef HAVE_EXECINFO_H
+  /* The first backtrace loads the unwinder, which is not signal safe */
+  backtrace (&frame, 1);
+#endif
+
+  memset (&action, 0, sizeof (action));
+  action.sa_sigaction = stackprofile_signal_handler;
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset (&action.sa_mask);
+  if (0 != sigaction (SIGPROF, &action, &old_action)) {
+    g_mutex_unlock (&stackprofile_mutex);
+    GST_ERROR_OBJECT (self, "Unable to install the SIGPROF handler: %s",
+        g_strerror (errno));
+    return;
+  }
+  if (SIG_DFL != old_action.sa_handler && SIG_IGN != old_action.sa_handler
+      && stackprofile_signal_handler != old_action.sa_sigaction) {
+    GST_WARNING_OBJECT (self, "Replaced an existing SIGPROF handler");
+  }
+
+  g_atomic_int_set (&stackprofile_depth, self->depth);
+  g_atomic_pointer_set (&stackprofile_samples,
+      g_new0 (GstStackProfileSample, SAMPLES_SIZE));
+  stackprofile_owner = self;
+  self->active = TRUE;
+  g_mutex_unlock (&stackprofile_mutex);
+
+  tracer = GST_TRACER (object);
+
+  GST_INFO_OBJECT (self, "Sampling every %" GST_TIME_FORMAT " of thread CPU "
+      "time, up to %d frames", GST_TIME_ARGS (self->interval), self->depth);
+
+  gst_tracing_register_hook (tracer, "pad-push-pre",
+      G_CALLBACK (do_push_buffer_pre));
+  gst_tracing_register_hook (tracer, "pad-push-post",
+      G_CALLBACK (do_push_post));
+  gst_tracing_register_hook (tracer, "pad-push-list-pre",
+      G_CALLBACK (do_push_list_pre));
+  gst_tracing_register_hook (tracer, "pad-push-list-post",
+      G_CALLBACK (do_push_post));
+  gst_tracing_register_hook (tracer, "pad-pull-range-pre",
+      G_CALLBACK (do_pull_range_pre));
+  gst_tracing_register_hook (tracer, "pad-pull-range-post",
+      G_CALLBACK (do_pull_range_post));
+#else
+  GST_ERROR_OBJECT (self, "Per thread CPU timers are not supported");
+#endif
+}
+
+static void
+gst_stack_profile_tracer_finalize (GObject * object)
+{
+  GstStackProfileTracer *self;
+#ifdef STACKPROFILE_ENABLE
+  GstStackProfileSample *samples;
+  GList *thread;
+#endif
+
+  self = GST_STACK_PROFILE_TRACER (object);
+
+#ifdef STACKPROFILE_ENABLE
+  if (self->active) {
+    g_mutex_lock (&stackprofile_mutex);
+    for (thread = stackprofile_threads; thread; thread = thread->next) {
+      disarm_thread ((GstStackProfileThread *) thread->data);
+    }
+    g_list_free (stackprofile_threads);
+    stackprofile_threads = NULL;
+    stackprofile_owner = NULL;
+    g_mutex_unlock (&stackprofile_mutex);
+
+    samples = g_atomic_pointer_get (&stackprofile_samples);
+    g_atomic_pointer_set (&stackprofile_samples, NULL);
+    g_free (samples);
+  }
+#endif
+
+  g_hash_table_unref (self->symbols);
+  g_string_free (self->stack, TRUE);
+
+  G_OBJECT_CLASS (gst_stack_profile_tracer_parent_class)->finalize (object);
+}
+
+static void
+gst_stack_profile_tracer_class_init (GstStackProfileTracerClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstPeriodicTracerClass *tracer_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  tracer_class = GST_PERIODIC_TRACER_CLASS (klass);
+
+  gobject_class->constructed = gst_stack_profile_tracer_constructed;
+  gobject_class->finalize = gst_stack_profile_tracer_finalize;
+
+  tracer_class->timer_callback = GST_DEBUG_FUNCPTR (collect_samples);
+  tracer_class->write_header = GST_DEBUG_FUNCPTR (create_metadata_event);
+}
+
+static void
+gst_stack_profile_tracer_init (GstStackProfileTracer * self)
+{
+  self->active = FALSE;
+  self->interval = GST_SECOND / DEFAULT_RATE;
+  self->depth = DEFAULT_DEPTH;
+  self->symbols = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      g_free);
+  self->stack = g_string_new (NULL);
+}
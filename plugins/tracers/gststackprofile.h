@@ -0,0 +1,33 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __GST_STACK_PROFILE_TRACER_H__
+#define __GST_STACK_PROFILE_TRACER_H__
+
+#include "gstperiodictracer.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_STACK_PROFILE_TRACER (gst_stack_profile_tracer_get_type())
+G_DECLARE_FINAL_TYPE (GstStackProfileTracer, gst_stack_profile_tracer, GST, STACK_PROFILE_TRACER, GstPeriodicTracer)
+
+G_END_DECLS
+
+#endif /* __GST_STACK_PROFILE_TRACER_H__ */
@@ -0,0 +1,165 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+
+#include "gstaggregate.h"
+
+/* Last bucket, where every value from 2^48 on is counted */
+#define LAST_VALUE ((G_GUINT64_CONSTANT (1) << 48) - 1)
+
+/* Long enough for the flush thread not to close a window during a test */
+#define WINDOW (G_GUINT64_CONSTANT (3600) * GST_SECOND)
+
+GST_START_TEST (test_gst_aggregate_buckets_exact)
+{
+  guint64 value;
+
+  for (value = 0; value < 256; value++) {
+    fail_unless_equals_int (gst_shark_aggregate_value_to_bucket (value),
+        value);
+    fail_unless_equals_uint64 (gst_shark_aggregate_bucket_to_value (value),
+        value);
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_aggregate_buckets_bounds)
+{
+  guint last;
+  guint bucket;
+  guint64 high;
+
+  last = gst_shark_aggregate_value_to_bucket (G_MAXUINT64);
+  fail_unless_equals_int (gst_shark_aggregate_value_to_bucket (LAST_VALUE),
+      last);
+  fail_unless_equals_uint64 (gst_shark_aggregate_bucket_to_value (last),
+      LAST_VALUE);
+
+  /* Every bucket starts right after the highest value of the previous one */
+  for (bucket = 0; bucket < last; bucket++) {
+    high = gst_shark_aggregate_bucket_to_value (bucket);
+    fail_unless_equals_int (gst_shark_aggregate_value_to_bucket (high),
+        bucket);
+    fail_unless_equals_int (gst_shark_aggregate_value_to_bucket (high + 1),
+        bucket + 1);
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_aggregate_buckets_error)
+{
+  guint64 value;
+  guint64 high;
+
+  for (value = 256; value < LAST_VALUE; value = value * 3 / 2 + 7) {
+    high = gst_shark_aggregate_bucket_to_value
+        (gst_shark_aggregate_value_to_bucket (value));
+    fail_unless (high >= value);
+    fail_unless (high - value <= value / 128,
+        "Bucket of %" G_GUINT64_FORMAT " ends at %" G_GUINT64_FORMAT, value,
+        high);
+  }
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_aggregate_stats)
+{
+  GstSharkAggregate *aggregate;
+  GstSharkAggregateStats stats;
+  guint64 value;
+
+  aggregate = gst_shark_aggregate_new ("test", WINDOW);
+  fail_unless (aggregate);
+
+  fail_if (gst_shark_aggregate_get_stats (aggregate, 1, 2, &stats));
+
+  /* Shuffled, the histogram does not depend on the order */
+  for (value = 1; value <= 100; value++) {
+    gst_shark_aggregate_add (aggregate, value, 1, "source", 2, "target",
+        value * 37 % 101);
+  }
+  gst_shark_aggregate_add (aggregate, 0, 3, "other", 0, NULL, 1000);
+
+  fail_unless (gst_shark_aggregate_get_stats (aggregate, 1, 2, &stats));
+  fail_unless_equals_uint64 (stats.count, 100);
+  fail_unless_equals_uint64 (stats.min, 1);
+  fail_unless_equals_uint64 (stats.max, 100);
+  fail_unless_equals_uint64 (stats.mean, 50);
+  fail_unless_equals_uint64 (stats.p500, 50);
+  fail_unless_equals_uint64 (stats.p900, 90);
+  fail_unless_equals_uint64 (stats.p990, 99);
+  fail_unless_equals_uint64 (stats.p999, 100);
+
+  /* A value past the window starts a new one */
+  gst_shark_aggregate_add (aggregate, WINDOW + 1, 1, "source", 2, "target",
+      5000);
+  fail_unless (gst_shark_aggregate_get_stats (aggregate, 1, 2, &stats));
+  fail_unless_equals_uint64 (stats.count, 1);
+  fail_unless_equals_uint64 (stats.min, 5000);
+  fail_unless_equals_uint64 (stats.max, 5000);
+  fail_unless_equals_uint64 (stats.p500, 5000);
+  fail_unless_equals_uint64 (stats.p999, 5000);
+
+  fail_unless (gst_shark_aggregate_get_stats (aggregate, 3, 0, &stats));
+  fail_unless_equals_uint64 (stats.count, 1);
+  fail_unless_equals_uint64 (stats.mean, 1000);
+
+  gst_shark_aggregate_free (aggregate);
+}
+
+GST_END_TEST;
+
+static Suite *
+gst_aggregate_suite (void)
+{
+  Suite *s = suite_create ("GstAggregate");
+  TCase *tc = tcase_create ("/tracers/aggregate");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_aggregate_buckets_exact);
+  tcase_add_test (tc, test_gst_aggregate_buckets_bounds);
+  tcase_add_test (tc, test_gst_aggregate_buckets_error);
+  tcase_add_test (tc, test_gst_aggregate_stats);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  /* The windows are logged to the CTF output, which needs a tracer */
+  g_setenv ("GST_TRACERS", "proctime", TRUE);
+  g_setenv ("GST_SHARK_CTF_DISABLE", "1", TRUE);
+
+  gst_check_init (&argc, &argv);
+
+  return gst_check_run_suite (gst_aggregate_suite (), "gst_aggregate",
+      __FILE__);
+}
@@ -0,0 +1,81 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+
+#include "gstcpuusagecompute.h"
+
+GST_START_TEST (test_gst_proc_stat_parse_ticks)
+{
+  guint64 ticks = 0;
+
+  fail_unless (gst_proc_stat_parse_ticks ("1234 (gst-launch-1.0) S 1 2 3 4 5 "
+          "6 7 8 9 10 250 75 0 0 20 0 1 0 100 4096 50", &ticks));
+  fail_unless_equals_uint64 (ticks, 325);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_proc_stat_parse_ticks_command)
+{
+  guint64 ticks = 0;
+
+  /* The command name may contain spaces and parentheses */
+  fail_unless (gst_proc_stat_parse_ticks ("42 (queue0:src (1)) R 1 2 3 4 5 6 "
+          "7 8 9 10 1000 24 0 0", &ticks));
+  fail_unless_equals_uint64 (ticks, 1024);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_proc_stat_parse_ticks_invalid)
+{
+  guint64 ticks = 0;
+
+  fail_if (gst_proc_stat_parse_ticks ("", &ticks));
+  fail_if (gst_proc_stat_parse_ticks ("1234 gst-launch-1.0 S 1 2 3 4 5 6 7 8 "
+          "9 10 250 75", &ticks));
+  fail_if (gst_proc_stat_parse_ticks ("1234 (gst-launch-1.0) S 1 2 3",
+          &ticks));
+  fail_unless_equals_uint64 (ticks, 0);
+}
+
+GST_END_TEST;
+
+static Suite *
+gst_cpu_usage_compute_suite (void)
+{
+  Suite *s = suite_create ("GstCpuUsageCompute");
+  TCase *tc = tcase_create ("/tracers/cpuusage/stat");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_proc_stat_parse_ticks);
+  tcase_add_test (tc, test_gst_proc_stat_parse_ticks_command);
+  tcase_add_test (tc, test_gst_proc_stat_parse_ticks_invalid);
+
+  return s;
+}
+
+GST_CHECK_MAIN (gst_cpu_usage_compute)
@@ -0,0 +1,122 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+
+#include "gstctfcheck.h"
+
+#define NUM_BUFFERS (50)
+
+/* The identity holds its buffer long enough for the timestamp of the next
+   event of its thread not to fit in a compact header */
+#define SLEEP_TIME_US (4500000)
+
+static gchar *ctf_dir;
+
+GST_START_TEST (test_gst_ctf_writer)
+{
+  CtfTrace trace;
+  gchar *desc;
+
+  desc = g_strdup_printf ("fakesrc num-buffers=%d ! queue ! identity "
+      "name=ident ! fakesink", NUM_BUFFERS);
+  ctf_run_pipeline (desc);
+  g_free (desc);
+
+  ctf_trace_wait_proctime (&trace, ctf_dir, "ident", NUM_BUFFERS);
+
+  /* No event is lost with a ring large enough for all of them */
+  fail_unless_equals_int (ctf_trace_count_proctime (&trace, "ident"),
+      NUM_BUFFERS);
+  /* The main thread and the streaming threads */
+  fail_unless (trace.streams >= 2, "Only %u streams", trace.streams);
+  fail_unless_equals_int (ctf_trace_undefined_names (&trace), 0);
+
+  ctf_trace_clear (&trace);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_ctf_extended_timestamps)
+{
+  CtfTrace trace;
+  gchar *desc;
+
+  desc = g_strdup_printf ("fakesrc num-buffers=1 ! queue ! identity "
+      "name=slow sleep-time=%d ! fakesink", SLEEP_TIME_US);
+  ctf_run_pipeline (desc);
+  g_free (desc);
+
+  ctf_trace_wait_proctime (&trace, ctf_dir, "slow", 1);
+
+  fail_unless_equals_int (ctf_trace_count_proctime (&trace, "slow"), 1);
+  fail_unless (trace.compact_events > 0);
+  /* The event after the sleep needs the full timestamp */
+  fail_unless (trace.extended_events > 0);
+  fail_unless_equals_int (ctf_trace_undefined_names (&trace), 0);
+
+  ctf_trace_clear (&trace);
+}
+
+GST_END_TEST;
+
+static Suite *
+gst_ctf_suite (void)
+{
+  Suite *s = suite_create ("GstCtf");
+  TCase *tc = tcase_create ("/tracers/ctf/datastream");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_ctf_writer);
+  tcase_add_test (tc, test_gst_ctf_extended_timestamps);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret;
+
+  ctf_dir = g_dir_make_tmp ("gstshark-ctf-XXXXXX", NULL);
+  g_assert (ctf_dir);
+
+  g_setenv ("GST_TRACERS", "proctime", TRUE);
+  g_setenv ("GST_SHARK_LOCATION", ctf_dir, TRUE);
+  /* The files are read while the writer is running */
+  g_setenv ("GST_SHARK_FILE_BUFFERING", "0", TRUE);
+  /* Forked tests would not have the writer thread */
+  g_setenv ("CK_FORK", "no", TRUE);
+
+  gst_check_init (&argc, &argv);
+
+  ret = gst_check_run_suite (gst_ctf_suite (), "gst_ctf", __FILE__);
+
+  gst_deinit ();
+  ctf_remove_dir (ctf_dir);
+  g_free (ctf_dir);
+
+  return ret;
+}
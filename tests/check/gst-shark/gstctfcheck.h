@@ -0,0 +1,451 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Decoder of the CTF packets written by gstctf.c and helpers shared by
+   the tests of the different outputs */
+
+#ifndef __GST_CTF_CHECK_H__
+#define __GST_CTF_CHECK_H__
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gstctf.h"
+
+#define CTF_READER_PACKET_MAGIC (0xC1FC1FC1)
+#define CTF_READER_UUID_SIZE (16)
+#define CTF_READER_PACKET_HEADER_SIZE \
+  (4 + CTF_READER_UUID_SIZE + 4 + 8 + 8 + 8 + 8 + 4 + 4)
+#define CTF_READER_EXTENDED_ID (65535)
+
+/* Time the writer gets to flush the rings to the outputs */
+#define CTF_FLUSH_TIMEOUT (5 * G_TIME_SPAN_SECOND)
+
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+#  define CTF_READ_UINT(w,mem) GST_READ_UINT ## w ## _BE (mem)
+#else
+#  define CTF_READ_UINT(w,mem) GST_READ_UINT ## w ## _LE (mem)
+#endif
+
+/* Field types of every event, one letter per field: u for uint32, l for
+   uint64 and s for string */
+/* *INDENT-OFF* */
+#define CTF_READER_FIELD_TYPE_uint32 "u"
+#define CTF_READER_FIELD_TYPE_uint64 "l"
+#define CTF_READER_FIELD_TYPE_string "s"
+#define CTF_READER_FIELD_TYPE(type, field) CTF_READER_FIELD_TYPE_##type
+#define CTF_READER_EVENT_FIELDS(name, id, kind, FIELDS) \
+  [id] = "" FIELDS (CTF_READER_FIELD_TYPE),
+static const gchar *ctf_reader_event_fields[] = {
+  GST_CTF_EVENTS (CTF_READER_EVENT_FIELDS)
+};
+/* *INDENT-ON* */
+
+typedef struct
+{
+  /* Name ID to name, from the name table events of every stream */
+  GHashTable *names;
+  /* Element name IDs of the proctime events */
+  GArray *proctime_elements;
+  guint streams;
+  guint packets;
+  guint init_events;
+  guint compact_events;
+  guint extended_events;
+  /* Total packets reported by the last tcp_dropped event */
+  guint64 tcp_dropped_packets;
+} CtfTrace;
+
+static inline void
+ctf_trace_init (CtfTrace * trace)
+{
+  trace->names = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+  trace->proctime_elements = g_array_new (FALSE, FALSE, sizeof (guint32));
+  trace->streams = 0;
+  trace->packets = 0;
+  trace->init_events = 0;
+  trace->compact_events = 0;
+  trace->extended_events = 0;
+  trace->tcp_dropped_packets = 0;
+}
+
+static inline void
+ctf_trace_clear (CtfTrace * trace)
+{
+  g_hash_table_unref (trace->names);
+  g_array_unref (trace->proctime_elements);
+}
+
+/* Size of the payload of the event, checking it fits in the packet */
+static inline gsize
+ctf_trace_decode_payload (CtfTrace * trace, guint32 id, const guint8 * mem,
+    const guint8 * end)
+{
+  const gchar *field;
+  const guint8 *start;
+  const guint8 *nul;
+  guint32 name_id;
+
+  fail_unless (id < G_N_ELEMENTS (ctf_reader_event_fields),
+      "Unknown event %u", id);
+
+  /* Custom events written by a proctime trace */
+  if (INIT_EVENT_ID == id) {
+    trace->init_events++;
+    return 0;
+  }
+  fail_if (CPUUSAGE_EVENT_ID == id, "Unexpected cpuusage event");
+
+  if (NAME_EVENT_ID == id) {
+    fail_unless ((gsize) (end - mem) > sizeof (guint32));
+    nul = memchr (mem + sizeof (guint32), '\0', end - mem - sizeof (guint32));
+    fail_unless (nul, "Name not terminated");
+    g_hash_table_insert (trace->names,
+        GUINT_TO_POINTER (CTF_READ_UINT (32, mem)),
+        g_strdup ((const gchar *) mem + sizeof (guint32)));
+  } else if (PROCTIME_EVENT_ID == id) {
+    fail_unless ((gsize) (end - mem) >= sizeof (guint32));
+    name_id = CTF_READ_UINT (32, mem);
+    g_array_append_val (trace->proctime_elements, name_id);
+  } else if (TCP_DROPPED_EVENT_ID == id) {
+    fail_unless ((gsize) (end - mem) >= sizeof (guint64));
+    trace->tcp_dropped_packets = CTF_READ_UINT (64, mem);
+  }
+
+  start = mem;
+  for (field = ctf_reader_event_fields[id]; '\0' != *field; field++) {
+    switch (*field) {
+      case 'u':
+        mem += sizeof (guint32);
+        break;
+      case 'l':
+        mem += sizeof (guint64);
+        break;
+      case 's':
+        nul = memchr (mem, '\0', end - mem);
+        fail_unless (nul, "String not terminated");
+        mem = nul + 1;
+        break;
+      default:
+        g_assert_not_reached ();
+    }
+    fail_unless (mem <= end, "Event %u exceeds the packet", id);
+  }
+
+  return mem - start;
+}
+
+/* Decode the packet at the start of data. previous holds the last
+ * timestamp of the stream and is updated. Returns the size of the packet,
+ * or 0 if the packet is not complete yet.
+ */
+static inline gsize
+ctf_trace_decode_packet (CtfTrace * trace, guint32 stream_idx,
+    const guint8 * data, gsize size, guint64 * previous)
+{
+  const guint8 *mem;
+  const guint8 *end;
+  guint64 timestamp;
+  guint64 timestamp_begin;
+  guint64 timestamp_end;
+  guint64 content_size;
+  guint64 packet_size;
+  guint32 id;
+
+  if (size < CTF_READER_PACKET_HEADER_SIZE) {
+    return 0;
+  }
+
+  mem = data;
+  fail_unless_equals_uint64 (CTF_READ_UINT (32, mem), CTF_READER_PACKET_MAGIC);
+  mem += sizeof (guint32) + CTF_READER_UUID_SIZE;
+  /* Every stream shares the same description */
+  fail_unless_equals_uint64 (CTF_READ_UINT (32, mem), 0);
+  mem += sizeof (guint32);
+  timestamp_begin = CTF_READ_UINT (64, mem);
+  mem += sizeof (guint64);
+  timestamp_end = CTF_READ_UINT (64, mem);
+  mem += sizeof (guint64);
+  content_size = CTF_READ_UINT (64, mem) / 8;
+  mem += sizeof (guint64);
+  packet_size = CTF_READ_UINT (64, mem) / 8;
+  mem += sizeof (guint64);
+  /* Events discarded */
+  mem += sizeof (guint32);
+
+  fail_unless (content_size >= CTF_READER_PACKET_HEADER_SIZE);
+  fail_unless (content_size <= packet_size);
+  /* The writer is still writing this packet */
+  if (packet_size > size) {
+    return 0;
+  }
+
+  /* Each thread writes its own stream instance */
+  fail_unless_equals_uint64 (CTF_READ_UINT (32, mem), stream_idx);
+  mem += sizeof (guint32);
+
+  fail_unless (timestamp_begin <= timestamp_end);
+  fail_unless (timestamp_begin >= *previous, "Stream %u goes back in time",
+      stream_idx);
+  /* Compact timestamps continue from the beginning of their packet */
+  *previous = timestamp_begin;
+
+  end = data + content_size;
+  while (mem < end) {
+    fail_unless ((gsize) (end - mem) >= sizeof (guint16) + sizeof (guint32));
+    id = CTF_READ_UINT (16, mem);
+    mem += sizeof (guint16);
+
+    if (CTF_READER_EXTENDED_ID == id) {
+      fail_unless ((gsize) (end - mem) >= sizeof (guint32) + sizeof (guint64));
+      id = CTF_READ_UINT (32, mem);
+      mem += sizeof (guint32);
+      timestamp = CTF_READ_UINT (64, mem);
+      mem += sizeof (guint64);
+      trace->extended_events++;
+    } else {
+      timestamp = *previous & G_GUINT64_CONSTANT (0xFFFFFFFF00000000);
+      timestamp |= CTF_READ_UINT (32, mem);
+      mem += sizeof (guint32);
+      if (timestamp < *previous) {
+        timestamp += G_GUINT64_CONSTANT (0x100000000);
+      }
+      trace->compact_events++;
+    }
+
+    fail_unless (timestamp >= *previous, "Stream %u goes back in time",
+        stream_idx);
+    fail_unless (timestamp >= timestamp_begin && timestamp <= timestamp_end,
+        "Event of stream %u out of its packet", stream_idx);
+    *previous = timestamp;
+
+    mem += ctf_trace_decode_payload (trace, id, mem, end);
+  }
+
+  trace->packets++;
+
+  return packet_size;
+}
+
+/* Decode the complete packets of a datastream file. Returns the size of
+ * the complete packets, so anything past it is still being written.
+ */
+static inline gsize
+ctf_trace_decode_file (CtfTrace * trace, guint32 stream_idx,
+    const gchar * path, gsize * file_size)
+{
+  gchar *contents;
+  guint64 previous;
+  gsize packet_size;
+  gsize offset;
+  gsize size;
+
+  fail_unless (g_file_get_contents (path, &contents, &size, NULL));
+
+  previous = 0;
+  offset = 0;
+  while (0 != (packet_size = ctf_trace_decode_packet (trace, stream_idx,
+              (const guint8 *) contents + offset, size - offset,
+              &previous))) {
+    offset += packet_size;
+  }
+
+  g_free (contents);
+  trace->streams++;
+
+  if (NULL != file_size) {
+    *file_size = size;
+  }
+
+  return offset;
+}
+
+/* Stream index of a datastream_<stream> or rotated
+ * datastream_<stream>_<sequence> file name, or FALSE for other files.
+ */
+static inline gboolean
+ctf_datastream_parse_name (const gchar * name, guint32 * stream_idx,
+    guint32 * sequence)
+{
+  gint len;
+
+  len = 0;
+  *sequence = 0;
+  if (1 != sscanf (name, "datastream_%u%n", stream_idx, &len)) {
+    return FALSE;
+  }
+  if ('_' == name[len]) {
+    name += len + 1;
+    len = 0;
+    if (1 != sscanf (name, "%u%n", sequence, &len)) {
+      return FALSE;
+    }
+  }
+
+  return '\0' == name[len];
+}
+
+/* Decode every datastream file of the trace directory */
+static inline void
+ctf_trace_decode_dir (CtfTrace * trace, const gchar * dir_name)
+{
+  const gchar *name;
+  gchar *path;
+  GError *e = NULL;
+  GDir *dir;
+  guint32 stream_idx;
+  guint32 sequence;
+
+  dir = g_dir_open (dir_name, 0, &e);
+  fail_if (e);
+
+  while (NULL != (name = g_dir_read_name (dir))) {
+    if (!ctf_datastream_parse_name (name, &stream_idx, &sequence)) {
+      continue;
+    }
+
+    path = g_build_filename (dir_name, name, NULL);
+    ctf_trace_decode_file (trace, stream_idx, path, NULL);
+    g_free (path);
+  }
+
+  g_dir_close (dir);
+}
+
+/* Number of proctime events of the element */
+static inline guint
+ctf_trace_count_proctime (CtfTrace * trace, const gchar * element)
+{
+  const gchar *name;
+  guint32 name_id;
+  guint count;
+  guint i;
+
+  count = 0;
+  for (i = 0; i < trace->proctime_elements->len; i++) {
+    name_id = g_array_index (trace->proctime_elements, guint32, i);
+    name = g_hash_table_lookup (trace->names, GUINT_TO_POINTER (name_id));
+    if (0 == g_strcmp0 (name, element)) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/* Number of proctime events whose element name was never defined. Names
+ * are interned once for every thread, so the definition may be in any
+ * stream.
+ */
+static inline guint
+ctf_trace_undefined_names (CtfTrace * trace)
+{
+  guint32 name_id;
+  guint count;
+  guint i;
+
+  count = 0;
+  for (i = 0; i < trace->proctime_elements->len; i++) {
+    name_id = g_array_index (trace->proctime_elements, guint32, i);
+    if (!g_hash_table_contains (trace->names, GUINT_TO_POINTER (name_id))) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/* Remove a trace directory and the files in it */
+static inline void
+ctf_remove_dir (const gchar * dir_name)
+{
+  const gchar *name;
+  gchar *path;
+  GDir *dir;
+
+  dir = g_dir_open (dir_name, 0, NULL);
+  if (NULL != dir) {
+    while (NULL != (name = g_dir_read_name (dir))) {
+      path = g_build_filename (dir_name, name, NULL);
+      if (g_file_test (path, G_FILE_TEST_IS_DIR)) {
+        ctf_remove_dir (path);
+      } else {
+        g_unlink (path);
+      }
+      g_free (path);
+    }
+    g_dir_close (dir);
+  }
+  g_rmdir (dir_name);
+}
+
+static inline void
+ctf_run_pipeline (const gchar * desc)
+{
+  GstElement *pipe;
+  GstMessage *msg;
+  GstBus *bus;
+  GError *e = NULL;
+
+  pipe = gst_parse_launch (desc, &e);
+  fail_if (!pipe);
+  fail_if (e);
+
+  fail_if (GST_STATE_CHANGE_FAILURE == gst_element_set_state (pipe,
+          GST_STATE_PLAYING));
+  bus = gst_element_get_bus (pipe);
+  msg = gst_bus_timed_pop_filtered (bus, 20 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+  gst_element_set_state (pipe, GST_STATE_NULL);
+  gst_object_unref (pipe);
+}
+
+/* Decode the trace directory until it has count proctime events of the
+ * element, or the writer had time enough to flush them. The tracers are
+ * still alive, so the events can only reach the files through the writer
+ * thread. The trace has to be cleared by the caller.
+ */
+static inline void
+ctf_trace_wait_proctime (CtfTrace * trace, const gchar * dir_name,
+    const gchar * element, guint count)
+{
+  gint64 end_time;
+
+  end_time = g_get_monotonic_time () + CTF_FLUSH_TIMEOUT;
+  while (TRUE) {
+    g_usleep (100 * G_TIME_SPAN_MILLISECOND);
+    ctf_trace_init (trace);
+    ctf_trace_decode_dir (trace, dir_name);
+    if (ctf_trace_count_proctime (trace, element) >= count ||
+        g_get_monotonic_time () >= end_time) {
+      break;
+    }
+    ctf_trace_clear (trace);
+  }
+}
+
+#endif /* __GST_CTF_CHECK_H__ */
@@ -0,0 +1,176 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+
+#include "gstctfcheck.h"
+
+#define NUM_BUFFERS (50)
+
+/* Proctime over the threshold requests a snapshot */
+#define SNAPSHOT_PROCTIME_NS "100000000"
+#define SLEEP_TIME_US (200000)
+
+/* Stream instance of the name table of a snapshot */
+#define CTF_NAMES_STREAM_INSTANCE (G_MAXUINT32)
+
+static gchar *ctf_dir;
+
+/* Decode the given snapshot until it holds count proctime events of the
+ * element. The snapshot is written by the writer thread after the
+ * request, so it may not exist yet.
+ */
+static void
+wait_snapshot (CtfTrace * trace, guint snapshot, const gchar * element,
+    guint count)
+{
+  gchar *snapshot_dir;
+  gchar *names;
+  gint64 end_time;
+
+  snapshot_dir = g_strdup_printf ("%s" G_DIR_SEPARATOR_S "snapshot_%u",
+      ctf_dir, snapshot);
+  names = g_build_filename (snapshot_dir, "datastream_names", NULL);
+
+  end_time = g_get_monotonic_time () + CTF_FLUSH_TIMEOUT;
+  while (TRUE) {
+    g_usleep (100 * G_TIME_SPAN_MILLISECOND);
+    ctf_trace_init (trace);
+    if (g_file_test (names, G_FILE_TEST_EXISTS)) {
+      ctf_trace_decode_file (trace, CTF_NAMES_STREAM_INSTANCE, names, NULL);
+      ctf_trace_decode_dir (trace, snapshot_dir);
+    }
+    if (ctf_trace_count_proctime (trace, element) >= count ||
+        g_get_monotonic_time () >= end_time) {
+      break;
+    }
+    ctf_trace_clear (trace);
+  }
+
+  g_free (names);
+  g_free (snapshot_dir);
+}
+
+GST_START_TEST (test_gst_ctf_flight_message)
+{
+  GstElement *element;
+  GstMessage *message;
+  CtfTrace trace;
+  gchar *desc;
+  GDir *dir;
+  const gchar *name;
+
+  desc = g_strdup_printf ("fakesrc num-buffers=%d ! queue ! identity "
+      "name=ident ! fakesink", NUM_BUFFERS);
+  ctf_run_pipeline (desc);
+  g_free (desc);
+
+  /* Nothing is written until a snapshot is requested */
+  g_usleep (500 * G_TIME_SPAN_MILLISECOND);
+  dir = g_dir_open (ctf_dir, 0, NULL);
+  fail_unless (dir);
+  while (NULL != (name = g_dir_read_name (dir))) {
+    fail_if (g_str_has_prefix (name, "datastream"), "%s was written", name);
+  }
+  g_dir_close (dir);
+
+  /* Any element can request a snapshot */
+  element = gst_element_factory_make ("fakesink", NULL);
+  message = gst_message_new_element (GST_OBJECT (element),
+      gst_structure_new_empty ("GstSharkSnapshot"));
+  gst_element_post_message (element, message);
+  gst_object_unref (element);
+
+  wait_snapshot (&trace, 0, "ident", NUM_BUFFERS);
+  fail_unless_equals_int (ctf_trace_count_proctime (&trace, "ident"),
+      NUM_BUFFERS);
+  fail_unless_equals_int (ctf_trace_undefined_names (&trace), 0);
+  ctf_trace_clear (&trace);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_ctf_flight_threshold)
+{
+  CtfTrace trace;
+  gchar *desc;
+
+  desc = g_strdup_printf ("fakesrc num-buffers=1 ! queue ! identity "
+      "name=slow sleep-time=%d ! fakesink", SLEEP_TIME_US);
+  ctf_run_pipeline (desc);
+  g_free (desc);
+
+  /* The recorded window still holds the previous pipeline */
+  wait_snapshot (&trace, 1, "slow", 1);
+  fail_unless_equals_int (ctf_trace_count_proctime (&trace, "slow"), 1);
+  fail_unless_equals_int (ctf_trace_count_proctime (&trace, "ident"),
+      NUM_BUFFERS);
+  fail_unless_equals_int (ctf_trace_undefined_names (&trace), 0);
+  ctf_trace_clear (&trace);
+}
+
+GST_END_TEST;
+
+static Suite *
+gst_ctf_flight_suite (void)
+{
+  Suite *s = suite_create ("GstCtfFlight");
+  TCase *tc = tcase_create ("/tracers/ctf/flight");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_ctf_flight_message);
+  tcase_add_test (tc, test_gst_ctf_flight_threshold);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  gchar *location;
+  int ret;
+
+  ctf_dir = g_dir_make_tmp ("gstshark-ctf-XXXXXX", NULL);
+  g_assert (ctf_dir);
+
+  location = g_strdup_printf ("flight://%s", ctf_dir);
+  g_setenv ("GST_TRACERS", "proctime", TRUE);
+  g_setenv ("GST_SHARK_LOCATION", location, TRUE);
+  g_setenv ("GST_SHARK_SNAPSHOT_PROCTIME", SNAPSHOT_PROCTIME_NS, TRUE);
+  /* Forked tests would not have the writer thread */
+  g_setenv ("CK_FORK", "no", TRUE);
+  g_free (location);
+
+  gst_check_init (&argc, &argv);
+
+  ret = gst_check_run_suite (gst_ctf_flight_suite (), "gst_ctf_flight",
+      __FILE__);
+
+  gst_deinit ();
+  ctf_remove_dir (ctf_dir);
+  g_free (ctf_dir);
+
+  return ret;
+}
@@ -0,0 +1,122 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+
+#include "gstctfcheck.h"
+
+/* The buffers are spread over several flushes of the writer, so the
+   mapping of the streaming thread grows a few times */
+#define NUM_BUFFERS (500)
+#define SLEEP_TIME_US (1000)
+
+static gchar *ctf_dir;
+
+GST_START_TEST (test_gst_ctf_mmap)
+{
+  const gchar *name;
+  CtfTrace trace;
+  GDir *dir;
+  gchar *desc;
+  gchar *path;
+  guint32 stream_idx;
+  guint32 sequence;
+  gsize file_size;
+  gsize packets_size;
+
+  desc = g_strdup_printf ("fakesrc num-buffers=%d ! queue ! identity "
+      "name=ident sleep-time=%d ! fakesink", NUM_BUFFERS, SLEEP_TIME_US);
+  ctf_run_pipeline (desc);
+  g_free (desc);
+
+  ctf_trace_wait_proctime (&trace, ctf_dir, "ident", NUM_BUFFERS);
+  fail_unless_equals_int (ctf_trace_count_proctime (&trace, "ident"),
+      NUM_BUFFERS);
+  fail_unless_equals_int (ctf_trace_undefined_names (&trace), 0);
+  ctf_trace_clear (&trace);
+
+  /* The preallocated space is not part of the file, which only ever ends
+     at a packet boundary */
+  ctf_trace_init (&trace);
+  dir = g_dir_open (ctf_dir, 0, NULL);
+  fail_unless (dir);
+  while (NULL != (name = g_dir_read_name (dir))) {
+    if (!ctf_datastream_parse_name (name, &stream_idx, &sequence)) {
+      continue;
+    }
+
+    path = g_build_filename (ctf_dir, name, NULL);
+    packets_size = ctf_trace_decode_file (&trace, stream_idx, path,
+        &file_size);
+    fail_unless_equals_uint64 (packets_size, file_size);
+    g_free (path);
+  }
+  g_dir_close (dir);
+
+  fail_unless (trace.streams >= 2, "Only %u streams", trace.streams);
+  fail_unless (trace.packets > trace.streams);
+  ctf_trace_clear (&trace);
+}
+
+GST_END_TEST;
+
+static Suite *
+gst_ctf_mmap_suite (void)
+{
+  Suite *s = suite_create ("GstCtfMmap");
+  TCase *tc = tcase_create ("/tracers/ctf/mmap");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_ctf_mmap);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret;
+
+  ctf_dir = g_dir_make_tmp ("gstshark-ctf-XXXXXX", NULL);
+  g_assert (ctf_dir);
+
+  g_setenv ("GST_TRACERS", "proctime", TRUE);
+  g_setenv ("GST_SHARK_LOCATION", ctf_dir, TRUE);
+  /* The smallest chunk, so the mapping is moved over the file */
+  g_setenv ("GST_SHARK_FILE_MMAP", "1", TRUE);
+  /* Forked tests would not have the writer thread */
+  g_setenv ("CK_FORK", "no", TRUE);
+
+  gst_check_init (&argc, &argv);
+
+  ret = gst_check_run_suite (gst_ctf_mmap_suite (), "gst_ctf_mmap",
+      __FILE__);
+
+  gst_deinit ();
+  ctf_remove_dir (ctf_dir);
+  g_free (ctf_dir);
+
+  return ret;
+}
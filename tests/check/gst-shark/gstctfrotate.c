@@ -0,0 +1,162 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+
+#include "gstctfcheck.h"
+
+/* The events of the streaming thread take several files */
+#define NUM_BUFFERS (500)
+#define SLEEP_TIME_US (1000)
+#define MAX_FILE_SIZE (2048)
+#define MAX_FILES (2)
+
+static gchar *ctf_dir;
+
+static void
+check_file_count (gpointer key, gpointer value, gpointer user_data)
+{
+  fail_unless (GPOINTER_TO_UINT (value) <= MAX_FILES,
+      "Stream %u keeps %u files", GPOINTER_TO_UINT (key),
+      GPOINTER_TO_UINT (value));
+}
+
+GST_START_TEST (test_gst_ctf_rotate)
+{
+  const gchar *name;
+  CtfTrace trace;
+  GHashTable *files;
+  GDir *dir;
+  gchar *desc;
+  gchar *path;
+  guint32 stream_idx;
+  guint32 sequence;
+  guint32 last_sequence;
+  gsize file_size;
+  gsize packets_size;
+  guint count;
+  guint proctime_events;
+
+  desc = g_strdup_printf ("fakesrc num-buffers=%d ! queue ! identity "
+      "name=ident sleep-time=%d ! fakesink", NUM_BUFFERS, SLEEP_TIME_US);
+  ctf_run_pipeline (desc);
+  g_free (desc);
+
+  /* Give the writer a few flushes to write the last events */
+  g_usleep (500 * G_TIME_SPAN_MILLISECOND);
+
+  /* Number of files and last sequence of every stream */
+  files = g_hash_table_new (NULL, NULL);
+  last_sequence = 0;
+
+  ctf_trace_init (&trace);
+  dir = g_dir_open (ctf_dir, 0, NULL);
+  fail_unless (dir);
+  while (NULL != (name = g_dir_read_name (dir))) {
+    if (!ctf_datastream_parse_name (name, &stream_idx, &sequence)) {
+      continue;
+    }
+
+    /* Every file is a sequence of complete packets within the cap */
+    path = g_build_filename (ctf_dir, name, NULL);
+    proctime_events = trace.proctime_elements->len;
+    packets_size = ctf_trace_decode_file (&trace, stream_idx, path,
+        &file_size);
+    fail_unless_equals_uint64 (packets_size, file_size);
+    fail_unless (file_size <= MAX_FILE_SIZE, "%s takes %" G_GSIZE_FORMAT
+        " bytes", name, file_size);
+    g_free (path);
+
+    count = GPOINTER_TO_UINT (g_hash_table_lookup (files,
+            GUINT_TO_POINTER (stream_idx)));
+    g_hash_table_insert (files, GUINT_TO_POINTER (stream_idx),
+        GUINT_TO_POINTER (count + 1));
+
+    if (trace.proctime_elements->len > proctime_events) {
+      last_sequence = MAX (last_sequence, sequence);
+    }
+  }
+  g_dir_close (dir);
+
+  /* The oldest files of the streaming thread were deleted */
+  fail_unless (last_sequence >= MAX_FILES, "Only %u files", last_sequence + 1);
+  fail_unless (ctf_trace_count_proctime (&trace, "ident") < NUM_BUFFERS);
+  fail_unless (g_hash_table_size (files) >= 2);
+  g_hash_table_foreach (files, check_file_count, NULL);
+
+  /* The remaining files still define every name they use */
+  fail_unless (trace.proctime_elements->len > 0);
+  fail_unless_equals_int (ctf_trace_undefined_names (&trace), 0);
+
+  g_hash_table_unref (files);
+  ctf_trace_clear (&trace);
+}
+
+GST_END_TEST;
+
+static Suite *
+gst_ctf_rotate_suite (void)
+{
+  Suite *s = suite_create ("GstCtfRotate");
+  TCase *tc = tcase_create ("/tracers/ctf/rotate");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_ctf_rotate);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  gchar *value;
+  int ret;
+
+  ctf_dir = g_dir_make_tmp ("gstshark-ctf-XXXXXX", NULL);
+  g_assert (ctf_dir);
+
+  g_setenv ("GST_TRACERS", "proctime", TRUE);
+  g_setenv ("GST_SHARK_LOCATION", ctf_dir, TRUE);
+  g_setenv ("GST_SHARK_FILE_BUFFERING", "0", TRUE);
+  value = g_strdup_printf ("%d", MAX_FILE_SIZE);
+  g_setenv ("GST_SHARK_MAX_FILE_SIZE", value, TRUE);
+  g_free (value);
+  value = g_strdup_printf ("%d", MAX_FILES);
+  g_setenv ("GST_SHARK_MAX_FILES", value, TRUE);
+  g_free (value);
+  /* Forked tests would not have the writer thread */
+  g_setenv ("CK_FORK", "no", TRUE);
+
+  gst_check_init (&argc, &argv);
+
+  ret = gst_check_run_suite (gst_ctf_rotate_suite (), "gst_ctf_rotate",
+      __FILE__);
+
+  gst_deinit ();
+  ctf_remove_dir (ctf_dir);
+  g_free (ctf_dir);
+
+  return ret;
+}
@@ -0,0 +1,196 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+#include <gio/gio.h>
+#include <string.h>
+
+#include "gstctfcheck.h"
+
+/* Sections of the TCP output */
+#define TCP_METADATA_ID (0x01)
+#define TCP_DATASTREAM_ID (0x03)
+#define TCP_HEADER_SIZE (sizeof (guint8) + sizeof (guint32))
+
+/* The buffers are spread over several flushes of the writer, so the
+   streaming thread writes several packets, and the queue only takes a few
+   of them */
+#define NUM_BUFFERS (30)
+#define SLEEP_TIME_US (20000)
+#define QUEUE_SIZE "512"
+
+/* Time the collector waits for the sender */
+#define SOCKET_TIMEOUT (10)
+
+static guint16 collector_port;
+
+/* Decode a datastream section: a stream index followed by one packet.
+ * timestamps holds the last timestamp of every stream.
+ */
+static void
+decode_section (CtfTrace * trace, GArray * timestamps, const guint8 * section,
+    gsize size)
+{
+  guint32 stream_idx;
+
+  fail_unless (size >= sizeof (guint32));
+  stream_idx = CTF_READ_UINT (32, section);
+
+  if (stream_idx >= timestamps->len) {
+    g_array_set_size (timestamps, stream_idx + 1);
+  }
+
+  /* Each section carries exactly one complete packet */
+  fail_unless_equals_uint64 (ctf_trace_decode_packet (trace, stream_idx,
+          section + sizeof (guint32), size - sizeof (guint32),
+          &g_array_index (timestamps, guint64, stream_idx)),
+      size - sizeof (guint32));
+}
+
+GST_START_TEST (test_gst_ctf_tcp_drop_oldest)
+{
+  GSocketListener *listener;
+  GSocketConnection *connection;
+  GInputStream *input;
+  GError *e = NULL;
+  GArray *timestamps;
+  CtfTrace trace;
+  guint8 header[TCP_HEADER_SIZE];
+  guint8 *section;
+  guint32 section_size;
+  gboolean metadata = FALSE;
+  gchar *desc;
+
+  /* Nobody listens yet, so every packet stays in the queue of the sender
+     and the oldest ones, with the first names, are dropped */
+  desc = g_strdup_printf ("fakesrc num-buffers=%d ! identity name=ident "
+      "sleep-time=%d ! fakesink", NUM_BUFFERS, SLEEP_TIME_US);
+  ctf_run_pipeline (desc);
+  g_free (desc);
+  g_usleep (500 * G_TIME_SPAN_MILLISECOND);
+
+  listener = g_socket_listener_new ();
+  fail_unless (g_socket_listener_add_inet_port (listener, collector_port,
+          NULL, &e));
+  connection = g_socket_listener_accept (listener, NULL, NULL, &e);
+  fail_unless (connection);
+  g_socket_set_timeout (g_socket_connection_get_socket (connection),
+      SOCKET_TIMEOUT);
+  input = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+
+  timestamps = g_array_new (FALSE, TRUE, sizeof (guint64));
+  ctf_trace_init (&trace);
+
+  /* Read until the drops were reported and every name is known again */
+  while (0 == trace.tcp_dropped_packets ||
+      0 == trace.proctime_elements->len ||
+      0 != ctf_trace_undefined_names (&trace)) {
+    fail_unless (g_input_stream_read_all (input, header, sizeof (header),
+            NULL, NULL, &e), "%s", e ? e->message : "");
+    memcpy (&section_size, header + sizeof (guint8), sizeof (section_size));
+
+    section = g_malloc (section_size);
+    fail_unless (g_input_stream_read_all (input, section, section_size, NULL,
+            NULL, &e), "%s", e ? e->message : "");
+
+    if (TCP_METADATA_ID == header[0]) {
+      metadata = TRUE;
+    } else {
+      fail_unless_equals_int (header[0], TCP_DATASTREAM_ID);
+      /* A collector can not decode a packet before the metadata */
+      fail_unless (metadata);
+      decode_section (&trace, timestamps, section, section_size);
+    }
+    g_free (section);
+  }
+
+  /* The init packet was the oldest one */
+  fail_unless_equals_int (trace.init_events, 0);
+  fail_unless (trace.proctime_elements->len < NUM_BUFFERS);
+
+  ctf_trace_clear (&trace);
+  g_array_unref (timestamps);
+  g_object_unref (connection);
+  g_socket_listener_close (listener);
+  g_object_unref (listener);
+}
+
+GST_END_TEST;
+
+static Suite *
+gst_ctf_tcp_suite (void)
+{
+  Suite *s = suite_create ("GstCtfTcp");
+  TCase *tc = tcase_create ("/tracers/ctf/tcp");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_ctf_tcp_drop_oldest);
+
+  return s;
+}
+
+/* Find a free port for the collector, it only listens once the trace
+   started */
+static guint16
+find_free_port (void)
+{
+  GSocketListener *listener;
+  guint16 port;
+
+  listener = g_socket_listener_new ();
+  port = g_socket_listener_add_any_inet_port (listener, NULL, NULL);
+  g_socket_listener_close (listener);
+  g_object_unref (listener);
+
+  return port;
+}
+
+int
+main (int argc, char **argv)
+{
+  gchar *location;
+  int ret;
+
+  collector_port = find_free_port ();
+  g_assert (collector_port);
+
+  location = g_strdup_printf ("tcp://127.0.0.1:%u", collector_port);
+  g_setenv ("GST_TRACERS", "proctime", TRUE);
+  g_setenv ("GST_SHARK_LOCATION", location, TRUE);
+  g_setenv ("GST_SHARK_CTF_DISABLE", "1", TRUE);
+  g_setenv ("GST_SHARK_TCP_QUEUE_SIZE", QUEUE_SIZE, TRUE);
+  g_setenv ("GST_SHARK_TCP_DROP_POLICY", "oldest", TRUE);
+  /* Forked tests would not have the writer and sender threads */
+  g_setenv ("CK_FORK", "no", TRUE);
+  g_free (location);
+
+  gst_check_init (&argc, &argv);
+
+  ret = gst_check_run_suite (gst_ctf_tcp_suite (), "gst_ctf_tcp", __FILE__);
+
+  gst_deinit ();
+
+  return ret;
+}
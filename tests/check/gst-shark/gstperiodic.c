@@ -0,0 +1,177 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+
+#include "gstrecordcheck.h"
+
+#define NUM_BUFFERS (1000)
+#define BUFFER_SIZE (100)
+
+/* Reports of a 100ms period are 10 times the counts of the period */
+#define PERIODS_PER_SECOND (10)
+
+/* Time for the timer to report the last counts after the EOS */
+#define DRAIN_TIME (500 * G_TIME_SPAN_MILLISECOND)
+
+static GstPadProbeReturn
+block_buffers (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  return GST_PAD_PROBE_OK;
+}
+
+/* Run the pipeline, holding the buffers of the source until it is
+ * playing: the counters are reset when the pipeline starts playing.
+ */
+static void
+run_pipeline (const gchar * desc)
+{
+  GstElement *pipe;
+  GstElement *src;
+  GstPad *src_pad;
+  GstMessage *msg;
+  GstBus *bus;
+  GError *e = NULL;
+  gulong probe;
+
+  pipe = gst_parse_launch (desc, &e);
+  fail_if (!pipe);
+  fail_if (e);
+
+  src = gst_bin_get_by_name (GST_BIN (pipe), "src");
+  fail_unless (src);
+  src_pad = gst_element_get_static_pad (src, "src");
+  probe = gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM,
+      block_buffers, NULL, NULL);
+
+  fail_if (GST_STATE_CHANGE_FAILURE == gst_element_set_state (pipe,
+          GST_STATE_PLAYING));
+  fail_unless_equals_int (gst_element_get_state (pipe, NULL, NULL,
+          GST_CLOCK_TIME_NONE), GST_STATE_CHANGE_SUCCESS);
+  gst_pad_remove_probe (src_pad, probe);
+
+  bus = gst_element_get_bus (pipe);
+  msg = gst_bus_timed_pop_filtered (bus, 20 * GST_SECOND,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+
+  g_usleep (DRAIN_TIME);
+
+  gst_object_unref (bus);
+  gst_element_set_state (pipe, GST_STATE_NULL);
+  gst_object_unref (src_pad);
+  gst_object_unref (src);
+  gst_object_unref (pipe);
+}
+
+/* Sum of the per second values reported for the pad */
+static guint64
+sum_records (RecordCapture * capture, const gchar * name, const gchar * pad,
+    const gchar * field)
+{
+  GstStructure *record;
+  const GValue *value;
+  guint64 sum;
+  guint i;
+
+  sum = 0;
+  for (i = 0; i < capture->records->len; i++) {
+    record = g_ptr_array_index (capture->records, i);
+    if (!gst_structure_has_name (record, name) ||
+        0 != g_strcmp0 (gst_structure_get_string (record, "pad"), pad)) {
+      continue;
+    }
+
+    value = gst_structure_get_value (record, field);
+    fail_unless (value);
+    if (G_VALUE_HOLDS_UINT (value)) {
+      sum += g_value_get_uint (value);
+    } else {
+      sum += g_value_get_uint64 (value);
+    }
+  }
+
+  return sum;
+}
+
+GST_START_TEST (test_gst_periodic_counters)
+{
+  RecordCapture capture;
+  gchar *desc;
+
+  record_capture_start (&capture);
+
+  /* The queue pushes from its own thread, while the source keeps adding
+     to its own counter */
+  desc = g_strdup_printf ("fakesrc name=src num-buffers=%d sizetype=fixed "
+      "sizemax=%d ! queue name=q ! fakesink async=false", NUM_BUFFERS,
+      BUFFER_SIZE);
+  run_pipeline (desc);
+  g_free (desc);
+
+  /* Every buffer is counted once, in some period */
+  fail_unless_equals_uint64 (sum_records (&capture, "framerate", "q_src",
+          "fps"), NUM_BUFFERS * PERIODS_PER_SECOND);
+  fail_unless_equals_uint64 (sum_records (&capture, "bitrate", "q_src",
+          "bitrate"), NUM_BUFFERS * BUFFER_SIZE * 8 * PERIODS_PER_SECOND);
+
+  record_capture_stop (&capture);
+}
+
+GST_END_TEST;
+
+static Suite *
+gst_periodic_suite (void)
+{
+  Suite *s = suite_create ("GstPeriodic");
+  TCase *tc = tcase_create ("/tracers/periodic/counters");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_periodic_counters);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret;
+
+  g_setenv ("GST_TRACERS", "framerate(period=100ms);bitrate(period=100ms)",
+      TRUE);
+  /* The records are checked instead of the CTF output */
+  g_setenv ("GST_SHARK_CTF_DISABLE", "1", TRUE);
+
+  gst_check_init (&argc, &argv);
+
+  ret = gst_check_run_suite (gst_periodic_suite (), "gst_periodic",
+      __FILE__);
+
+  gst_deinit ();
+
+  return ret;
+}
@@ -0,0 +1,134 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+
+#include "gstctfcheck.h"
+#include "gstrecordcheck.h"
+
+#define NUM_BUFFERS (5)
+
+/* The first branch of the tee holds every buffer, which is not part of
+   the processing time of the tee for the second branch */
+#define SLEEP_TIME_US (50000)
+
+GST_START_TEST (test_gst_proctime_element)
+{
+  RecordCapture capture;
+  gchar *desc;
+
+  record_capture_start (&capture);
+
+  desc = g_strdup_printf ("fakesrc num-buffers=%d ! identity name=ident ! "
+      "fakesink", NUM_BUFFERS);
+  ctf_run_pipeline (desc);
+  g_free (desc);
+
+  /* Elements with one sink and src pad are reported per element */
+  fail_unless_equals_int (record_capture_count (&capture, "proctime",
+          "element", "ident"), NUM_BUFFERS);
+  fail_unless_equals_int (record_capture_count (&capture, "proctimepads",
+          NULL, NULL), 0);
+
+  record_capture_stop (&capture);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_proctime_pads)
+{
+  RecordCapture capture;
+  GstStructure *record;
+  GstClockTime time;
+  gchar *desc;
+  guint i;
+
+  record_capture_start (&capture);
+
+  desc = g_strdup_printf ("fakesrc num-buffers=%d ! tee name=t "
+      "t. ! identity sleep-time=%d ! fakesink t. ! fakesink", NUM_BUFFERS,
+      SLEEP_TIME_US);
+  ctf_run_pipeline (desc);
+  g_free (desc);
+
+  /* The tee is reported once for every src pad and buffer */
+  fail_unless_equals_int (record_capture_count (&capture, "proctime",
+          "element", "t"), 0);
+  fail_unless_equals_int (record_capture_count (&capture, "proctimepads",
+          "src_pad", "t_src_0"), NUM_BUFFERS);
+  fail_unless_equals_int (record_capture_count (&capture, "proctimepads",
+          "src_pad", "t_src_1"), NUM_BUFFERS);
+
+  for (i = 0; i < capture.records->len; i++) {
+    record = g_ptr_array_index (capture.records, i);
+    if (!gst_structure_has_name (record, "proctimepads")) {
+      continue;
+    }
+
+    fail_unless_equals_string (gst_structure_get_string (record,
+            "sink_pad"), "t_sink");
+    /* The push to the other branch is excluded */
+    time = record_parse_time (gst_structure_get_string (record, "time"));
+    fail_unless (time < SLEEP_TIME_US * GST_USECOND, "%s took %"
+        GST_TIME_FORMAT, gst_structure_get_string (record, "src_pad"),
+        GST_TIME_ARGS (time));
+  }
+
+  record_capture_stop (&capture);
+}
+
+GST_END_TEST;
+
+static Suite *
+gst_proctime_suite (void)
+{
+  Suite *s = suite_create ("GstProcTime");
+  TCase *tc = tcase_create ("/tracers/proctime");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_proctime_element);
+  tcase_add_test (tc, test_gst_proctime_pads);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret;
+
+  g_setenv ("GST_TRACERS", "proctime", TRUE);
+  /* The records are checked instead of the CTF output */
+  g_setenv ("GST_SHARK_CTF_DISABLE", "1", TRUE);
+
+  gst_check_init (&argc, &argv);
+
+  ret = gst_check_run_suite (gst_proctime_suite (), "gst_proctime",
+      __FILE__);
+
+  gst_deinit ();
+
+  return ret;
+}
@@ -0,0 +1,146 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+
+#include "gstctfcheck.h"
+#include "gstrecordcheck.h"
+
+/* fakesrc timestamps its buffers from their size and the data rate */
+#define FAKESRC_TIMESTAMPED "fakesrc sizetype=fixed sizemax=100 " \
+    "datarate=100000"
+
+/* The sink is slower than the source, so the queue holds several buffers */
+#define NUM_BUFFERS (20)
+#define SLEEP_TIME_US (10000)
+
+/* More than the inputs kept without a matching output */
+#define NUM_REWRITTEN_BUFFERS (1100)
+
+/* Longest proctime of the element */
+static GstClockTime
+max_proctime (RecordCapture * capture, const gchar * element)
+{
+  GstStructure *record;
+  GstClockTime time;
+  GstClockTime max;
+  guint i;
+
+  max = 0;
+  for (i = 0; i < capture->records->len; i++) {
+    record = g_ptr_array_index (capture->records, i);
+    if (!gst_structure_has_name (record, "proctime") ||
+        0 != g_strcmp0 (gst_structure_get_string (record, "element"),
+            element)) {
+      continue;
+    }
+
+    time = record_parse_time (gst_structure_get_string (record, "time"));
+    max = MAX (max, time);
+  }
+
+  return max;
+}
+
+GST_START_TEST (test_gst_proctime_correlate_queue)
+{
+  RecordCapture capture;
+  gchar *desc;
+
+  record_capture_start (&capture);
+
+  desc = g_strdup_printf (FAKESRC_TIMESTAMPED " num-buffers=%d ! queue "
+      "name=q ! identity sleep-time=%d ! fakesink", NUM_BUFFERS,
+      SLEEP_TIME_US);
+  ctf_run_pipeline (desc);
+  g_free (desc);
+
+  /* Every buffer is matched at the output of the queue */
+  fail_unless_equals_int (record_capture_count (&capture, "proctime",
+          "element", "q"), NUM_BUFFERS);
+  /* The last buffers waited for most of the others to be consumed */
+  fail_unless (max_proctime (&capture, "q") >
+      NUM_BUFFERS / 2 * SLEEP_TIME_US * GST_USECOND);
+
+  record_capture_stop (&capture);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_proctime_correlate_mismatch)
+{
+  RecordCapture capture;
+  guint count;
+  gchar *desc;
+
+  record_capture_start (&capture);
+
+  /* The identity timestamps its outputs from its own data rate */
+  desc = g_strdup_printf (FAKESRC_TIMESTAMPED " num-buffers=%d ! identity "
+      "name=rewrite datarate=1 ! fakesink", NUM_REWRITTEN_BUFFERS);
+  ctf_run_pipeline (desc);
+  g_free (desc);
+
+  /* Once too many inputs are pending, it is measured without correlation */
+  count = record_capture_count (&capture, "proctime", "element", "rewrite");
+  fail_unless (count > 0);
+  fail_unless (count < NUM_REWRITTEN_BUFFERS);
+
+  record_capture_stop (&capture);
+}
+
+GST_END_TEST;
+
+static Suite *
+gst_proctime_correlate_suite (void)
+{
+  Suite *s = suite_create ("GstProcTimeCorrelate");
+  TCase *tc = tcase_create ("/tracers/proctime/correlate");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_proctime_correlate_queue);
+  tcase_add_test (tc, test_gst_proctime_correlate_mismatch);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret;
+
+  g_setenv ("GST_TRACERS", "proctime(correlate=buffer)", TRUE);
+  /* The records are checked instead of the CTF output */
+  g_setenv ("GST_SHARK_CTF_DISABLE", "1", TRUE);
+
+  gst_check_init (&argc, &argv);
+
+  ret = gst_check_run_suite (gst_proctime_correlate_suite (),
+      "gst_proctime_correlate", __FILE__);
+
+  gst_deinit ();
+
+  return ret;
+}
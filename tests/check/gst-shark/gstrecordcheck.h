@@ -0,0 +1,127 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Capture of the records logged by the tracers, to check their values
+   without decoding the CTF output */
+
+#ifndef __GST_RECORD_CHECK_H__
+#define __GST_RECORD_CHECK_H__
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+#include <stdio.h>
+
+typedef struct
+{
+  GMutex mutex;
+  /* GstStructure of every record logged, in order */
+  GPtrArray *records;
+} RecordCapture;
+
+static void
+record_capture_log (GstDebugCategory * category, GstDebugLevel level,
+    const gchar * file, const gchar * function, gint line, GObject * object,
+    GstDebugMessage * message, gpointer user_data)
+{
+  RecordCapture *capture = (RecordCapture *) user_data;
+  GstStructure *record;
+
+  if (GST_LEVEL_TRACE != level ||
+      0 != g_strcmp0 (gst_debug_category_get_name (category), "GST_TRACER")) {
+    return;
+  }
+
+  record = gst_structure_from_string (gst_debug_message_get (message), NULL);
+  if (NULL == record) {
+    return;
+  }
+
+  g_mutex_lock (&capture->mutex);
+  g_ptr_array_add (capture->records, record);
+  g_mutex_unlock (&capture->mutex);
+}
+
+/* Start capturing the records, they are only logged while GST_TRACER is
+ * traced.
+ */
+static inline void
+record_capture_start (RecordCapture * capture)
+{
+  g_mutex_init (&capture->mutex);
+  capture->records =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) gst_structure_free);
+
+  gst_debug_set_threshold_for_name ("GST_TRACER", GST_LEVEL_TRACE);
+  gst_debug_add_log_function (record_capture_log, capture, NULL);
+}
+
+static inline void
+record_capture_stop (RecordCapture * capture)
+{
+  gst_debug_remove_log_function (record_capture_log);
+  gst_debug_unset_threshold_for_name ("GST_TRACER");
+
+  g_ptr_array_unref (capture->records);
+  g_mutex_clear (&capture->mutex);
+}
+
+/* Records with the given name, and the given string field value if not
+ * NULL. The records are only read once the pipeline stopped.
+ */
+static inline guint
+record_capture_count (RecordCapture * capture, const gchar * name,
+    const gchar * field, const gchar * value)
+{
+  GstStructure *record;
+  guint count;
+  guint i;
+
+  count = 0;
+  for (i = 0; i < capture->records->len; i++) {
+    record = g_ptr_array_index (capture->records, i);
+    if (!gst_structure_has_name (record, name)) {
+      continue;
+    }
+    if (NULL == field ||
+        0 == g_strcmp0 (gst_structure_get_string (record, field), value)) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/* Parse a time logged with GST_TIME_FORMAT */
+static inline GstClockTime
+record_parse_time (const gchar * time_string)
+{
+  guint hours;
+  guint minutes;
+  guint seconds;
+  guint nanoseconds;
+
+  fail_unless (time_string);
+  fail_unless_equals_int (sscanf (time_string, "%u:%u:%u.%u", &hours,
+          &minutes, &seconds, &nanoseconds), 4);
+
+  return (((hours * 60 + minutes) * 60 + seconds) * GST_SECOND) + nanoseconds;
+}
+
+#endif /* __GST_RECORD_CHECK_H__ */
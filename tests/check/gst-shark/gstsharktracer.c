@@ -0,0 +1,233 @@
+/* GstShark - A Front End for GstTracer
+ * Copyright (C) 2024 RidgeRun Engineering <manuel.leiva@ridgerun.com>
+ *
+ * This file is part of GstShark.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/check/gstcheck.h>
+
+#include "gstsharktracer.h"
+
+/* A shark tracer without hooks, only its params are used */
+#define GST_TYPE_TEST_TRACER (gst_test_tracer_get_type ())
+G_DECLARE_FINAL_TYPE (GstTestTracer, gst_test_tracer, GST, TEST_TRACER,
+    GstSharkTracer);
+
+struct _GstTestTracer
+{
+  GstSharkTracer parent;
+};
+
+G_DEFINE_TYPE (GstTestTracer, gst_test_tracer, GST_SHARK_TYPE_TRACER);
+
+static void
+gst_test_tracer_class_init (GstTestTracerClass * klass)
+{
+}
+
+static void
+gst_test_tracer_init (GstTestTracer * self)
+{
+}
+
+static GstSharkTracer *
+test_tracer_new (const gchar * params)
+{
+  return g_object_new (GST_TYPE_TEST_TRACER, "params", params, NULL);
+}
+
+GST_START_TEST (test_gst_shark_tracer_filter_none)
+{
+  GstSharkTracer *tracer;
+  GstElement *element;
+
+  tracer = test_tracer_new (NULL);
+  element = gst_element_factory_make ("identity", "ident");
+
+  /* Without filters every element is traced */
+  fail_unless (gst_shark_tracer_element_is_filtered (tracer, "ident"));
+  fail_unless (gst_shark_tracer_object_is_filtered (tracer,
+          GST_OBJECT (element)));
+
+  gst_object_unref (element);
+  g_object_unref (tracer);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_shark_tracer_filter_several)
+{
+  GstSharkTracer *tracer;
+  GstElement *sink;
+  GstElement *queue;
+
+  tracer = test_tracer_new ("filter=^src,filter=sink$");
+  sink = gst_element_factory_make ("fakesink", "videosink");
+  queue = gst_element_factory_make ("queue", "queue0");
+
+  /* Only the second filter matches */
+  fail_unless (gst_shark_tracer_element_is_filtered (tracer, "videosink"));
+  fail_unless (gst_shark_tracer_object_is_filtered (tracer,
+          GST_OBJECT (sink)));
+  fail_unless (gst_shark_tracer_element_is_filtered (tracer, "src0"));
+  fail_if (gst_shark_tracer_element_is_filtered (tracer, "queue0"));
+  fail_if (gst_shark_tracer_object_is_filtered (tracer, GST_OBJECT (queue)));
+
+  /* The cached results are the same */
+  fail_unless (gst_shark_tracer_object_is_filtered (tracer,
+          GST_OBJECT (sink)));
+  fail_if (gst_shark_tracer_object_is_filtered (tracer, GST_OBJECT (queue)));
+
+  gst_object_unref (queue);
+  gst_object_unref (sink);
+  g_object_unref (tracer);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_shark_tracer_filter_per_tracer)
+{
+  GstSharkTracer *sinks;
+  GstSharkTracer *queues;
+  GstElement *sink;
+  GstElement *queue;
+
+  sinks = test_tracer_new ("filter=sink");
+  queues = test_tracer_new ("filter=queue");
+  sink = gst_element_factory_make ("fakesink", "sink0");
+  queue = gst_element_factory_make ("queue", "queue0");
+
+  /* Each tracer caches its own result on the same object */
+  fail_unless (gst_shark_tracer_object_is_filtered (sinks, GST_OBJECT (sink)));
+  fail_if (gst_shark_tracer_object_is_filtered (queues, GST_OBJECT (sink)));
+  fail_if (gst_shark_tracer_object_is_filtered (sinks, GST_OBJECT (queue)));
+  fail_unless (gst_shark_tracer_object_is_filtered (queues,
+          GST_OBJECT (queue)));
+
+  fail_unless (gst_shark_tracer_object_is_filtered (sinks, GST_OBJECT (sink)));
+  fail_if (gst_shark_tracer_object_is_filtered (queues, GST_OBJECT (sink)));
+
+  gst_object_unref (queue);
+  gst_object_unref (sink);
+  g_object_unref (queues);
+  g_object_unref (sinks);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_shark_tracer_filter_invalid)
+{
+  GstSharkTracer *tracer;
+
+  /* An invalid filter is ignored, the valid ones still apply */
+  tracer = test_tracer_new ("filter=(,filter=ident");
+
+  fail_unless (gst_shark_tracer_element_is_filtered (tracer, "ident"));
+  fail_if (gst_shark_tracer_element_is_filtered (tracer, "queue0"));
+
+  g_object_unref (tracer);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_shark_tracer_parse_time_suffix)
+{
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("2s", GST_MSECOND),
+      2 * GST_SECOND);
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("100ms",
+          GST_SECOND), 100 * GST_MSECOND);
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("20us",
+          GST_SECOND), 20 * GST_USECOND);
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("7ns", GST_SECOND),
+      7);
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("0ms", GST_SECOND),
+      0);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_shark_tracer_parse_time_unit)
+{
+  /* Values without suffix are in the unit of the caller */
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("3", GST_SECOND),
+      3 * GST_SECOND);
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("3", GST_MSECOND),
+      3 * GST_MSECOND);
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("3", 1), 3);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_gst_shark_tracer_parse_time_invalid)
+{
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("", GST_SECOND),
+      GST_CLOCK_TIME_NONE);
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("ms", GST_SECOND),
+      GST_CLOCK_TIME_NONE);
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("10m", GST_SECOND),
+      GST_CLOCK_TIME_NONE);
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("10 s",
+          GST_SECOND), GST_CLOCK_TIME_NONE);
+  fail_unless_equals_uint64 (gst_shark_tracer_parse_time ("10sec",
+          GST_SECOND), GST_CLOCK_TIME_NONE);
+}
+
+GST_END_TEST;
+
+static Suite *
+gst_shark_tracer_suite (void)
+{
+  Suite *s = suite_create ("GstSharkTracer");
+  TCase *tc = tcase_create ("/tracers/sharktracer/filter");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_shark_tracer_filter_none);
+  tcase_add_test (tc, test_gst_shark_tracer_filter_several);
+  tcase_add_test (tc, test_gst_shark_tracer_filter_per_tracer);
+  tcase_add_test (tc, test_gst_shark_tracer_filter_invalid);
+
+  tc = tcase_create ("/tracers/sharktracer/parse_time");
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_gst_shark_tracer_parse_time_suffix);
+  tcase_add_test (tc, test_gst_shark_tracer_parse_time_unit);
+  tcase_add_test (tc, test_gst_shark_tracer_parse_time_invalid);
+
+  return s;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret;
+
+  /* The tracers of the test do not write any trace */
+  g_setenv ("GST_SHARK_CTF_DISABLE", "1", TRUE);
+
+  gst_check_init (&argc, &argv);
+
+  ret = gst_check_run_suite (gst_shark_tracer_suite (), "gst_shark_tracer",
+      __FILE__);
+
+  gst_deinit ();
+
+  return ret;
+}